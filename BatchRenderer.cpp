@@ -0,0 +1,517 @@
+#include "BatchRenderer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <QCoreApplication>
+#include <QProcess>
+#include <QDir>
+#include <QImage>
+#include "OpenGLWidget.h"
+#include "VideoWriter.h"
+#include "FieldStatistics.h"
+#include "Expression.h"
+#include "FARGO.h"
+#include "PackedFARGO.h"
+#include "Pack.h"
+
+static const char* const elementNames[] = { "disk", "grid", "border", "planets", "particles", "orbits", "roche", "sky", "text", "key" };
+static const unsigned int NElements = sizeof(elementNames)/sizeof(elementNames[0]);
+
+BatchRenderer::BatchRenderer()
+{
+	firstTimestep = 0;
+	lastTimestep = -1;
+	step = 1;
+	width = 1280;
+	height = 720;
+	fps = 25;
+
+	quantityType = Simulation::DENSITY;
+	hasMinimum = false;
+	hasMaximum = false;
+	minimumValue = 10;
+	maximumValue = 1000;
+	logarithmic = -1;
+	autoscale = false;
+
+	hasCameraPosition = false;
+	hasCameraLookAt = false;
+	hasCameraUp = false;
+
+	// same defaults as the menu of the viewer
+	shown << "disk" << "planets" << "orbits" << "text" << "key";
+
+	jobs = 1;
+	worker = -1;
+}
+
+BatchRenderer::~BatchRenderer()
+{
+}
+
+void BatchRenderer::printUsage(const char* program)
+{
+	printf("Usage: %s --render <simulation> <output directory> [options]\n", program);
+	printf("       %s --render <simulation> --video <output> [options]\n", program);
+	printf("Options:\n");
+	printf("  --first <timestep>                first timestep to render (default 0)\n");
+	printf("  --last <timestep>                 last timestep to render (default last of the simulation)\n");
+	printf("  --step <n>                        render every n-th timestep\n");
+	printf("  --size <width>x<height>           size of the images (default 1280x720)\n");
+	printf("  --quantity <quantity>             density, temperature, vradial, vazimuthal, vorticity,\n");
+	printf("                                    vortensity, toomreq, massflux or expression\n");
+	printf("  --expression <expression>         expression of quantity 'expression'\n");
+	printf("  --minimum <value>                 minimum of the color scale\n");
+	printf("  --maximum <value>                 maximum of the color scale\n");
+	printf("  --autoscale                       scale each frame to its minimum and maximum\n");
+	printf("  --logarithmic | --linear          scale of the colors\n");
+	printf("  --palette <value:#rrggbb,...>     colors of the palette\n");
+	printf("  --camera-position <x,y,z>         position of the camera\n");
+	printf("  --camera-look-at <x,y,z>          point the camera looks at\n");
+	printf("  --camera-up <x,y,z>               up direction of the camera\n");
+	printf("  --show <element>                  show disk, grid, border, planets, particles, orbits,\n");
+	printf("  --hide <element>                  roche, sky, text or key\n");
+	printf("  --video <file | |command>         write a Y4M video to a file or into a command,\n");
+	printf("                                    e.g. \"| ffmpeg -i - movie.mp4\", instead of images\n");
+	printf("  --fps <n>                         frames per second of the video (default 25)\n");
+	printf("  --jobs <n>                        number of worker processes (images only)\n");
+	printf("\n");
+	printf("Without a display the renderer runs in a virtual X server, e.g. 'xvfb-run -a %s --render ...'.\n", program);
+}
+
+/**
+	parses a vector like "1,2.5,-3"
+*/
+int BatchRenderer::parseVector(const QString& text, double* vector)
+{
+	QStringList parts = text.split(',');
+
+	if (parts.size() != 3) {
+		return -1;
+	}
+
+	for (int i = 0; i < 3; ++i) {
+		bool ok;
+		vector[i] = parts[i].toDouble(&ok);
+		if (!ok) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+bool BatchRenderer::isElement(const QString& name)
+{
+	for (unsigned int i = 0; i < NElements; ++i) {
+		if (name == elementNames[i]) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+	parses the arguments following --render
+
+	\returns 0 on success, -1 on invalid arguments
+*/
+int BatchRenderer::parseArguments(const QStringList& arguments)
+{
+	this->arguments = arguments;
+
+	QStringList positional;
+
+	for (int i = 0; i < arguments.size(); ++i) {
+		const QString& argument = arguments[i];
+
+		if (!argument.startsWith("--")) {
+			positional << argument;
+			continue;
+		}
+
+		if ((argument == "--logarithmic") || (argument == "--linear")) {
+			logarithmic = (argument == "--logarithmic") ? 1 : 0;
+			continue;
+		}
+		if (argument == "--autoscale") {
+			autoscale = true;
+			continue;
+		}
+
+		// everything else has a value
+		if (i+1 >= arguments.size()) {
+			fprintf(stderr, "Missing value of '%s'.\n", argument.toAscii().constData());
+			return -1;
+		}
+		const QString& value = arguments[++i];
+		bool ok = true;
+
+		if (argument == "--first") {
+			firstTimestep = value.toInt(&ok);
+			ok = ok && (firstTimestep >= 0);
+		} else if (argument == "--last") {
+			lastTimestep = value.toInt(&ok);
+			ok = ok && (lastTimestep >= 0);
+		} else if (argument == "--step") {
+			step = value.toUInt(&ok);
+			ok = ok && (step > 0);
+		} else if (argument == "--size") {
+			QStringList parts = value.split('x');
+			ok = (parts.size() == 2);
+			if (ok) {
+				bool okHeight;
+				width = parts[0].toUInt(&ok);
+				height = parts[1].toUInt(&okHeight);
+				ok = ok && okHeight && (width > 0) && (height > 0);
+			}
+		} else if (argument == "--quantity") {
+			if (value == "density") {
+				quantityType = Simulation::DENSITY;
+			} else if (value == "temperature") {
+				quantityType = Simulation::TEMPERATURE;
+			} else if (value == "vradial") {
+				quantityType = Simulation::V_RADIAL;
+			} else if (value == "vazimuthal") {
+				quantityType = Simulation::V_AZIMUTHAL;
+			} else if (value == "vorticity") {
+				quantityType = Simulation::VORTICITY;
+			} else if (value == "vortensity") {
+				quantityType = Simulation::VORTENSITY;
+			} else if (value == "toomreq") {
+				quantityType = Simulation::TOOMRE_Q;
+			} else if (value == "massflux") {
+				quantityType = Simulation::MASS_FLUX;
+			} else if (value == "expression") {
+				quantityType = Simulation::EXPRESSION;
+			} else {
+				ok = false;
+			}
+		} else if (argument == "--expression") {
+			expression = value;
+		} else if (argument == "--minimum") {
+			minimumValue = value.toDouble(&ok);
+			hasMinimum = true;
+		} else if (argument == "--maximum") {
+			maximumValue = value.toDouble(&ok);
+			hasMaximum = true;
+		} else if (argument == "--palette") {
+			palette.clear();
+			QStringList entries = value.split(',');
+			for (int j = 0; ok && (j < entries.size()); ++j) {
+				QStringList parts = entries[j].split(':');
+				ok = (parts.size() == 2);
+				if (ok) {
+					unsigned int position = parts[0].toUInt(&ok);
+					QColor color(parts[1]);
+					ok = ok && color.isValid();
+					palette.append(qMakePair(position, color));
+				}
+			}
+		} else if (argument == "--camera-position") {
+			ok = (parseVector(value, cameraPosition) == 0);
+			hasCameraPosition = true;
+		} else if (argument == "--camera-look-at") {
+			ok = (parseVector(value, cameraLookAt) == 0);
+			hasCameraLookAt = true;
+		} else if (argument == "--camera-up") {
+			ok = (parseVector(value, cameraUp) == 0);
+			hasCameraUp = true;
+		} else if (argument == "--show") {
+			ok = isElement(value);
+			if (ok && !shown.contains(value)) {
+				shown << value;
+			}
+		} else if (argument == "--hide") {
+			ok = isElement(value);
+			shown.removeAll(value);
+		} else if (argument == "--video") {
+			videoOutput = value;
+		} else if (argument == "--fps") {
+			fps = value.toUInt(&ok);
+			ok = ok && (fps > 0);
+		} else if (argument == "--jobs") {
+			jobs = value.toUInt(&ok);
+			ok = ok && (jobs > 0);
+		} else if (argument == "--worker") {
+			worker = value.toInt(&ok);
+		} else {
+			fprintf(stderr, "Unknown option '%s'.\n", argument.toAscii().constData());
+			return -1;
+		}
+
+		if (!ok) {
+			fprintf(stderr, "Invalid value '%s' of '%s'.\n", value.toAscii().constData(), argument.toAscii().constData());
+			return -1;
+		}
+	}
+
+	if (!videoOutput.isEmpty()) {
+		if (positional.size() != 1) {
+			fprintf(stderr, "Please provide the simulation (and no output directory with --video).\n");
+			return -1;
+		}
+		// the stream needs the frames in order
+		if (jobs > 1) {
+			fprintf(stderr, "--jobs can not be used with --video.\n");
+			return -1;
+		}
+		positional << QString();
+	} else if (positional.size() != 2) {
+		fprintf(stderr, "Please provide the simulation and the output directory.\n");
+		return -1;
+	}
+
+	if ((worker >= 0) && ((unsigned int)worker >= jobs)) {
+		fprintf(stderr, "Invalid worker %i of %u jobs.\n", worker, jobs);
+		return -1;
+	}
+
+	simulationFilename = positional[0];
+	outputDirectory = positional[1];
+
+	return 0;
+}
+
+/**
+	renders all frames, in worker processes if more than one job is requested
+
+	\returns 0 if all frames were written, -1 otherwise
+*/
+int BatchRenderer::run()
+{
+	if (videoOutput.isEmpty() && !QDir().mkpath(outputDirectory)) {
+		fprintf(stderr, "Could not create output directory '%s'.\n", outputDirectory.toAscii().constData());
+		return -1;
+	}
+
+	if ((jobs > 1) && (worker < 0)) {
+		return runWorkers();
+	}
+
+	return renderFrames();
+}
+
+/**
+	starts a process per job rendering every jobs-th frame and waits for all of them
+*/
+int BatchRenderer::runWorkers()
+{
+	QList<QProcess*> processes;
+	int ret = 0;
+
+	for (unsigned int i = 0; i < jobs; ++i) {
+		QProcess* process = new QProcess;
+		process->setProcessChannelMode(QProcess::ForwardedChannels);
+		process->start(QCoreApplication::applicationFilePath(), QStringList() << "--render" << arguments << "--worker" << QString::number(i));
+		processes.append(process);
+	}
+
+	for (int i = 0; i < processes.size(); ++i) {
+		QProcess* process = processes[i];
+
+		if (!process->waitForFinished(-1) || (process->exitStatus() != QProcess::NormalExit) || (process->exitCode() != 0)) {
+			fprintf(stderr, "Worker %i failed.\n", i);
+			ret = -1;
+		}
+
+		delete process;
+	}
+
+	return ret;
+}
+
+void BatchRenderer::applySettings(OpenGLWidget* openGLWidget, Simulation* simulation)
+{
+	openGLWidget->updateShowDisk(shown.contains("disk"));
+	openGLWidget->updateShowGrid(shown.contains("grid"));
+	openGLWidget->updateShowDiskBorder(shown.contains("border"));
+	openGLWidget->updateShowPlanets(shown.contains("planets"));
+	openGLWidget->updateShowParticles(shown.contains("particles"));
+	openGLWidget->updateShowOrbits(shown.contains("orbits"));
+	openGLWidget->updateShowRocheLobe(shown.contains("roche"));
+	openGLWidget->updateShowSky(shown.contains("sky"));
+	openGLWidget->updateShowText(shown.contains("text"));
+	openGLWidget->updateShowKey(shown.contains("key"));
+	openGLWidget->updateSaveScreenshots(false);
+
+	if (!palette.isEmpty()) {
+		Palette* widgetPalette = openGLWidget->getPalette();
+		widgetPalette->clear();
+		for (int i = 0; i < palette.size(); ++i) {
+			widgetPalette->addColor(palette[i].first, palette[i].second);
+		}
+	}
+
+	if (logarithmic >= 0) {
+		openGLWidget->setLogarithmic(logarithmic == 1);
+	}
+	openGLWidget->setMinimumValue(minimumValue);
+	openGLWidget->setMaximumValue(maximumValue);
+
+	// setSimulation resets the camera
+	openGLWidget->setSimulation(simulation);
+
+	if (hasCameraPosition) {
+		openGLWidget->setCameraPosition(Vector<GLdouble, 3>(3, cameraPosition[0], cameraPosition[1], cameraPosition[2]));
+	}
+	if (hasCameraLookAt) {
+		openGLWidget->setCameraLookAt(Vector<GLdouble, 3>(3, cameraLookAt[0], cameraLookAt[1], cameraLookAt[2]));
+	}
+	if (hasCameraUp) {
+		openGLWidget->setCameraUp(Vector<GLdouble, 3>(3, cameraUp[0], cameraUp[1], cameraUp[2]));
+	}
+}
+
+/**
+	sets the limits not given on the command line to the range of the current frame
+*/
+void BatchRenderer::autoscaleFrame(OpenGLWidget* openGLWidget, Simulation* simulation)
+{
+	const FieldStatistics* statistics = simulation->getStatistics();
+
+	if (statistics == NULL) {
+		return;
+	}
+
+	if (openGLWidget->getLogarithmic()) {
+		if (statistics->positiveCount == 0) {
+			return;
+		}
+		if (!hasMinimum) {
+			openGLWidget->setMinimumValue(statistics->positiveMinimum);
+		}
+		if (!hasMaximum) {
+			openGLWidget->setMaximumValue(statistics->positiveMaximum);
+		}
+	} else {
+		if (!hasMinimum) {
+			openGLWidget->setMinimumValue(statistics->minimum);
+		}
+		if (!hasMaximum) {
+			openGLWidget->setMaximumValue(statistics->maximum);
+		}
+	}
+}
+
+/**
+	renders the frames of this process (all if there is only one job)
+*/
+int BatchRenderer::renderFrames()
+{
+	QByteArray filename = simulationFilename.toLocal8Bit();
+	char *full_filename = realpath(filename.constData(), NULL);
+
+	if (full_filename == NULL) {
+		fprintf(stderr, "Could not find '%s'.\n", filename.constData());
+		return -1;
+	}
+
+	Simulation* simulation;
+	if (Pack::isPack(full_filename)) {
+		simulation = new PackedFARGO;
+	} else {
+		simulation = new FARGO;
+	}
+
+	if (simulation->loadFromFile(full_filename) != 0) {
+		fprintf(stderr, "Failed to open '%s'.\n", full_filename);
+		free(full_filename);
+		delete simulation;
+		return -1;
+	}
+	free(full_filename);
+
+	if (!expression.isEmpty()) {
+		Expression* parsed = new Expression;
+		if (parsed->parse(expression.toAscii().constData()) < 0) {
+			fprintf(stderr, "Invalid expression: %s\n", parsed->getError());
+			delete parsed;
+			delete simulation;
+			return -1;
+		}
+		simulation->setExpression(ExpressionPointer(parsed));
+	} else if (quantityType == Simulation::EXPRESSION) {
+		fprintf(stderr, "Please provide the expression to render.\n");
+		delete simulation;
+		return -1;
+	}
+
+	simulation->setQuantityType(quantityType);
+
+	OpenGLWidget* openGLWidget = new OpenGLWidget(0);
+	QObject::connect(simulation, SIGNAL(dataUpdated()), openGLWidget, SLOT(updateFromData()));
+	applySettings(openGLWidget, simulation);
+
+	VideoWriter* video = NULL;
+	if (!videoOutput.isEmpty()) {
+		video = new VideoWriter;
+		if (video->open(videoOutput, fps) != 0) {
+			delete video;
+			delete openGLWidget;
+			delete simulation;
+			return -1;
+		}
+	}
+
+	unsigned int last = (lastTimestep < 0) ? simulation->getLastTimeStep() : (unsigned int)lastTimestep;
+	unsigned int frame = 0;
+	unsigned int rendered = 0;
+	int ret = 0;
+
+	for (unsigned int timestep = firstTimestep; timestep <= last; timestep += step) {
+		// frames are numbered consecutively, missing timesteps are skipped by all workers alike
+		if (!simulation->hasTimestep(timestep)) {
+			continue;
+		}
+
+		if ((worker >= 0) && (frame % jobs != (unsigned int)worker)) {
+			++frame;
+			continue;
+		}
+
+		if (simulation->loadTimestep(timestep) != 0) {
+			fprintf(stderr, "Could not load timestep %u.\n", timestep);
+			ret = -1;
+			break;
+		}
+
+		if (autoscale) {
+			autoscaleFrame(openGLWidget, simulation);
+		}
+
+		QImage image = openGLWidget->renderImage(width, height);
+		if (image.isNull()) {
+			ret = -1;
+			break;
+		}
+
+		if (video != NULL) {
+			video->write(image);
+		} else {
+			QString path = QDir(outputDirectory).filePath(QString("frame_%1.png").arg(frame, 6, 10, QChar('0')));
+			if (!image.save(path, "PNG")) {
+				fprintf(stderr, "Could not write '%s'.\n", path.toAscii().constData());
+				ret = -1;
+				break;
+			}
+		}
+
+		++frame;
+		++rendered;
+	}
+
+	if ((video != NULL) && (video->close() != 0)) {
+		ret = -1;
+	}
+	delete video;
+
+	if (worker < 0) {
+		printf("Rendered %u frames to '%s'.\n", rendered, (video != NULL ? videoOutput : outputDirectory).toAscii().constData());
+	}
+
+	delete openGLWidget;
+	delete simulation;
+
+	return ret;
+}
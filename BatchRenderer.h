@@ -0,0 +1,80 @@
+#ifndef _BATCHRENDERER_H_
+#define _BATCHRENDERER_H_
+
+#include <QStringList>
+#include <QColor>
+#include <QList>
+#include <QPair>
+#include "Simulation.h"
+
+class OpenGLWidget;
+
+/**
+	renders a range of timesteps to images without user interaction
+
+	usage: FARGO-Viewer --render <simulation> <output directory> [options]
+	       FARGO-Viewer --render <simulation> --video <output> [options]
+
+	Frames are written as frame_000000.png, ... in the order of the
+	timesteps, or streamed into a video by VideoWriter. With --jobs N the
+	frames (of images only) are distributed round robin over N worker
+	processes, each with its own OpenGL context.
+*/
+class BatchRenderer
+{
+	public:
+		BatchRenderer();
+		~BatchRenderer();
+
+		int parseArguments(const QStringList& arguments);
+		int run();
+
+		static void printUsage(const char* program);
+
+	private:
+		QStringList arguments;
+		QString simulationFilename;
+		QString outputDirectory;
+		QString videoOutput;
+		unsigned int fps;
+
+		int firstTimestep;
+		int lastTimestep;
+		unsigned int step;
+		unsigned int width;
+		unsigned int height;
+
+		Simulation::QuantityType quantityType;
+		QString expression;
+		bool hasMinimum;
+		bool hasMaximum;
+		double minimumValue;
+		double maximumValue;
+		int logarithmic;
+		bool autoscale;
+		QList<QPair<unsigned int, QColor> > palette;
+
+		bool hasCameraPosition;
+		bool hasCameraLookAt;
+		bool hasCameraUp;
+		double cameraPosition[3];
+		double cameraLookAt[3];
+		double cameraUp[3];
+
+		// elements which are shown, by name
+		QStringList shown;
+
+		unsigned int jobs;
+		// index of this worker process, -1 in the parent
+		int worker;
+
+		int runWorkers();
+		int renderFrames();
+		void applySettings(OpenGLWidget* openGLWidget, Simulation* simulation);
+		void autoscaleFrame(OpenGLWidget* openGLWidget, Simulation* simulation);
+
+		static int parseVector(const QString& text, double* vector);
+		static bool isElement(const QString& name);
+};
+
+#endif
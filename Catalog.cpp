@@ -0,0 +1,519 @@
+#include "Catalog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+static const unsigned int catalogVersion = 1;
+
+// file name prefixes of the timestep files of each kind
+static const char* kindPrefixes[Catalog::N_KINDS] = {
+	"gasdens",
+	"gasTemperature",
+	"gasvrad",
+	"gasvtheta",
+	"particles"
+};
+
+Catalog::Catalog()
+{
+	outputDirectory = NULL;
+
+	NRadial = 0;
+	NAzimuthal = 0;
+	totalTimestep = 0;
+	NPlanets = 0;
+}
+
+Catalog::~Catalog()
+{
+	free(outputDirectory);
+
+	for (unsigned int i = 0; i < dependencies.size(); ++i) {
+		free(dependencies[i].filename);
+	}
+}
+
+void Catalog::setOutputDirectory(const char* directory)
+{
+	free(outputDirectory);
+	outputDirectory = strdup(directory);
+}
+
+/**
+	adds a file (or directory) whose size and modification time are checked when loading the catalog
+
+	\param identifiesRun the file is not changed while the simulation runs, but by a new run, see getStamp
+*/
+void Catalog::addDependency(const char* filename, bool identifiesRun)
+{
+	Dependency dependency;
+
+	dependency.filename = strdup(filename);
+	dependency.identifiesRun = identifiesRun;
+	if (stat(filename, &dependency.mtime, &dependency.size) < 0) {
+		dependency.mtime = -1;
+		dependency.size = -2;
+	}
+
+	dependencies.push_back(dependency);
+}
+
+/**
+	returns a hash of the names, sizes and modification times of the dependencies which identify the run
+
+	Data derived from the output of a run (like the statistics index) is
+	outdated if the stamp changed.
+*/
+unsigned long long Catalog::getStamp() const
+{
+	// FNV-1a
+	unsigned long long hash = 14695981039346656037ULL;
+
+	for (unsigned int i = 0; i < dependencies.size(); ++i) {
+		if (!dependencies[i].identifiesRun)
+			continue;
+
+		for (const char* c = dependencies[i].filename; *c != 0; ++c) {
+			hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+		}
+
+		long long stamps[2] = { dependencies[i].mtime, dependencies[i].size };
+		const unsigned char* bytes = (const unsigned char*)stamps;
+		for (unsigned int j = 0; j < sizeof(stamps); ++j) {
+			hash = (hash ^ bytes[j]) * 1099511628211ULL;
+		}
+	}
+
+	return hash;
+}
+
+/**
+	gets modification time (in ns) and size of a file, size is -1 for directories
+*/
+int Catalog::stat(const char* filename, long long* mtime, long long* size)
+{
+	struct stat filestatus;
+
+	if (::stat(filename, &filestatus) < 0) {
+		return -1;
+	}
+
+#ifdef __APPLE__
+	*mtime = (long long)filestatus.st_mtimespec.tv_sec*1000000000LL + filestatus.st_mtimespec.tv_nsec;
+#else
+	*mtime = (long long)filestatus.st_mtim.tv_sec*1000000000LL + filestatus.st_mtim.tv_nsec;
+#endif
+	*size = S_ISDIR(filestatus.st_mode) ? -1 : filestatus.st_size;
+
+	return 0;
+}
+
+/**
+	returns the name of the sidecar file in the output directory or in the user cache directory
+*/
+char* Catalog::getFilename(bool cacheDirectory) const
+{
+	return getSidecarFilename(outputDirectory, "catalog", cacheDirectory);
+}
+
+/**
+	returns the name of a sidecar file of the viewer
+
+	\param path output directory (or file in the user cache directory) the sidecar belongs to
+	\param name one of the sidecar names, e.g. "catalog"
+	\returns path/.fargo-viewer-<name> or <cache directory>/FARGO-Viewer/<name>-<hash of path>, NULL if there is no cache directory
+*/
+char* Catalog::getSidecarFilename(const char* path, const char* name, bool cacheDirectory)
+{
+	char* filename;
+	int ret;
+
+	if (!cacheDirectory) {
+		ret = asprintf(&filename, "%s/.fargo-viewer-%s", path, name);
+	} else {
+		// FNV-1a hash of the path as name
+		unsigned long long hash = 14695981039346656037ULL;
+		for (const char* c = path; *c != 0; ++c) {
+			hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+		}
+
+		if (getenv("XDG_CACHE_HOME") != NULL) {
+			ret = asprintf(&filename, "%s/FARGO-Viewer/%s-%016llx", getenv("XDG_CACHE_HOME"), name, hash);
+		} else if (getenv("HOME") != NULL) {
+			ret = asprintf(&filename, "%s/.cache/FARGO-Viewer/%s-%016llx", getenv("HOME"), name, hash);
+		} else {
+			return NULL;
+		}
+	}
+
+	if (ret < 0) {
+		fprintf(stderr, "Not enough memory.");
+		exit(-1);
+	}
+
+	return filename;
+}
+
+/**
+	opens a temporary file next to a sidecar file, so readers never see a partial sidecar
+
+	Missing directories (of the user cache directory) are created.
+
+	\param temp set to the name of the temporary file, to be passed to commitSidecar
+	\returns NULL if the file could not be created
+*/
+FILE* Catalog::createSidecar(const char* filename, char** temp)
+{
+	char* directory = strdup(filename);
+	for (char* c = directory+1; *c != 0; ++c) {
+		if (*c == '/') {
+			*c = 0;
+			mkdir(directory, 0755);
+			*c = '/';
+		}
+	}
+	free(directory);
+
+	if (asprintf(temp, "%s.%d", filename, (int)getpid()) < 0) {
+		fprintf(stderr, "Not enough memory.");
+		exit(-1);
+	}
+
+	FILE* fd = fopen(*temp, "w");
+	if (fd == NULL) {
+		free(*temp);
+		*temp = NULL;
+	}
+
+	return fd;
+}
+
+/**
+	closes the temporary file of a sidecar and renames it to the sidecar
+
+	\param ok false if writing failed, the temporary file is removed then
+	\returns 0 on success, -1 otherwise
+*/
+int Catalog::commitSidecar(FILE* fd, char* temp, const char* filename, bool ok)
+{
+	ok = (ferror(fd) == 0) && ok;
+	ok = (fclose(fd) == 0) && ok;
+
+	if (!ok || (rename(temp, filename) != 0)) {
+		unlink(temp);
+		free(temp);
+		return -1;
+	}
+
+	free(temp);
+
+	return 0;
+}
+
+/**
+	loads the catalog from its sidecar file
+
+	\returns 0 if a valid catalog was found, -1 otherwise
+*/
+int Catalog::load()
+{
+	for (unsigned int i = 0; i < 2; ++i) {
+		char* filename = getFilename(i == 1);
+
+		if (filename == NULL)
+			continue;
+
+		int ret = loadFrom(filename);
+		free(filename);
+
+		if (ret == 0)
+			return 0;
+	}
+
+	return -1;
+}
+
+int Catalog::loadFrom(const char* filename)
+{
+	FILE* fd = fopen(filename, "r");
+	if (fd == NULL) {
+		return -1;
+	}
+
+	char key[64];
+	unsigned int version;
+	int ret = 0;
+
+	if ((fscanf(fd, "%63s %u", key, &version) != 2) || (strcmp(key, "FARGO-Viewer-catalog") != 0) || (version != catalogVersion)) {
+		fclose(fd);
+		return -1;
+	}
+
+	unsigned int checkedDependencies = 0;
+	bool listDirectory = false;
+
+	for (unsigned int kind = 0; kind < N_KINDS; ++kind) {
+		timesteps[kind].clear();
+	}
+
+	while ((ret == 0) && (fscanf(fd, "%63s", key) == 1)) {
+		if (strcmp(key, "dependency") == 0) {
+			char path[4096];
+			long long mtime, size, currentMtime, currentSize;
+
+			// a dependency which changed invalidates the whole catalog, the path is the rest of the line
+			if ((fscanf(fd, "%lld %lld %4095[^\n]", &mtime, &size, path) != 3)
+				|| (checkedDependencies >= dependencies.size())
+				|| (strcmp(path, dependencies[checkedDependencies].filename) != 0)
+				|| (stat(path, &currentMtime, &currentSize) < 0)
+				|| (currentSize != size)) {
+				ret = -1;
+			} else if (currentMtime != mtime) {
+				// writing sidecars into the output directory changes it as well,
+				// so it is only outdated if other timestep files exist now
+				if ((size == -1) && (strcmp(path, outputDirectory) == 0)) {
+					listDirectory = true;
+				} else {
+					ret = -1;
+				}
+			}
+			checkedDependencies++;
+		} else if (strcmp(key, "NRadial") == 0) {
+			ret = fscanf(fd, "%u", &NRadial) == 1 ? 0 : -1;
+		} else if (strcmp(key, "NAzimuthal") == 0) {
+			ret = fscanf(fd, "%u", &NAzimuthal) == 1 ? 0 : -1;
+		} else if (strcmp(key, "totalTimestep") == 0) {
+			ret = fscanf(fd, "%u", &totalTimestep) == 1 ? 0 : -1;
+		} else if (strcmp(key, "radii") == 0) {
+			unsigned int count;
+			ret = fscanf(fd, "%u", &count) == 1 ? 0 : -1;
+			radii.resize(count);
+			for (unsigned int i = 0; (i < count) && (ret == 0); ++i) {
+				ret = fscanf(fd, "%lf", &radii[i]) == 1 ? 0 : -1;
+			}
+		} else if (strcmp(key, "planets") == 0) {
+			ret = fscanf(fd, "%u", &NPlanets) == 1 ? 0 : -1;
+			planetMasses.resize(NPlanets);
+			planetRadii.resize(NPlanets);
+			planetPositions.resize(3*NPlanets);
+			planetVelocities.resize(3*NPlanets);
+			for (unsigned int i = 0; (i < NPlanets) && (ret == 0); ++i) {
+				ret = fscanf(fd, "%lf %lf %lf %lf %lf %lf %lf %lf", &planetMasses[i], &planetRadii[i],
+					&planetPositions[3*i+0], &planetPositions[3*i+1], &planetPositions[3*i+2],
+					&planetVelocities[3*i+0], &planetVelocities[3*i+1], &planetVelocities[3*i+2]) == 8 ? 0 : -1;
+			}
+		} else if (strcmp(key, "timesteps") == 0) {
+			// list of ranges "first-last", terminated by ";"
+			unsigned int kind, first, last;
+			ret = ((fscanf(fd, "%u", &kind) == 1) && (kind < N_KINDS)) ? 0 : -1;
+			while ((ret == 0) && (fscanf(fd, " %u-%u", &first, &last) == 2)) {
+				for (unsigned int timestep = first; timestep <= last; ++timestep) {
+					addTimestep(kind, timestep);
+				}
+			}
+			if ((ret == 0) && (fscanf(fd, " %63[;]", key) != 1)) {
+				ret = -1;
+			}
+		} else {
+			ret = -1;
+		}
+	}
+
+	fclose(fd);
+
+	if (checkedDependencies != dependencies.size()) {
+		ret = -1;
+	}
+
+	if ((ret == 0) && listDirectory) {
+		std::vector<bool> cached[N_KINDS];
+
+		for (unsigned int kind = 0; kind < N_KINDS; ++kind) {
+			cached[kind].swap(timesteps[kind]);
+		}
+
+		scan();
+
+		for (unsigned int kind = 0; kind < N_KINDS; ++kind) {
+			if (timesteps[kind] != cached[kind])
+				ret = -1;
+		}
+	}
+
+	return ret;
+}
+
+/**
+	saves the catalog as sidecar file
+
+	\returns 0 on success, -1 if neither the output directory nor the cache directory are writable
+*/
+int Catalog::save() const
+{
+	for (unsigned int i = 0; i < 2; ++i) {
+		char* filename = getFilename(i == 1);
+		char* temp;
+
+		if (filename == NULL)
+			continue;
+
+		FILE* fd = createSidecar(filename, &temp);
+		if (fd == NULL) {
+			free(filename);
+			continue;
+		}
+
+		fprintf(fd, "FARGO-Viewer-catalog %u\n", catalogVersion);
+
+		for (unsigned int j = 0; j < dependencies.size(); ++j) {
+			fprintf(fd, "dependency %lld %lld %s\n", dependencies[j].mtime, dependencies[j].size, dependencies[j].filename);
+		}
+
+		fprintf(fd, "NRadial %u\n", NRadial);
+		fprintf(fd, "NAzimuthal %u\n", NAzimuthal);
+		fprintf(fd, "totalTimestep %u\n", totalTimestep);
+
+		fprintf(fd, "radii %u\n", (unsigned int)radii.size());
+		for (unsigned int j = 0; j < radii.size(); ++j) {
+			fprintf(fd, "%.17g\n", radii[j]);
+		}
+
+		fprintf(fd, "planets %u\n", NPlanets);
+		for (unsigned int j = 0; j < NPlanets; ++j) {
+			fprintf(fd, "%.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g\n", planetMasses[j], planetRadii[j],
+				planetPositions[3*j+0], planetPositions[3*j+1], planetPositions[3*j+2],
+				planetVelocities[3*j+0], planetVelocities[3*j+1], planetVelocities[3*j+2]);
+		}
+
+		for (unsigned int kind = 0; kind < N_KINDS; ++kind) {
+			fprintf(fd, "timesteps %u", kind);
+
+			unsigned int timestep = 0;
+			while (timestep < timesteps[kind].size()) {
+				if (timesteps[kind][timestep]) {
+					unsigned int first = timestep;
+					while ((timestep+1 < timesteps[kind].size()) && timesteps[kind][timestep+1]) {
+						timestep++;
+					}
+					fprintf(fd, " %u-%u", first, timestep);
+				}
+				timestep++;
+			}
+
+			fprintf(fd, " ;\n");
+		}
+
+		int ret = commitSidecar(fd, temp, filename, true);
+		free(filename);
+
+		if (ret == 0)
+			return 0;
+	}
+
+	return -1;
+}
+
+/**
+	finds out kind and timestep of a file in the output directory
+
+	\param name file name without directory
+	\returns 0 if name is exactly <prefix><timestep>.dat, -1 otherwise
+*/
+int Catalog::parseFilename(const char* name, unsigned int* kind, unsigned int* timestep)
+{
+	for (unsigned int i = 0; i < N_KINDS; ++i) {
+		size_t prefixLength = strlen(kindPrefixes[i]);
+
+		if (strncmp(name, kindPrefixes[i], prefixLength) != 0)
+			continue;
+
+		int length = 0;
+
+		if ((sscanf(name+prefixLength, "%u.dat%n", timestep, &length) == 1) && (length > 0) && (name[prefixLength+length] == 0) && (name[prefixLength] >= '0') && (name[prefixLength] <= '9')) {
+			*kind = i;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/**
+	discovers which timesteps exist in the output directory with a single directory scan
+*/
+void Catalog::scan()
+{
+	for (unsigned int kind = 0; kind < N_KINDS; ++kind) {
+		timesteps[kind].clear();
+	}
+
+	DIR* dir = opendir(outputDirectory);
+	if (dir == NULL) {
+		return;
+	}
+
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL) {
+		unsigned int kind, timestep;
+
+		if (parseFilename(entry->d_name, &kind, &timestep) == 0) {
+			addTimestep(kind, timestep);
+		}
+	}
+
+	closedir(dir);
+}
+
+void Catalog::addTimestep(unsigned int kind, unsigned int timestep)
+{
+	if (timestep >= timesteps[kind].size()) {
+		timesteps[kind].resize(timestep+1, false);
+	}
+
+	timesteps[kind][timestep] = true;
+}
+
+/**
+	returns if any timestep of this kind was found
+*/
+bool Catalog::hasTimesteps(unsigned int kind) const
+{
+	return !timesteps[kind].empty();
+}
+
+bool Catalog::hasTimestep(unsigned int kind, unsigned int timestep) const
+{
+	return (timestep < timesteps[kind].size()) && timesteps[kind][timestep];
+}
+
+unsigned int Catalog::getNumberOfTimesteps(unsigned int kind) const
+{
+	unsigned int count = 0;
+
+	for (unsigned int i = 0; i < timesteps[kind].size(); ++i) {
+		if (timesteps[kind][i])
+			count++;
+	}
+
+	return count;
+}
+
+/**
+	returns the number of missing timesteps between the first and the last timestep found
+*/
+unsigned int Catalog::getNumberOfGaps(unsigned int kind) const
+{
+	if (timesteps[kind].empty())
+		return 0;
+
+	unsigned int first = 0;
+	while (!timesteps[kind][first]) {
+		first++;
+	}
+
+	return timesteps[kind].size() - first - getNumberOfTimesteps(kind);
+}
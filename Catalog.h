@@ -0,0 +1,83 @@
+#ifndef _CATALOG_H_
+#define _CATALOG_H_
+
+#include <vector>
+#include <stdio.h>
+#include "Simulation.h"
+
+/**
+	cached description of a FARGO output directory
+
+	The catalog stores everything which is expensive to find out when
+	opening a simulation (radii, planet configuration, last timestep and
+	which timesteps exist for every quantity). It is saved as a sidecar
+	file in the output directory (or in the user cache directory if the
+	output directory is not writable) and is valid as long as none of its
+	dependencies changed size or modification time. If only the output
+	directory changed (e.g. by writing sidecars), it is listed again and the
+	catalog stays valid if the same timestep files exist.
+
+	Only the existence of timestep files is cached, their contents are always
+	read from disk, so files rewritten in place do not make it outdated.
+*/
+class Catalog
+{
+	public:
+		enum Kind {
+			PARTICLES = Simulation::N_GRID_TYPES,
+			N_KINDS
+		};
+
+		Catalog();
+		~Catalog();
+
+		void setOutputDirectory(const char* directory);
+		void addDependency(const char* filename, bool identifiesRun);
+		unsigned long long getStamp() const;
+
+		int load();
+		int save() const;
+		void scan();
+		static int parseFilename(const char* name, unsigned int* kind, unsigned int* timestep);
+
+		// sidecar files of the viewer, written to a temporary file and renamed
+		static char* getSidecarFilename(const char* path, const char* name, bool cacheDirectory);
+		static FILE* createSidecar(const char* filename, char** temp);
+		static int commitSidecar(FILE* fd, char* temp, const char* filename, bool ok);
+
+		bool hasTimesteps(unsigned int kind) const;
+		bool hasTimestep(unsigned int kind, unsigned int timestep) const;
+		unsigned int getNumberOfTimesteps(unsigned int kind) const;
+		unsigned int getNumberOfGaps(unsigned int kind) const;
+		void addTimestep(unsigned int kind, unsigned int timestep);
+
+		// cached data
+		unsigned int NRadial;
+		unsigned int NAzimuthal;
+		unsigned int totalTimestep;
+		std::vector<double> radii;
+
+		unsigned int NPlanets;
+		std::vector<double> planetMasses;
+		std::vector<double> planetRadii;
+		std::vector<double> planetPositions;
+		std::vector<double> planetVelocities;
+
+	private:
+		struct Dependency {
+			char* filename;
+			long long mtime;
+			long long size;
+			bool identifiesRun;
+		};
+
+		char* outputDirectory;
+		std::vector<Dependency> dependencies;
+		std::vector<bool> timesteps[N_KINDS];
+
+		char* getFilename(bool cacheDirectory) const;
+		static int stat(const char* filename, long long* mtime, long long* size);
+		int loadFrom(const char* filename);
+};
+
+#endif
@@ -0,0 +1,199 @@
+#include "Colormap.h"
+#include <math.h>
+#include <string.h>
+#include <float.h>
+#include <stdint.h>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QColor>
+#include "Palette.h"
+#include "SIMD.h"
+
+using namespace simd;
+
+// values mapped per block (normalized values of a block stay in cache)
+static const unsigned int blockSize = 256;
+// fields smaller than this are mapped on the calling thread
+static const size_t minimumParallelSize = 256*1024;
+
+Colormap::Colormap()
+{
+	memset(table, 0, sizeof(table));
+
+	// log2 of the middle of each mantissa interval
+	for (unsigned int i = 0; i < (1u << mantissaBits); ++i) {
+		log2Mantissa[i] = log2(1.0 + (i + 0.5)/(1u << mantissaBits));
+	}
+}
+
+/**
+	bakes the palette into the table, an empty palette gives transparent black
+*/
+void Colormap::setPalette(const Palette& palette)
+{
+	if (palette.getNumberOfColors() == 0) {
+		memset(table, 0, sizeof(table));
+		return;
+	}
+
+	for (unsigned int i = 0; i < tableSize; ++i) {
+		QColor color = palette.getColorNormalized((double)i/(tableSize - 1));
+
+		table[4*i + 0] = color.red();
+		table[4*i + 1] = color.green();
+		table[4*i + 2] = color.blue();
+		table[4*i + 3] = color.alpha();
+	}
+}
+
+double Colormap::fastLog2(double value) const
+{
+	// also catches NaN
+	if (!(value > 0.0)) {
+		return -DBL_MAX;
+	}
+
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	int exponent = (int)((bits >> 52) & 0x7FF) - 1023;
+
+	return exponent + log2Mantissa[(bits >> (52 - mantissaBits)) & ((1u << mantissaBits) - 1)];
+}
+
+/**
+	positions range from 0 (minimum) to tableSize-1 (maximum), values <= 0
+	are taken as DBL_EPSILON for the logarithmic scale
+*/
+void Colormap::getTransform(double minimum, double maximum, bool logarithmic, double* offset, double* scale)
+{
+	if (logarithmic) {
+		if (minimum <= 0.0) {
+			minimum = DBL_EPSILON;
+		}
+		if (maximum <= 0.0) {
+			maximum = DBL_EPSILON;
+		}
+		minimum = log2(minimum);
+		maximum = log2(maximum);
+	}
+
+	*offset = minimum;
+	*scale = (maximum > minimum) ? (tableSize - 1)/(maximum - minimum) : 0.0;
+}
+
+void Colormap::mapRange(const double* values, size_t first, size_t last, unsigned char* colors, double minimum, double maximum, bool logarithmic) const
+{
+	double offset, scale;
+	getTransform(minimum, maximum, logarithmic, &offset, &scale);
+
+	const double top = tableSize - 0.5;
+	double logarithms[blockSize];
+	double positions[blockSize];
+
+#ifdef SIMD_ENABLED
+	const Vector offsetVector = set1(offset);
+	const Vector scaleVector = set1(scale);
+	const Vector halfVector = set1(0.5);
+	const Vector zeroVector = set1(0.0);
+	const Vector topVector = set1(top);
+#endif
+
+	for (size_t start = first; start < last; start += blockSize) {
+		unsigned int count = (last - start < blockSize) ? (unsigned int)(last - start) : blockSize;
+		const double* source = values + start;
+
+		if (logarithmic) {
+			for (unsigned int i = 0; i < count; ++i) {
+				logarithms[i] = fastLog2(source[i]);
+			}
+			source = logarithms;
+		}
+
+		unsigned int i = 0;
+#ifdef SIMD_ENABLED
+		// max returns its second argument for NaN, so NaN goes to 0
+		for (; i + vectorWidth <= count; i += vectorWidth) {
+			Vector position = add(mul(sub(load(source + i), offsetVector), scaleVector), halfVector);
+			store(positions + i, min(max(position, zeroVector), topVector));
+		}
+#endif
+		for (; i < count; ++i) {
+			double position = (source[i] - offset)*scale + 0.5;
+			position = position > 0.0 ? position : 0.0;
+			positions[i] = position < top ? position : top;
+		}
+
+		unsigned char* out = colors + 4*start;
+		for (i = 0; i < count; ++i) {
+			memcpy(out + 4*i, table + 4*(unsigned int)positions[i], 4);
+		}
+	}
+}
+
+/**
+	maps a range of values on a thread of the colormap pool
+*/
+class ColorTask : public QRunnable
+{
+	public:
+		ColorTask(const Colormap* colormap, const double* values, size_t first, size_t last, unsigned char* colors, double minimum, double maximum, bool logarithmic, QSemaphore* done)
+		: colormap(colormap), values(values), first(first), last(last), colors(colors), minimum(minimum), maximum(maximum), logarithmic(logarithmic), done(done)
+		{
+		}
+
+		void run()
+		{
+			colormap->mapRange(values, first, last, colors, minimum, maximum, logarithmic);
+			done->release();
+		}
+
+	private:
+		const Colormap* colormap;
+		const double* values;
+		size_t first;
+		size_t last;
+		unsigned char* colors;
+		double minimum;
+		double maximum;
+		bool logarithmic;
+		QSemaphore* done;
+};
+
+static QThreadPool* getPool()
+{
+	static QThreadPool pool;
+
+	return &pool;
+}
+
+/**
+	maps count values to 4*count bytes of colors, large fields are split over several threads
+*/
+void Colormap::map(const double* values, size_t count, unsigned char* colors, double minimum, double maximum, bool logarithmic) const
+{
+	unsigned int threads = QThread::idealThreadCount() > 1 ? QThread::idealThreadCount() : 1;
+
+	if ((threads == 1) || (count < minimumParallelSize)) {
+		mapRange(values, 0, count, colors, minimum, maximum, logarithmic);
+		return;
+	}
+
+	// whole blocks per task
+	size_t perTask = ((count + threads - 1)/threads + blockSize - 1)/blockSize*blockSize;
+	unsigned int tasks = 0;
+	QSemaphore done;
+
+	for (size_t first = perTask; first < count; first += perTask) {
+		size_t last = first + perTask < count ? first + perTask : count;
+		getPool()->start(new ColorTask(this, values, first, last, colors, minimum, maximum, logarithmic, &done));
+		tasks++;
+	}
+
+	// first range on this thread
+	mapRange(values, 0, perTask < count ? perTask : count, colors, minimum, maximum, logarithmic);
+
+	done.acquire(tasks);
+}
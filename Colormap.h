@@ -0,0 +1,43 @@
+#ifndef _COLORMAP_H_
+#define _COLORMAP_H_
+
+#include <stddef.h>
+
+class Palette;
+
+/**
+	maps fields to RGBA8 colors through a lookup table baked from a palette
+
+	Values are normalized linearly or logarithmically to [0,1] between
+	minimum and maximum (clamped, NaN and for the logarithmic scale values
+	<= 0 give the first color) and rounded to the nearest of tableSize
+	colors. The logarithm is taken from the exponent of the double and a
+	table of the mantissa, so no libm call is needed per value.
+*/
+class Colormap
+{
+	public:
+		static const unsigned int tableSize = 4096;
+		// bits of the mantissa used for the logarithm
+		static const unsigned int mantissaBits = 12;
+
+		Colormap();
+
+		void setPalette(const Palette& palette);
+		// colors as bytes R, G, B, A
+		inline const unsigned char* getTable() const { return table; }
+
+		void map(const double* values, size_t count, unsigned char* colors, double minimum, double maximum, bool logarithmic) const;
+		void mapRange(const double* values, size_t first, size_t last, unsigned char* colors, double minimum, double maximum, bool logarithmic) const;
+		// table position is (value - offset)*scale (value being its log2 for the logarithmic scale)
+		static void getTransform(double minimum, double maximum, bool logarithmic, double* offset, double* scale);
+
+	private:
+		unsigned char table[4*tableSize];
+		/// log2 of the mantissa, indexed by its leading bits
+		double log2Mantissa[1 << mantissaBits];
+
+		inline double fastLog2(double value) const;
+};
+
+#endif
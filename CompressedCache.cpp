@@ -0,0 +1,615 @@
+#include "CompressedCache.h"
+#include "Snapshot.h"
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QRunnable>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// values per block of a quantized field
+static const unsigned int blockSize = 256;
+
+// evicted snapshots waiting for encoding at most, more are dropped
+static const unsigned int maximumQueued = 4;
+
+struct BlockHeader {
+	double offset;
+	double scale;
+	unsigned int bits;
+	unsigned int padding;
+};
+
+CompressedCache::Entry::Entry()
+{
+	timestep = 0;
+	quantityMask = 0;
+	mode = OFF;
+
+	for (unsigned int type = 0; type < Simulation::N_QUANTITY_TYPES; ++type) {
+		fieldSize[type] = 0;
+		fields[type] = NULL;
+		fieldBytes[type] = 0;
+	}
+
+	NPlanets = 0;
+	planets = NULL;
+	NParticles = 0;
+	particles = NULL;
+
+	size = sizeof(Entry);
+	rawSize = 0;
+}
+
+CompressedCache::Entry::~Entry()
+{
+	for (unsigned int type = 0; type < Simulation::N_QUANTITY_TYPES; ++type) {
+		free(fields[type]);
+	}
+
+	free(planets);
+	free(particles);
+}
+
+/**
+	encodes an evicted snapshot on the thread of the cache
+*/
+class CompressTask : public QRunnable
+{
+	public:
+		CompressTask(CompressedCache* cache, const SnapshotPointer& snapshot, unsigned int generation) : cache(cache), snapshot(snapshot), generation(generation)
+		{
+		}
+
+		void run()
+		{
+			cache->encode(snapshot.data(), generation);
+
+			// drop the snapshot before making room for the next one
+			snapshot.clear();
+
+			QMutexLocker locker(&cache->mutex);
+			cache->queued--;
+		}
+
+	private:
+		CompressedCache* cache;
+		SnapshotPointer snapshot;
+		unsigned int generation;
+};
+
+CompressedCache::CompressedCache()
+{
+	mode = OFF;
+	errorBound = 1e-4;
+	budget = 1024*1024*1024;
+	usage = 0;
+	rawSize = 0;
+	queued = 0;
+	generation = 0;
+
+	// a single thread, encoding competes with loading the next snapshots
+	pool.setMaxThreadCount(1);
+
+	resetStatistics();
+}
+
+CompressedCache::~CompressedCache()
+{
+	pool.waitForDone();
+}
+
+/**
+	sets how snapshots are encoded, already stored snapshots are kept
+
+	\param mode encoding (OFF disables and clears the cache)
+	\param errorBound maximum error of QUANTIZED relative to the largest absolute value of a field
+*/
+void CompressedCache::setMode(Mode mode, double errorBound)
+{
+	QMutexLocker locker(&mutex);
+
+	this->mode = mode;
+	this->errorBound = errorBound;
+
+	if (mode == OFF) {
+		entries.clear();
+		index.clear();
+		usage = 0;
+		rawSize = 0;
+	}
+}
+
+/**
+	sets the maximum memory used by all compressed snapshots
+*/
+void CompressedCache::setBudget(size_t bytes)
+{
+	QMutexLocker locker(&mutex);
+
+	budget = bytes;
+	evict();
+}
+
+/**
+	encodes a snapshot and stores it, replacing an older entry of its timestep
+*/
+/**
+	queues a snapshot for encoding, returns at once
+
+	The snapshot is dropped if the cache is off or too many are waiting.
+*/
+void CompressedCache::insert(const SnapshotPointer& snapshot)
+{
+	QMutexLocker locker(&mutex);
+
+	if ((mode == OFF) || (queued >= maximumQueued))
+		return;
+
+	queued++;
+	pool.start(new CompressTask(this, snapshot, generation));
+}
+
+/**
+	encodes a snapshot and stores it unless remove or clear was called since it was queued
+*/
+void CompressedCache::encode(const Snapshot* snapshot, unsigned int queuedGeneration)
+{
+	Mode currentMode;
+	double currentErrorBound;
+
+	mutex.lock();
+	currentMode = mode;
+	currentErrorBound = errorBound;
+
+	// snapshots decoded from here come back when evicted again
+	std::map<unsigned int, List::iterator>::iterator pos = index.find(snapshot->timestep);
+	bool stored = (pos != index.end()) && (((*pos->second)->quantityMask & snapshot->quantityMask) == snapshot->quantityMask) && (*pos->second)->region.covers(snapshot->region);
+	bool stale = generation != queuedGeneration;
+	mutex.unlock();
+
+	if ((currentMode == OFF) || stored || stale)
+		return;
+
+	EntryPointer entry(new Entry);
+	entry->timestep = snapshot->timestep;
+	entry->quantityMask = snapshot->quantityMask;
+	entry->region = snapshot->region;
+	entry->mode = currentMode;
+
+	for (unsigned int type = 0; type < Simulation::N_QUANTITY_TYPES; ++type) {
+		if (!snapshot->hasQuantity((Simulation::QuantityType)type))
+			continue;
+
+		const Snapshot::Field& field = snapshot->fields[type];
+		entry->fieldSize[type] = field.size;
+		entry->statistics[type] = field.statistics;
+
+		if (currentMode == LOSSLESS) {
+			entry->fieldBytes[type] = encodeLossless(field.data, field.size, &entry->fields[type]);
+		} else {
+			entry->fieldBytes[type] = encodeQuantized(field.data, field.size, currentErrorBound, &entry->fields[type]);
+		}
+
+		entry->size += entry->fieldBytes[type];
+		entry->rawSize += field.size*sizeof(double);
+	}
+
+	entry->NPlanets = snapshot->NPlanets;
+	entry->planets = (double*)malloc((6*entry->NPlanets+1)*sizeof(double));
+	memcpy(entry->planets, snapshot->planetPositions, 3*entry->NPlanets*sizeof(double));
+	memcpy(entry->planets + 3*entry->NPlanets, snapshot->planetVelocities, 3*entry->NPlanets*sizeof(double));
+
+	entry->NParticles = snapshot->NParticles;
+	entry->particles = (double*)malloc((5*entry->NParticles+1)*sizeof(double));
+	memcpy(entry->particles, snapshot->particlePositions, 2*entry->NParticles*sizeof(double));
+	memcpy(entry->particles + 2*entry->NParticles, snapshot->particleVelocities, 2*entry->NParticles*sizeof(double));
+	memcpy(entry->particles + 4*entry->NParticles, snapshot->particleMasses, entry->NParticles*sizeof(double));
+
+	size_t other = (6*entry->NPlanets + 5*entry->NParticles)*sizeof(double);
+	entry->size += other;
+	entry->rawSize += other;
+
+	QMutexLocker locker(&mutex);
+
+	// mode may have been switched off or the files changed meanwhile
+	if ((mode == OFF) || (generation != queuedGeneration))
+		return;
+
+	pos = index.find(entry->timestep);
+	if (pos != index.end()) {
+		erase(pos->second);
+	}
+
+	entries.push_front(entry);
+	index[entry->timestep] = entries.begin();
+	usage += entry->size;
+	rawSize += entry->rawSize;
+
+	evict();
+}
+
+/**
+	decodes the stored snapshot of timestep if it holds quantity type, otherwise returns a null pointer
+*/
+SnapshotPointer CompressedCache::find(unsigned int timestep, Simulation::QuantityType type)
+{
+	EntryPointer entry;
+
+	mutex.lock();
+	std::map<unsigned int, List::iterator>::iterator pos = index.find(timestep);
+
+	if ((pos == index.end()) || !((*pos->second)->quantityMask & (1u << type))) {
+		misses++;
+		mutex.unlock();
+		return SnapshotPointer();
+	}
+
+	hits++;
+	entries.splice(entries.begin(), entries, pos->second);
+	entry = *pos->second;
+	mutex.unlock();
+
+	QElapsedTimer timer;
+	timer.start();
+
+	SnapshotPointer snapshot = Snapshot::create();
+	snapshot->timestep = entry->timestep;
+
+	for (unsigned int type = 0; type < Simulation::N_QUANTITY_TYPES; ++type) {
+		if (!(entry->quantityMask & (1u << type)))
+			continue;
+
+		Snapshot::Field& field = snapshot->fields[type];
+		snapshot->resizeQuantity((Simulation::QuantityType)type, entry->fieldSize[type]);
+
+		if (entry->mode == LOSSLESS) {
+			decodeLossless(entry->fields[type], entry->fieldBytes[type], entry->fieldSize[type], field.buffer);
+		} else {
+			decodeQuantized(entry->fields[type], entry->fieldSize[type], field.buffer);
+		}
+
+		field.data = field.buffer;
+		field.statistics = entry->statistics[type];
+	}
+	snapshot->quantityMask = entry->quantityMask;
+	snapshot->region = entry->region;
+
+	snapshot->resizePlanets(entry->NPlanets);
+	memcpy(snapshot->planetPositions, entry->planets, 3*entry->NPlanets*sizeof(double));
+	memcpy(snapshot->planetVelocities, entry->planets + 3*entry->NPlanets, 3*entry->NPlanets*sizeof(double));
+
+	snapshot->resizeParticles(entry->NParticles);
+	memcpy(snapshot->particlePositions, entry->particles, 2*entry->NParticles*sizeof(double));
+	memcpy(snapshot->particleVelocities, entry->particles + 2*entry->NParticles, 2*entry->NParticles*sizeof(double));
+	memcpy(snapshot->particleMasses, entry->particles + 4*entry->NParticles, entry->NParticles*sizeof(double));
+
+	unsigned long long elapsed = timer.nsecsElapsed();
+
+	mutex.lock();
+	decodedBytes += entry->rawSize;
+	decodeNanoseconds += elapsed;
+	mutex.unlock();
+
+	return snapshot;
+}
+
+void CompressedCache::remove(unsigned int timestep)
+{
+	QMutexLocker locker(&mutex);
+
+	generation++;
+
+	std::map<unsigned int, List::iterator>::iterator pos = index.find(timestep);
+
+	if (pos != index.end()) {
+		erase(pos->second);
+	}
+}
+
+void CompressedCache::clear()
+{
+	QMutexLocker locker(&mutex);
+
+	generation++;
+
+	entries.clear();
+	index.clear();
+	usage = 0;
+	rawSize = 0;
+}
+
+/**
+	removes an entry (mutex must be locked)
+*/
+void CompressedCache::erase(List::iterator pos)
+{
+	usage -= (*pos)->size;
+	rawSize -= (*pos)->rawSize;
+	index.erase((*pos)->timestep);
+	entries.erase(pos);
+}
+
+/**
+	evicts least recently used entries until the budget is met (mutex must be locked)
+*/
+void CompressedCache::evict()
+{
+	while ((usage > budget) && !entries.empty()) {
+		List::iterator pos = entries.end();
+		erase(--pos);
+	}
+}
+
+unsigned int CompressedCache::getNumberOfEntries()
+{
+	QMutexLocker locker(&mutex);
+
+	return index.size();
+}
+
+/**
+	returns uncompressed size divided by compressed size of all entries
+*/
+double CompressedCache::getCompressionRatio() const
+{
+	return usage > 0 ? (double)rawSize/(double)usage : 0.0;
+}
+
+/**
+	returns the number of decoded bytes per second
+*/
+double CompressedCache::getDecodeThroughput() const
+{
+	return decodeNanoseconds > 0 ? decodedBytes*1e9/decodeNanoseconds : 0.0;
+}
+
+void CompressedCache::resetStatistics()
+{
+	hits = 0;
+	misses = 0;
+	decodedBytes = 0;
+	decodeNanoseconds = 0;
+}
+
+/**
+	splits the doubles into byte planes and compresses them with zlib
+
+	Doubles of a smooth field share sign, exponent and leading mantissa bytes,
+	which become long runs once all first bytes, all second bytes etc. are
+	stored together.
+
+	\returns size of result in bytes
+*/
+size_t CompressedCache::encodeLossless(const double* values, unsigned int count, char** result)
+{
+	const unsigned char* bytes = (const unsigned char*)values;
+	unsigned char* planes = (unsigned char*)malloc(count*sizeof(double) + 1);
+
+	for (unsigned int i = 0; i < count; ++i) {
+		for (unsigned int b = 0; b < sizeof(double); ++b) {
+			planes[b*count + i] = bytes[i*sizeof(double) + b];
+		}
+	}
+
+	QByteArray compressed = qCompress(planes, count*sizeof(double), 1);
+	free(planes);
+
+	*result = (char*)malloc(compressed.size());
+	memcpy(*result, compressed.constData(), compressed.size());
+
+	return compressed.size();
+}
+
+void CompressedCache::decodeLossless(const char* data, size_t size, unsigned int count, double* values)
+{
+	QByteArray planesArray = qUncompress(QByteArray::fromRawData(data, size));
+	const unsigned char* planes = (const unsigned char*)planesArray.constData();
+	unsigned char* bytes = (unsigned char*)values;
+	unsigned int i = 0;
+
+	if ((size_t)planesArray.size() < count*sizeof(double))
+		count = planesArray.size()/sizeof(double);
+
+#ifdef __SSE2__
+	// interleave 16 values at once: bytes, then 16 bit words, then 32 bit words
+	for (; i + 16 <= count; i += 16) {
+		__m128i p0 = _mm_loadu_si128((const __m128i*)&planes[0*count + i]);
+		__m128i p1 = _mm_loadu_si128((const __m128i*)&planes[1*count + i]);
+		__m128i p2 = _mm_loadu_si128((const __m128i*)&planes[2*count + i]);
+		__m128i p3 = _mm_loadu_si128((const __m128i*)&planes[3*count + i]);
+		__m128i p4 = _mm_loadu_si128((const __m128i*)&planes[4*count + i]);
+		__m128i p5 = _mm_loadu_si128((const __m128i*)&planes[5*count + i]);
+		__m128i p6 = _mm_loadu_si128((const __m128i*)&planes[6*count + i]);
+		__m128i p7 = _mm_loadu_si128((const __m128i*)&planes[7*count + i]);
+
+		__m128i a0 = _mm_unpacklo_epi8(p0, p1);
+		__m128i a1 = _mm_unpackhi_epi8(p0, p1);
+		__m128i b0 = _mm_unpacklo_epi8(p2, p3);
+		__m128i b1 = _mm_unpackhi_epi8(p2, p3);
+		__m128i c0 = _mm_unpacklo_epi8(p4, p5);
+		__m128i c1 = _mm_unpackhi_epi8(p4, p5);
+		__m128i d0 = _mm_unpacklo_epi8(p6, p7);
+		__m128i d1 = _mm_unpackhi_epi8(p6, p7);
+
+		__m128i e0 = _mm_unpacklo_epi16(a0, b0);
+		__m128i e1 = _mm_unpackhi_epi16(a0, b0);
+		__m128i e2 = _mm_unpacklo_epi16(a1, b1);
+		__m128i e3 = _mm_unpackhi_epi16(a1, b1);
+		__m128i f0 = _mm_unpacklo_epi16(c0, d0);
+		__m128i f1 = _mm_unpackhi_epi16(c0, d0);
+		__m128i f2 = _mm_unpacklo_epi16(c1, d1);
+		__m128i f3 = _mm_unpackhi_epi16(c1, d1);
+
+		__m128i* out = (__m128i*)&bytes[i*sizeof(double)];
+		_mm_storeu_si128(out + 0, _mm_unpacklo_epi32(e0, f0));
+		_mm_storeu_si128(out + 1, _mm_unpackhi_epi32(e0, f0));
+		_mm_storeu_si128(out + 2, _mm_unpacklo_epi32(e1, f1));
+		_mm_storeu_si128(out + 3, _mm_unpackhi_epi32(e1, f1));
+		_mm_storeu_si128(out + 4, _mm_unpacklo_epi32(e2, f2));
+		_mm_storeu_si128(out + 5, _mm_unpackhi_epi32(e2, f2));
+		_mm_storeu_si128(out + 6, _mm_unpacklo_epi32(e3, f3));
+		_mm_storeu_si128(out + 7, _mm_unpackhi_epi32(e3, f3));
+	}
+#endif
+
+	for (; i < count; ++i) {
+		for (unsigned int b = 0; b < sizeof(double); ++b) {
+			bytes[i*sizeof(double) + b] = planes[b*count + i];
+		}
+	}
+}
+
+/**
+	quantizes blocks of values to 0, 8 or 16 bit codes with an offset and scale per block
+
+	Blocks which cannot meet the error bound with 16 bit (or contain
+	non-finite values) are stored as doubles.
+
+	\returns size of result in bytes
+*/
+size_t CompressedCache::encodeQuantized(const double* values, unsigned int count, double errorBound, char** result)
+{
+	// a single infinity must not make the tolerance infinite
+	double maximumAbsolute = 0.0;
+	for (unsigned int i = 0; i < count; ++i) {
+		if (isfinite(values[i]) && (fabs(values[i]) > maximumAbsolute)) {
+			maximumAbsolute = fabs(values[i]);
+		}
+	}
+
+	double tolerance = errorBound*maximumAbsolute;
+	unsigned int NBlocks = (count + blockSize - 1)/blockSize;
+
+	// worst case is every block stored as doubles
+	char* data = (char*)malloc(NBlocks*sizeof(BlockHeader) + count*sizeof(double) + 1);
+	size_t size = 0;
+
+	for (unsigned int first = 0; first < count; first += blockSize) {
+		unsigned int n = count - first < blockSize ? count - first : blockSize;
+		const double* block = &values[first];
+
+		// comparisons never see a NaN, so every value is checked
+		bool finite = true;
+		double minimum = DBL_MAX, maximum = -DBL_MAX;
+		for (unsigned int i = 0; i < n; ++i) {
+			if (!isfinite(block[i])) {
+				finite = false;
+				break;
+			}
+			if (block[i] < minimum) minimum = block[i];
+			if (block[i] > maximum) maximum = block[i];
+		}
+
+		double range = maximum - minimum;
+
+		BlockHeader header;
+		header.offset = minimum;
+		header.scale = 0.0;
+		header.padding = 0;
+
+		if (!finite || !(range <= DBL_MAX)) {
+			header.bits = 64;
+		} else if (range <= 2.0*tolerance) {
+			header.bits = 0;
+			header.offset = minimum + 0.5*range;
+		} else if (range <= 2.0*255.0*tolerance) {
+			header.bits = 8;
+			header.scale = range/255.0;
+		} else if (range <= 2.0*65535.0*tolerance) {
+			header.bits = 16;
+			header.scale = range/65535.0;
+		} else {
+			header.bits = 64;
+		}
+
+		memcpy(&data[size], &header, sizeof(header));
+		size += sizeof(header);
+
+		if (header.bits == 8) {
+			unsigned char* codes = (unsigned char*)&data[size];
+			for (unsigned int i = 0; i < n; ++i) {
+				codes[i] = (unsigned char)((block[i] - minimum)/header.scale + 0.5);
+			}
+			size += n;
+		} else if (header.bits == 16) {
+			unsigned short code;
+			for (unsigned int i = 0; i < n; ++i) {
+				code = (unsigned short)((block[i] - minimum)/header.scale + 0.5);
+				memcpy(&data[size + i*sizeof(code)], &code, sizeof(code));
+			}
+			size += n*sizeof(code);
+		} else if (header.bits == 64) {
+			memcpy(&data[size], block, n*sizeof(double));
+			size += n*sizeof(double);
+		}
+	}
+
+	*result = (char*)realloc(data, size);
+
+	return size;
+}
+
+void CompressedCache::decodeQuantized(const char* data, unsigned int count, double* values)
+{
+	for (unsigned int first = 0; first < count; first += blockSize) {
+		unsigned int n = count - first < blockSize ? count - first : blockSize;
+		double* block = &values[first];
+
+		BlockHeader header;
+		memcpy(&header, data, sizeof(header));
+		data += sizeof(header);
+
+		unsigned int i = 0;
+
+		if (header.bits == 0) {
+			for (; i < n; ++i) {
+				block[i] = header.offset;
+			}
+		} else if (header.bits == 8) {
+			const unsigned char* codes = (const unsigned char*)data;
+#ifdef __SSE2__
+			__m128d offset = _mm_set1_pd(header.offset);
+			__m128d scale = _mm_set1_pd(header.scale);
+			__m128i zero = _mm_setzero_si128();
+
+			for (; i + 4 <= n; i += 4) {
+				int packed;
+				memcpy(&packed, &codes[i], sizeof(packed));
+				__m128i words = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+				_mm_storeu_pd(&block[i], _mm_add_pd(offset, _mm_mul_pd(scale, _mm_cvtepi32_pd(words))));
+				_mm_storeu_pd(&block[i+2], _mm_add_pd(offset, _mm_mul_pd(scale, _mm_cvtepi32_pd(_mm_shuffle_epi32(words, _MM_SHUFFLE(1, 0, 3, 2))))));
+			}
+#endif
+			for (; i < n; ++i) {
+				block[i] = header.offset + header.scale*codes[i];
+			}
+			data += n;
+		} else if (header.bits == 16) {
+			unsigned short code;
+#ifdef __SSE2__
+			__m128d offset = _mm_set1_pd(header.offset);
+			__m128d scale = _mm_set1_pd(header.scale);
+			__m128i zero = _mm_setzero_si128();
+
+			for (; i + 4 <= n; i += 4) {
+				__m128i words = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)&data[i*sizeof(code)]), zero);
+				_mm_storeu_pd(&block[i], _mm_add_pd(offset, _mm_mul_pd(scale, _mm_cvtepi32_pd(words))));
+				_mm_storeu_pd(&block[i+2], _mm_add_pd(offset, _mm_mul_pd(scale, _mm_cvtepi32_pd(_mm_shuffle_epi32(words, _MM_SHUFFLE(1, 0, 3, 2))))));
+			}
+#endif
+			for (; i < n; ++i) {
+				memcpy(&code, &data[i*sizeof(code)], sizeof(code));
+				block[i] = header.offset + header.scale*code;
+			}
+			data += n*sizeof(code);
+		} else {
+			memcpy(block, data, n*sizeof(double));
+			data += n*sizeof(double);
+		}
+	}
+}
@@ -0,0 +1,124 @@
+#ifndef _COMPRESSEDCACHE_H_
+#define _COMPRESSEDCACHE_H_
+
+#include <QMutex>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <list>
+#include <map>
+#include <stddef.h>
+#include "Simulation.h"
+#include "FieldStatistics.h"
+
+/**
+	second cache tier holding compressed copies of snapshots
+
+	Snapshots evicted from the SnapshotCache are encoded either losslessly
+	(byte planes of the doubles compressed with zlib) or quantized with a
+	per-block offset and scale and a maximum error relative to the largest
+	absolute value of the field. Encoding happens on a thread of the cache, so
+	evicting never waits for it; snapshots are dropped if too many are
+	waiting. Decoding happens in find, i.e. on the thread asking for the
+	snapshot (usually the prefetcher).
+*/
+class CompressedCache
+{
+	public:
+		enum Mode {
+			OFF,
+			LOSSLESS,
+			QUANTIZED,
+			N_MODES
+		};
+
+		CompressedCache();
+		~CompressedCache();
+
+		void setMode(Mode mode, double errorBound);
+		inline Mode getMode() const { return mode; }
+		inline double getErrorBound() const { return errorBound; }
+		void setBudget(size_t bytes);
+		inline size_t getBudget() const { return budget; }
+
+		void insert(const SnapshotPointer& snapshot);
+		SnapshotPointer find(unsigned int timestep, Simulation::QuantityType type);
+		void remove(unsigned int timestep);
+		void clear();
+
+		// statistics
+		inline unsigned int getHits() const { return hits; }
+		inline unsigned int getMisses() const { return misses; }
+		inline size_t getUsage() const { return usage; }
+		inline size_t getRawSize() const { return rawSize; }
+		unsigned int getNumberOfEntries();
+		double getCompressionRatio() const;
+		double getDecodeThroughput() const;
+		void resetStatistics();
+
+		// encodings of a grid, result is allocated with malloc
+		static size_t encodeLossless(const double* values, unsigned int count, char** result);
+		static void decodeLossless(const char* data, size_t size, unsigned int count, double* values);
+		static size_t encodeQuantized(const double* values, unsigned int count, double errorBound, char** result);
+		static void decodeQuantized(const char* data, unsigned int count, double* values);
+
+	private:
+		struct Entry {
+			Entry();
+			~Entry();
+
+			unsigned int timestep;
+			unsigned int quantityMask;
+			Simulation::Region region;
+			Mode mode;
+
+			// encoded grids and their number of values
+			unsigned int fieldSize[Simulation::N_QUANTITY_TYPES];
+			char* fields[Simulation::N_QUANTITY_TYPES];
+			size_t fieldBytes[Simulation::N_QUANTITY_TYPES];
+			// statistics of the original values, kept so decoding does not need another pass
+			FieldStatistics statistics[Simulation::N_QUANTITY_TYPES];
+
+			// planets and particles are stored as they are
+			unsigned int NPlanets;
+			double* planets;
+			unsigned int NParticles;
+			double* particles;
+
+			size_t size;
+			size_t rawSize;
+		};
+
+		typedef QSharedPointer<Entry> EntryPointer;
+		typedef std::list<EntryPointer> List;
+
+		/// entries, most recently used first
+		List entries;
+		std::map<unsigned int, List::iterator> index;
+
+		QMutex mutex;
+
+		Mode mode;
+		double errorBound;
+		size_t budget;
+		size_t usage;
+		size_t rawSize;
+
+		unsigned int hits;
+		unsigned int misses;
+		unsigned long long decodedBytes;
+		unsigned long long decodeNanoseconds;
+
+		QThreadPool pool;
+		/// snapshots waiting for or being encoded
+		unsigned int queued;
+		/// changed by remove and clear, encodings queued before are dropped
+		unsigned int generation;
+
+		void encode(const Snapshot* snapshot, unsigned int queuedGeneration);
+		void erase(List::iterator pos);
+		void evict();
+
+		friend class CompressTask;
+};
+
+#endif
@@ -0,0 +1,359 @@
+#include "DerivedQuantities.h"
+#include "FieldStatistics.h"
+#include "Expression.h"
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "SIMD.h"
+
+namespace derived {
+
+using namespace simd;
+
+// grids with fewer vertices are not split across threads
+static const unsigned int minimumParallelSize = 256*1024;
+
+bool isDerived(Simulation::QuantityType type)
+{
+	return (type >= Simulation::N_GRID_TYPES) && (type < Simulation::N_QUANTITY_TYPES);
+}
+
+/**
+	returns the grids (bit 1 << type) a quantity is computed from, a grid depends on itself
+*/
+unsigned int getDependencies(Simulation::QuantityType type)
+{
+	switch (type) {
+		case Simulation::VORTICITY:
+			return (1u << Simulation::V_RADIAL) | (1u << Simulation::V_AZIMUTHAL);
+
+		case Simulation::VORTENSITY:
+			return (1u << Simulation::V_RADIAL) | (1u << Simulation::V_AZIMUTHAL) | (1u << Simulation::DENSITY);
+
+		case Simulation::TOOMRE_Q:
+			return (1u << Simulation::V_AZIMUTHAL) | (1u << Simulation::DENSITY) | (1u << Simulation::TEMPERATURE);
+
+		case Simulation::MASS_FLUX:
+			return (1u << Simulation::V_RADIAL) | (1u << Simulation::DENSITY);
+
+		// depends on the expression
+		case Simulation::EXPRESSION:
+			return 0;
+
+		default:
+			return 1u << type;
+	}
+}
+
+/**
+	returns the grids a quantity is computed from, including those of an expression (may be NULL)
+*/
+unsigned int getDependencies(Simulation::QuantityType type, const Expression* expression)
+{
+	if ((type == Simulation::EXPRESSION) && (expression != NULL))
+		return expression->getDependencies();
+
+	return getDependencies(type);
+}
+
+/**
+	weights of the rows around a vertex row for d(r f)/dr
+
+	Second order central difference on the non-uniform radii, first order
+	one sided difference in the innermost and outermost row.
+*/
+static void getRadialWeights(const double* radii, unsigned int NRadial, unsigned int row, double* below, double* center, double* above)
+{
+	if (row == 0) {
+		double h = radii[1] - radii[0];
+		*below = 0.0;
+		*center = -radii[0]/h;
+		*above = radii[1]/h;
+	} else if (row == NRadial) {
+		double h = radii[NRadial] - radii[NRadial-1];
+		*below = -radii[NRadial-1]/h;
+		*center = radii[NRadial]/h;
+		*above = 0.0;
+	} else {
+		double hBelow = radii[row] - radii[row-1];
+		double hAbove = radii[row+1] - radii[row];
+		*below = -hAbove/(hBelow*(hBelow+hAbove))*radii[row-1];
+		*center = (hAbove-hBelow)/(hBelow*hAbove)*radii[row];
+		*above = hBelow/(hAbove*(hBelow+hAbove))*radii[row+1];
+	}
+}
+
+/**
+	d(r v_phi)/dr of a row from the rows below and above
+
+	offset is added to every vertex, 2 OmegaFrame r turns the derivative of
+	the rotating frame into the inertial one.
+*/
+static inline void circulationRow(const double* below, const double* center, const double* above, double wBelow, double wCenter, double wAbove, double offset, double* out, unsigned int NAzimuthal)
+{
+	unsigned int j = 0;
+
+#ifdef SIMD_ENABLED
+	const Vector vBelow = set1(wBelow);
+	const Vector vCenter = set1(wCenter);
+	const Vector vAbove = set1(wAbove);
+	const Vector vOffset = set1(offset);
+
+	for (; j + vectorWidth <= NAzimuthal; j += vectorWidth) {
+		store(&out[j], add(add(add(mul(vBelow, load(&below[j])), mul(vCenter, load(&center[j]))), mul(vAbove, load(&above[j]))), vOffset));
+	}
+#endif
+
+	for (; j < NAzimuthal; ++j) {
+		out[j] = wBelow*below[j] + wCenter*center[j] + wAbove*above[j] + offset;
+	}
+}
+
+/**
+	turns d(r v_phi)/dr in out into the vorticity, dv_r/dphi is periodic
+*/
+static inline void vorticityRow(const double* vRadial, double inverseRadius, double inverseTwoDphi, double* out, unsigned int NAzimuthal)
+{
+	// a single column has no azimuthal derivative
+	if (NAzimuthal < 2) {
+		for (unsigned int j = 0; j < NAzimuthal; ++j) {
+			out[j] = inverseRadius*out[j];
+		}
+		return;
+	}
+
+	// wrap columns
+	out[0] = inverseRadius*(out[0] - inverseTwoDphi*(vRadial[1] - vRadial[NAzimuthal-1]));
+	out[NAzimuthal-1] = inverseRadius*(out[NAzimuthal-1] - inverseTwoDphi*(vRadial[0] - vRadial[NAzimuthal-2]));
+
+	unsigned int j = 1;
+
+#ifdef SIMD_ENABLED
+	const Vector vInverseRadius = set1(inverseRadius);
+	const Vector vInverseTwoDphi = set1(inverseTwoDphi);
+
+	for (; j + vectorWidth < NAzimuthal; j += vectorWidth) {
+		Vector dphi = mul(vInverseTwoDphi, sub(load(&vRadial[j+1]), load(&vRadial[j-1])));
+		store(&out[j], mul(vInverseRadius, sub(load(&out[j]), dphi)));
+	}
+#endif
+
+	for (; j + 1 < NAzimuthal; ++j) {
+		out[j] = inverseRadius*(out[j] - inverseTwoDphi*(vRadial[j+1] - vRadial[j-1]));
+	}
+}
+
+static inline void divideRow(const double* divisor, double* out, unsigned int NAzimuthal)
+{
+	unsigned int j = 0;
+
+#ifdef SIMD_ENABLED
+	for (; j + vectorWidth <= NAzimuthal; j += vectorWidth) {
+		store(&out[j], div(load(&out[j]), load(&divisor[j])));
+	}
+#endif
+
+	for (; j < NAzimuthal; ++j) {
+		out[j] = out[j]/divisor[j];
+	}
+}
+
+/**
+	turns d(r v_phi)/dr in out into Toomre Q = sqrt(2 T v_phi d(r v_phi)/dr)/(pi r Sigma)
+
+	omegaRadius (OmegaFrame r) is added to v_phi of the rotating frame, out
+	must already be inertial.
+*/
+static inline void toomreRow(const double* vAzimuthal, const double* temperature, const double* density, double inversePiRadius, double omegaRadius, double* out, unsigned int NAzimuthal)
+{
+	unsigned int j = 0;
+
+#ifdef SIMD_ENABLED
+	const Vector two = set1(2.0);
+	const Vector zero = set1(0.0);
+	const Vector vInversePiRadius = set1(inversePiRadius);
+	const Vector vOmegaRadius = set1(omegaRadius);
+
+	for (; j + vectorWidth <= NAzimuthal; j += vectorWidth) {
+		Vector square = max(mul(mul(two, load(&temperature[j])), mul(add(load(&vAzimuthal[j]), vOmegaRadius), load(&out[j]))), zero);
+		store(&out[j], div(mul(vInversePiRadius, sqrt(square)), load(&density[j])));
+	}
+#endif
+
+	for (; j < NAzimuthal; ++j) {
+		double square = 2.0*temperature[j]*(vAzimuthal[j] + omegaRadius)*out[j];
+		out[j] = inversePiRadius*::sqrt(square > 0.0 ? square : 0.0)/density[j];
+	}
+}
+
+static inline void massFluxRow(const double* density, const double* vRadial, double circumference, double* out, unsigned int NAzimuthal)
+{
+	unsigned int j = 0;
+
+#ifdef SIMD_ENABLED
+	const Vector vCircumference = set1(circumference);
+
+	for (; j + vectorWidth <= NAzimuthal; j += vectorWidth) {
+		store(&out[j], mul(vCircumference, mul(load(&density[j]), load(&vRadial[j]))));
+	}
+#endif
+
+	for (; j < NAzimuthal; ++j) {
+		out[j] = circumference*density[j]*vRadial[j];
+	}
+}
+
+/**
+	computes the vertex rows firstRow to lastRow-1 of a quantity
+
+	\param grids vertex grids of all quantities read from files, indexed by type (only dependencies are used)
+	\param out (NRadial+1)*NAzimuthal vertex values
+	\param radii NRadial+1 radii of the vertex rows
+	\param omegaFrame angular velocity of the frame the velocities are written in
+	\param statistics statistics to add the vertices to (may be NULL)
+	\param expression expression of quantity EXPRESSION
+*/
+void computeRows(Simulation::QuantityType type, const double* const* grids, double* out, const double* radii, unsigned int NRadial, unsigned int NAzimuthal, double omegaFrame, unsigned int firstRow, unsigned int lastRow, FieldStatistics* statistics, const Expression* expression)
+{
+	if (type == Simulation::EXPRESSION) {
+		expression->evaluateRows(grids, out, radii, NAzimuthal, firstRow, lastRow, statistics);
+		return;
+	}
+
+	const double inverseTwoDphi = NAzimuthal/(4.0*M_PI);
+
+	for (unsigned int row = firstRow; row < lastRow; ++row) {
+		const size_t offset = (size_t)row*NAzimuthal;
+		double* outRow = &out[offset];
+
+		// neighbour rows for radial derivatives (the weight of a missing one is 0)
+		const size_t belowOffset = row > 0 ? offset - NAzimuthal : offset;
+		const size_t aboveOffset = row < NRadial ? offset + NAzimuthal : offset;
+		double wBelow, wCenter, wAbove;
+
+		switch (type) {
+			case Simulation::VORTICITY:
+			case Simulation::VORTENSITY: {
+				const double* vAzimuthal = grids[Simulation::V_AZIMUTHAL];
+				getRadialWeights(radii, NRadial, row, &wBelow, &wCenter, &wAbove);
+				circulationRow(&vAzimuthal[belowOffset], &vAzimuthal[offset], &vAzimuthal[aboveOffset], wBelow, wCenter, wAbove, 2.0*omegaFrame*radii[row], outRow, NAzimuthal);
+				vorticityRow(&grids[Simulation::V_RADIAL][offset], 1.0/radii[row], inverseTwoDphi, outRow, NAzimuthal);
+
+				if (type == Simulation::VORTENSITY) {
+					divideRow(&grids[Simulation::DENSITY][offset], outRow, NAzimuthal);
+				}
+				break;
+			}
+
+			case Simulation::TOOMRE_Q: {
+				const double* vAzimuthal = grids[Simulation::V_AZIMUTHAL];
+				getRadialWeights(radii, NRadial, row, &wBelow, &wCenter, &wAbove);
+				circulationRow(&vAzimuthal[belowOffset], &vAzimuthal[offset], &vAzimuthal[aboveOffset], wBelow, wCenter, wAbove, 2.0*omegaFrame*radii[row], outRow, NAzimuthal);
+				toomreRow(&vAzimuthal[offset], &grids[Simulation::TEMPERATURE][offset], &grids[Simulation::DENSITY][offset], 1.0/(M_PI*radii[row]), omegaFrame*radii[row], outRow, NAzimuthal);
+				break;
+			}
+
+			case Simulation::MASS_FLUX:
+				massFluxRow(&grids[Simulation::DENSITY][offset], &grids[Simulation::V_RADIAL][offset], 2.0*M_PI*radii[row], outRow, NAzimuthal);
+				break;
+
+			default:
+				memcpy(outRow, &grids[type][offset], NAzimuthal*sizeof(double));
+				break;
+		}
+
+		if (statistics != NULL) {
+			statistics->add(outRow, NAzimuthal);
+		}
+	}
+}
+
+/**
+	computes a range of rows on a thread of the pool for derived quantities
+*/
+class RowTask : public QRunnable
+{
+	public:
+		RowTask(Simulation::QuantityType type, const double* const* grids, double* out, const double* radii, unsigned int NRadial, unsigned int NAzimuthal, double omegaFrame, unsigned int firstRow, unsigned int lastRow, FieldStatistics* statistics, const Expression* expression, QSemaphore* done)
+		: type(type), grids(grids), out(out), radii(radii), NRadial(NRadial), NAzimuthal(NAzimuthal), omegaFrame(omegaFrame), firstRow(firstRow), lastRow(lastRow), statistics(statistics), expression(expression), done(done)
+		{
+		}
+
+		void run()
+		{
+			computeRows(type, grids, out, radii, NRadial, NAzimuthal, omegaFrame, firstRow, lastRow, statistics, expression);
+			done->release();
+		}
+
+	private:
+		Simulation::QuantityType type;
+		const double* const* grids;
+		double* out;
+		const double* radii;
+		unsigned int NRadial;
+		unsigned int NAzimuthal;
+		double omegaFrame;
+		unsigned int firstRow;
+		unsigned int lastRow;
+		FieldStatistics* statistics;
+		const Expression* expression;
+		QSemaphore* done;
+};
+
+/**
+	returns the pool for row tasks, separate from the global pool like the one of the interpolation
+*/
+static QThreadPool* getPool()
+{
+	static QThreadPool pool;
+
+	return &pool;
+}
+
+/**
+	computes a whole grid of a quantity, large grids are split into blocks of rows for several threads
+*/
+void compute(Simulation::QuantityType type, const double* const* grids, double* out, const double* radii, unsigned int NRadial, unsigned int NAzimuthal, double omegaFrame, FieldStatistics* statistics, const Expression* expression)
+{
+	unsigned int rows = NRadial + 1;
+	unsigned int threads = QThread::idealThreadCount() > 1 ? QThread::idealThreadCount() : 1;
+
+	if (statistics != NULL) {
+		statistics->reset();
+	}
+
+	if ((threads == 1) || ((size_t)rows*NAzimuthal < minimumParallelSize)) {
+		computeRows(type, grids, out, radii, NRadial, NAzimuthal, omegaFrame, 0, rows, statistics, expression);
+		return;
+	}
+
+	unsigned int rowsPerTask = (rows + threads - 1)/threads;
+	unsigned int tasks = 0;
+	QSemaphore done;
+
+	// every task accumulates its own statistics
+	std::vector<FieldStatistics> partial(threads);
+
+	for (unsigned int first = rowsPerTask; first < rows; first += rowsPerTask) {
+		unsigned int last = first + rowsPerTask < rows ? first + rowsPerTask : rows;
+		getPool()->start(new RowTask(type, grids, out, radii, NRadial, NAzimuthal, omegaFrame, first, last, statistics != NULL ? &partial[tasks] : NULL, expression, &done));
+		tasks++;
+	}
+
+	// first block on this thread
+	computeRows(type, grids, out, radii, NRadial, NAzimuthal, omegaFrame, 0, rowsPerTask, statistics, expression);
+
+	done.acquire(tasks);
+
+	if (statistics != NULL) {
+		for (unsigned int i = 0; i < tasks; ++i) {
+			statistics->merge(partial[i]);
+		}
+	}
+}
+
+}
@@ -0,0 +1,37 @@
+#ifndef _DERIVEDQUANTITIES_H_
+#define _DERIVEDQUANTITIES_H_
+
+#include "Simulation.h"
+
+class FieldStatistics;
+class Expression;
+
+/**
+	quantities computed from the vertex grids of a snapshot
+
+	Derivatives are finite differences on the vertex grid: second order
+	central differences for the (non-uniform) radii, one sided at the inner
+	and outer border, and periodic central differences in azimuthal
+	direction. The azimuthal velocity is written in the frame rotating with
+	OmegaFrame, which is added back (v_phi + OmegaFrame r) so that vorticity
+	and kappa are those of the inertial frame. Code units with G = 1.
+
+	- vorticity: (1/r) (d(r v_phi)/dr - dv_r/dphi)
+	- vortensity: vorticity / Sigma
+	- Toomre Q: c_s kappa / (pi Sigma) with c_s^2 = T and the local epicyclic
+	  frequency kappa^2 = (2 v_phi / r^2) d(r v_phi)/dr (0 where kappa^2 < 0)
+	- mass flux: 2 pi r Sigma v_r, the mass per time through the circle at r
+	  if averaged azimuthally (positive outwards)
+	- expression: evaluated by Expression, which also knows its grids
+*/
+namespace derived {
+
+bool isDerived(Simulation::QuantityType type);
+unsigned int getDependencies(Simulation::QuantityType type);
+unsigned int getDependencies(Simulation::QuantityType type, const Expression* expression);
+void compute(Simulation::QuantityType type, const double* const* grids, double* out, const double* radii, unsigned int NRadial, unsigned int NAzimuthal, double omegaFrame, FieldStatistics* statistics = 0, const Expression* expression = 0);
+void computeRows(Simulation::QuantityType type, const double* const* grids, double* out, const double* radii, unsigned int NRadial, unsigned int NAzimuthal, double omegaFrame, unsigned int firstRow, unsigned int lastRow, FieldStatistics* statistics = 0, const Expression* expression = 0);
+
+}
+
+#endif
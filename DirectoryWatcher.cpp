@@ -0,0 +1,165 @@
+#include "DirectoryWatcher.h"
+#include <QSocketNotifier>
+#include <QStringList>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+DirectoryWatcher::DirectoryWatcher(QObject* parent)
+: QObject(parent)
+{
+	fd = -1;
+	notifier = NULL;
+	directory = NULL;
+	lastRead = 0;
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+	stop();
+}
+
+#ifdef __linux__
+
+/**
+	starts watching a directory for written, appended and moved in files
+
+	\returns 0 on success, -1 if inotify is not available
+*/
+int DirectoryWatcher::watch(const char* directory)
+{
+	stop();
+
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "Could not initialize inotify.\n");
+		return -1;
+	}
+
+	if (inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO) < 0) {
+		fprintf(stderr, "Could not watch '%s'.\n", directory);
+		stop();
+		return -1;
+	}
+
+	this->directory = strdup(directory);
+	lastRead = time(NULL);
+
+	notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+	connect(notifier, SIGNAL(activated(int)), this, SLOT(readEvents()));
+
+	return 0;
+}
+
+void DirectoryWatcher::readEvents()
+{
+	// buffer for several events, aligned like struct inotify_event
+	char buffer[16*1024] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	QStringList names;
+	bool overflow = false;
+	time_t since = lastRead;
+
+	lastRead = time(NULL);
+
+	while (true) {
+		ssize_t length = read(fd, buffer, sizeof(buffer));
+
+		if (length <= 0)
+			break;
+
+		for (char* position = buffer; position < buffer + length; ) {
+			const struct inotify_event* event = (const struct inotify_event*)position;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				overflow = true;
+			} else if ((event->len > 0) && !names.contains(event->name)) {
+				names.append(event->name);
+			}
+
+			position += sizeof(struct inotify_event) + event->len;
+		}
+	}
+
+	if (overflow) {
+		rescan(since, &names);
+	}
+
+	for (int i = 0; i < names.size(); ++i) {
+		emit fileWritten(names[i]);
+	}
+}
+
+#else
+
+/**
+	watching directories needs inotify, which only exists on Linux
+
+	\returns -1
+*/
+int DirectoryWatcher::watch(const char* directory)
+{
+	stop();
+
+	fprintf(stderr, "Could not watch '%s', following a simulation is only supported on Linux.\n", directory);
+	return -1;
+}
+
+void DirectoryWatcher::readEvents()
+{
+}
+
+#endif
+
+void DirectoryWatcher::stop()
+{
+	delete notifier;
+	notifier = NULL;
+
+	if (fd >= 0) {
+		close(fd);
+	}
+
+	fd = -1;
+
+	free(directory);
+	directory = NULL;
+}
+
+/**
+	adds all files modified since a time, used when events were lost
+*/
+void DirectoryWatcher::rescan(time_t since, QStringList* names)
+{
+	DIR* dir = opendir(directory);
+
+	if (dir == NULL)
+		return;
+
+	struct dirent* entry;
+
+	while ((entry = readdir(dir)) != NULL) {
+		char* filename;
+		struct stat filestatus;
+
+		if (asprintf(&filename, "%s/%s", directory, entry->d_name) < 0) {
+			fprintf(stderr, "Not enough memory.");
+			exit(-1);
+		}
+
+		// modification times have a resolution of one second on some file systems
+		if ((stat(filename, &filestatus) == 0) && S_ISREG(filestatus.st_mode) && (filestatus.st_mtime + 1 >= since) && !names->contains(entry->d_name)) {
+			names->append(entry->d_name);
+		}
+
+		free(filename);
+	}
+
+	closedir(dir);
+}
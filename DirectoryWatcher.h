@@ -0,0 +1,46 @@
+#ifndef _DIRECTORYWATCHER_H_
+#define _DIRECTORYWATCHER_H_
+
+#include <QObject>
+#include <QString>
+#include <time.h>
+
+class QSocketNotifier;
+class QStringList;
+
+/**
+	reports files written in a directory using inotify (only on Linux)
+
+	Events are read from the main event loop, names written several times
+	between two reads are reported once. If the event queue overflowed, all
+	files modified since the previous read are reported.
+*/
+class DirectoryWatcher : public QObject
+{
+	Q_OBJECT
+
+	public:
+		DirectoryWatcher(QObject* parent = 0);
+		~DirectoryWatcher();
+
+		int watch(const char* directory);
+		void stop();
+		inline bool isWatching() const { return fd >= 0; }
+
+	signals:
+		void fileWritten(const QString& name);
+
+	private slots:
+		void readEvents();
+
+	private:
+		int fd;
+		QSocketNotifier* notifier;
+		char* directory;
+		/// time of the previous read of events
+		time_t lastRead;
+
+		void rescan(time_t since, QStringList* names);
+};
+
+#endif
@@ -0,0 +1,620 @@
+#include "Expression.h"
+#include "Simulation.h"
+#include "FieldStatistics.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "SIMD.h"
+
+using namespace simd;
+
+Expression::Expression()
+{
+	text = NULL;
+	error[0] = 0;
+	dependencies = 0;
+	depth = 0;
+	position = NULL;
+	nesting = 0;
+}
+
+Expression::~Expression()
+{
+	free(text);
+}
+
+/**
+	parses an expression, replacing the previous one
+
+	\returns 0 on success, -1 on syntax errors (see getError)
+*/
+int Expression::parse(const char* text)
+{
+	free(this->text);
+	this->text = strdup(text);
+	error[0] = 0;
+	programs.clear();
+	dependencies = 0;
+	depth = 0;
+
+	Program program;
+	program.depth = 0;
+	program.maximumDepth = 0;
+
+	position = this->text;
+	nesting = 0;
+	int ret = parseSum(&program);
+
+	if (ret == 0) {
+		skipSpace();
+
+		if (*position != 0) {
+			ret = fail("unexpected character");
+		}
+	}
+
+	if (ret == 0) {
+		programs.push_back(program);
+
+		for (unsigned int i = 0; i < programs.size(); ++i) {
+			if (programs[i].maximumDepth > depth)
+				depth = programs[i].maximumDepth;
+		}
+
+		if (depth > maximumDepth) {
+			snprintf(error, sizeof(error), "Expression is too deeply nested.");
+			ret = -1;
+		}
+	}
+
+	if (ret != 0) {
+		programs.clear();
+		dependencies = 0;
+	}
+
+	return ret;
+}
+
+void Expression::skipSpace()
+{
+	while (isspace((unsigned char)*position))
+		position++;
+}
+
+/**
+	sets an error message at the current position
+*/
+int Expression::fail(const char* message)
+{
+	snprintf(error, sizeof(error), "Error in expression at position %u: %s.", (unsigned int)(position - text) + 1, message);
+
+	return -1;
+}
+
+int Expression::expect(char c)
+{
+	skipSpace();
+
+	if (*position != c) {
+		char message[32];
+		snprintf(message, sizeof(message), "'%c' expected", c);
+		return fail(message);
+	}
+
+	position++;
+
+	return 0;
+}
+
+/**
+	appends an instruction and keeps track of the depth of the stack
+*/
+void Expression::addInstruction(Program* program, Opcode opcode, unsigned int index, double value)
+{
+	Instruction instruction;
+	instruction.opcode = opcode;
+	instruction.index = index;
+	instruction.value = value;
+	program->instructions.push_back(instruction);
+
+	if (opcode < ADD) {
+		program->depth++;
+
+		if (program->depth > program->maximumDepth)
+			program->maximumDepth = program->depth;
+	} else if (opcode < NEGATE) {
+		program->depth--;
+	}
+}
+
+int Expression::parseSum(Program* program)
+{
+	if (parseProduct(program) < 0)
+		return -1;
+
+	while (true) {
+		skipSpace();
+
+		if ((*position != '+') && (*position != '-'))
+			return 0;
+
+		Opcode opcode = *position == '+' ? ADD : SUBTRACT;
+		position++;
+
+		if (parseProduct(program) < 0)
+			return -1;
+
+		addInstruction(program, opcode);
+	}
+}
+
+int Expression::parseProduct(Program* program)
+{
+	if (parseUnary(program) < 0)
+		return -1;
+
+	while (true) {
+		skipSpace();
+
+		// '**' is a power
+		if (((*position != '*') && (*position != '/')) || ((position[0] == '*') && (position[1] == '*')))
+			return 0;
+
+		Opcode opcode = *position == '*' ? MULTIPLY : DIVIDE;
+		position++;
+
+		if (parseUnary(program) < 0)
+			return -1;
+
+		addInstruction(program, opcode);
+	}
+}
+
+int Expression::parseUnary(Program* program)
+{
+	skipSpace();
+
+	// every nested parenthesis, function argument, sign and power passes here
+	if (nesting >= maximumNesting)
+		return fail("too deeply nested");
+
+	nesting++;
+	int ret;
+
+	if (*position == '-') {
+		position++;
+		ret = parseUnary(program);
+
+		if (ret == 0)
+			addInstruction(program, NEGATE);
+	} else if (*position == '+') {
+		position++;
+		ret = parseUnary(program);
+	} else {
+		ret = parsePower(program);
+	}
+
+	nesting--;
+	return ret;
+}
+
+int Expression::parsePower(Program* program)
+{
+	if (parsePrimary(program) < 0)
+		return -1;
+
+	skipSpace();
+
+	if ((*position == '^') || ((position[0] == '*') && (position[1] == '*'))) {
+		position += *position == '^' ? 1 : 2;
+
+		// right associative, binds tighter than a unary minus on its left
+		if (parseUnary(program) < 0)
+			return -1;
+
+		addInstruction(program, POWER);
+	}
+
+	return 0;
+}
+
+int Expression::parsePrimary(Program* program)
+{
+	skipSpace();
+
+	if (*position == '(') {
+		position++;
+
+		if (parseSum(program) < 0)
+			return -1;
+
+		return expect(')');
+	}
+
+	if (isdigit((unsigned char)*position) || (*position == '.')) {
+		char* end;
+		double value = strtod(position, &end);
+
+		if (end == position)
+			return fail("invalid number");
+
+		position = end;
+		addInstruction(program, CONSTANT, 0, value);
+
+		return 0;
+	}
+
+	if (!isalpha((unsigned char)*position) && (*position != '_'))
+		return fail(*position == 0 ? "unexpected end" : "unexpected character");
+
+	char name[32];
+	unsigned int length = 0;
+
+	while (isalnum((unsigned char)*position) || (*position == '_')) {
+		if (length + 1 < sizeof(name))
+			name[length++] = *position;
+		position++;
+	}
+	name[length] = 0;
+
+	skipSpace();
+
+	if (*position == '(') {
+		position++;
+		return parseCall(program, name);
+	}
+
+	static const struct {
+		const char* name;
+		Simulation::QuantityType type;
+	} grids[] = {
+		{ "dens", Simulation::DENSITY },
+		{ "density", Simulation::DENSITY },
+		{ "sigma", Simulation::DENSITY },
+		{ "temp", Simulation::TEMPERATURE },
+		{ "temperature", Simulation::TEMPERATURE },
+		{ "vrad", Simulation::V_RADIAL },
+		{ "vr", Simulation::V_RADIAL },
+		{ "vtheta", Simulation::V_AZIMUTHAL },
+		{ "vphi", Simulation::V_AZIMUTHAL }
+	};
+
+	for (unsigned int i = 0; i < sizeof(grids)/sizeof(grids[0]); ++i) {
+		if (strcmp(name, grids[i].name) == 0) {
+			addInstruction(program, GRID, grids[i].type);
+			dependencies |= 1u << grids[i].type;
+			return 0;
+		}
+	}
+
+	if ((strcmp(name, "r") == 0) || (strcmp(name, "radius") == 0)) {
+		addInstruction(program, RADIUS);
+	} else if ((strcmp(name, "phi") == 0) || (strcmp(name, "azimuth") == 0)) {
+		addInstruction(program, AZIMUTH);
+	} else if (strcmp(name, "pi") == 0) {
+		addInstruction(program, CONSTANT, 0, M_PI);
+	} else {
+		return fail("unknown name");
+	}
+
+	return 0;
+}
+
+/**
+	parses the arguments of a function, the opening parenthesis is already read
+*/
+int Expression::parseCall(Program* program, const char* name)
+{
+	static const struct {
+		const char* name;
+		Opcode opcode;
+	} unary[] = {
+		{ "log", LOG },
+		{ "ln", LOG },
+		{ "log10", LOG10 },
+		{ "exp", EXP },
+		{ "sqrt", SQRT },
+		{ "abs", ABS },
+		{ "sin", SIN },
+		{ "cos", COS }
+	}, binary[] = {
+		{ "pow", POWER },
+		{ "min", MINIMUM },
+		{ "max", MAXIMUM }
+	};
+
+	for (unsigned int i = 0; i < sizeof(unary)/sizeof(unary[0]); ++i) {
+		if (strcmp(name, unary[i].name) == 0) {
+			if ((parseSum(program) < 0) || (expect(')') < 0))
+				return -1;
+
+			addInstruction(program, unary[i].opcode);
+			return 0;
+		}
+	}
+
+	for (unsigned int i = 0; i < sizeof(binary)/sizeof(binary[0]); ++i) {
+		if (strcmp(name, binary[i].name) == 0) {
+			if ((parseSum(program) < 0) || (expect(',') < 0) || (parseSum(program) < 0) || (expect(')') < 0))
+				return -1;
+
+			addInstruction(program, binary[i].opcode);
+			return 0;
+		}
+	}
+
+	if (strcmp(name, "azimean") == 0) {
+		// the argument gets its own program, evaluated for the whole row first
+		Program mean;
+		mean.depth = 0;
+		mean.maximumDepth = 0;
+
+		if ((parseSum(&mean) < 0) || (expect(')') < 0))
+			return -1;
+
+		programs.push_back(mean);
+		addInstruction(program, ROW_VALUE, programs.size() - 1);
+		return 0;
+	}
+
+	return fail("unknown function");
+}
+
+/**
+	operations on blocks, with a vector loop where the vector unit has the operation
+*/
+namespace {
+
+struct Add {
+#ifdef SIMD_ENABLED
+	static inline Vector vector(Vector a, Vector b) { return add(a, b); }
+#endif
+	static inline double scalar(double a, double b) { return a + b; }
+};
+
+struct Subtract {
+#ifdef SIMD_ENABLED
+	static inline Vector vector(Vector a, Vector b) { return sub(a, b); }
+#endif
+	static inline double scalar(double a, double b) { return a - b; }
+};
+
+struct Multiply {
+#ifdef SIMD_ENABLED
+	static inline Vector vector(Vector a, Vector b) { return mul(a, b); }
+#endif
+	static inline double scalar(double a, double b) { return a * b; }
+};
+
+struct Divide {
+#ifdef SIMD_ENABLED
+	static inline Vector vector(Vector a, Vector b) { return div(a, b); }
+#endif
+	static inline double scalar(double a, double b) { return a / b; }
+};
+
+struct Minimum {
+#ifdef SIMD_ENABLED
+	static inline Vector vector(Vector a, Vector b) { return min(a, b); }
+#endif
+	static inline double scalar(double a, double b) { return a < b ? a : b; }
+};
+
+struct Maximum {
+#ifdef SIMD_ENABLED
+	static inline Vector vector(Vector a, Vector b) { return max(a, b); }
+#endif
+	static inline double scalar(double a, double b) { return a > b ? a : b; }
+};
+
+template< typename Operation >
+inline void binaryBlock(const double* a, const double* b, double* out, unsigned int count)
+{
+	unsigned int i = 0;
+
+#ifdef SIMD_ENABLED
+	for (; i + vectorWidth <= count; i += vectorWidth) {
+		store(&out[i], Operation::vector(load(&a[i]), load(&b[i])));
+	}
+#endif
+
+	for (; i < count; ++i) {
+		out[i] = Operation::scalar(a[i], b[i]);
+	}
+}
+
+inline void fillBlock(double value, double* out, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; ++i) {
+		out[i] = value;
+	}
+}
+
+}
+
+/**
+	evaluates a program for the vertices firstColumn to firstColumn+count-1 of a row
+
+	\param offset index of the first vertex in the grids
+	\param scratch depth*blockSize values for the stack
+	\returns the values, either in scratch or in a grid
+*/
+const double* Expression::evaluateBlock(const Program& program, const double* const* grids, size_t offset, double radius, unsigned int firstColumn, unsigned int count, double dphi, const double* rowValues, double* scratch) const
+{
+	// stack entries point to their slot in scratch or directly into a grid
+	const double* stack[maximumDepth];
+	unsigned int top = 0;
+
+	for (unsigned int i = 0; i < program.instructions.size(); ++i) {
+		const Instruction& instruction = program.instructions[i];
+		double* slot = &scratch[(size_t)(instruction.opcode < ADD ? top : top - 1 - (instruction.opcode < NEGATE ? 1 : 0))*blockSize];
+
+		switch (instruction.opcode) {
+			case GRID:
+				stack[top++] = &grids[instruction.index][offset];
+				break;
+
+			case CONSTANT:
+				fillBlock(instruction.value, slot, count);
+				stack[top++] = slot;
+				break;
+
+			case RADIUS:
+				fillBlock(radius, slot, count);
+				stack[top++] = slot;
+				break;
+
+			case AZIMUTH:
+				for (unsigned int j = 0; j < count; ++j) {
+					slot[j] = (firstColumn + j)*dphi;
+				}
+				stack[top++] = slot;
+				break;
+
+			case ROW_VALUE:
+				fillBlock(rowValues[instruction.index], slot, count);
+				stack[top++] = slot;
+				break;
+
+			case ADD:
+				binaryBlock<Add>(stack[top-2], stack[top-1], slot, count);
+				break;
+
+			case SUBTRACT:
+				binaryBlock<Subtract>(stack[top-2], stack[top-1], slot, count);
+				break;
+
+			case MULTIPLY:
+				binaryBlock<Multiply>(stack[top-2], stack[top-1], slot, count);
+				break;
+
+			case DIVIDE:
+				binaryBlock<Divide>(stack[top-2], stack[top-1], slot, count);
+				break;
+
+			case MINIMUM:
+				binaryBlock<Minimum>(stack[top-2], stack[top-1], slot, count);
+				break;
+
+			case MAXIMUM:
+				binaryBlock<Maximum>(stack[top-2], stack[top-1], slot, count);
+				break;
+
+			case POWER: {
+				const double* a = stack[top-2];
+				const double* b = stack[top-1];
+				for (unsigned int j = 0; j < count; ++j) {
+					slot[j] = pow(a[j], b[j]);
+				}
+				break;
+			}
+
+			case NEGATE: {
+				const double* a = stack[top-1];
+				for (unsigned int j = 0; j < count; ++j) {
+					slot[j] = -a[j];
+				}
+				break;
+			}
+
+			case SQRT: {
+				const double* a = stack[top-1];
+				unsigned int j = 0;
+#ifdef SIMD_ENABLED
+				for (; j + vectorWidth <= count; j += vectorWidth) {
+					store(&slot[j], simd::sqrt(load(&a[j])));
+				}
+#endif
+				for (; j < count; ++j) {
+					slot[j] = ::sqrt(a[j]);
+				}
+				break;
+			}
+
+			case LOG:
+			case LOG10:
+			case EXP:
+			case ABS:
+			case SIN:
+			case COS: {
+				const double* a = stack[top-1];
+				double (*function)(double);
+
+				switch (instruction.opcode) {
+					case LOG: function = ::log; break;
+					case LOG10: function = ::log10; break;
+					case EXP: function = ::exp; break;
+					case ABS: function = ::fabs; break;
+					case SIN: function = ::sin; break;
+					default: function = ::cos; break;
+				}
+
+				for (unsigned int j = 0; j < count; ++j) {
+					slot[j] = function(a[j]);
+				}
+				break;
+			}
+		}
+
+		if ((instruction.opcode >= ADD) && (instruction.opcode < NEGATE)) {
+			top--;
+			stack[top-1] = slot;
+		} else if (instruction.opcode >= NEGATE) {
+			stack[top-1] = slot;
+		}
+	}
+
+	return stack[0];
+}
+
+/**
+	evaluates the vertex rows firstRow to lastRow-1
+
+	\param grids vertex grids of the quantities read from files, indexed by type (only dependencies are used)
+	\param out vertex values
+	\param radii radii of the vertex rows
+	\param statistics statistics to add the vertices to (may be NULL)
+*/
+void Expression::evaluateRows(const double* const* grids, double* out, const double* radii, unsigned int NAzimuthal, unsigned int firstRow, unsigned int lastRow, FieldStatistics* statistics) const
+{
+	if (programs.empty())
+		return;
+
+	const double dphi = 2.0*M_PI/NAzimuthal;
+	const Program& expression = programs.back();
+	std::vector<double> scratch((size_t)(depth > 0 ? depth : 1)*blockSize);
+	std::vector<double> rowValues(programs.size());
+
+	for (unsigned int row = firstRow; row < lastRow; ++row) {
+		const size_t rowOffset = (size_t)row*NAzimuthal;
+
+		// azimuthal means, inner ones first
+		for (unsigned int i = 0; i + 1 < programs.size(); ++i) {
+			double sum = 0.0;
+
+			for (unsigned int column = 0; column < NAzimuthal; column += blockSize) {
+				unsigned int count = NAzimuthal - column < blockSize ? NAzimuthal - column : blockSize;
+				const double* values = evaluateBlock(programs[i], grids, rowOffset + column, radii[row], column, count, dphi, &rowValues[0], &scratch[0]);
+
+				for (unsigned int j = 0; j < count; ++j) {
+					sum += values[j];
+				}
+			}
+
+			rowValues[i] = sum/NAzimuthal;
+		}
+
+		for (unsigned int column = 0; column < NAzimuthal; column += blockSize) {
+			unsigned int count = NAzimuthal - column < blockSize ? NAzimuthal - column : blockSize;
+			const double* values = evaluateBlock(expression, grids, rowOffset + column, radii[row], column, count, dphi, &rowValues[0], &scratch[0]);
+
+			memcpy(&out[rowOffset + column], values, count*sizeof(double));
+		}
+
+		if (statistics != NULL) {
+			statistics->add(&out[rowOffset], NAzimuthal);
+		}
+	}
+}
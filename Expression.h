@@ -0,0 +1,112 @@
+#ifndef _EXPRESSION_H_
+#define _EXPRESSION_H_
+
+#include <vector>
+#include <stddef.h>
+
+class FieldStatistics;
+
+/**
+	user defined quantity computed from the vertex grids
+
+	The text is parsed once into stack programs, which are evaluated on
+	blocks of a row (blockSize vertices), so all intermediate values stay in
+	cache and there are no temporary grids. Arithmetic runs on the widest
+	vector unit.
+
+	Grammar (usual precedence, ^ is right associative):
+	- numbers, pi
+	- grids: dens (density, sigma), temp (temperature), vrad (vr), vtheta (vphi)
+	- coordinates of the vertex: r (radius), phi (azimuth)
+	- + - * / ^ and unary -
+	- log (ln), log10, exp, sqrt, abs, sin, cos, pow(a, b), min(a, b), max(a, b)
+	- azimean(x): mean of x over the ring of the vertex
+*/
+class Expression
+{
+	public:
+		// vertices of a row evaluated at once
+		static const unsigned int blockSize = 256;
+		static const unsigned int maximumDepth = 32;
+		// of parentheses, signs and powers, bounds the recursion of the parser
+		static const unsigned int maximumNesting = 256;
+
+		Expression();
+		~Expression();
+
+		int parse(const char* text);
+		inline const char* getText() const { return text; }
+		inline const char* getError() const { return error; }
+		inline unsigned int getDependencies() const { return dependencies; }
+
+		void evaluateRows(const double* const* grids, double* out, const double* radii, unsigned int NAzimuthal, unsigned int firstRow, unsigned int lastRow, FieldStatistics* statistics) const;
+
+	private:
+		enum Opcode {
+			GRID,
+			CONSTANT,
+			RADIUS,
+			AZIMUTH,
+			ROW_VALUE,
+			// binary
+			ADD,
+			SUBTRACT,
+			MULTIPLY,
+			DIVIDE,
+			POWER,
+			MINIMUM,
+			MAXIMUM,
+			// unary
+			NEGATE,
+			LOG,
+			LOG10,
+			EXP,
+			SQRT,
+			ABS,
+			SIN,
+			COS
+		};
+
+		struct Instruction {
+			Opcode opcode;
+			// grid or row value
+			unsigned int index;
+			double value;
+		};
+
+		struct Program {
+			std::vector<Instruction> instructions;
+			unsigned int depth;
+			unsigned int maximumDepth;
+		};
+
+		char* text;
+		char error[256];
+
+		/// azimuthal means (computed per row, in this order) and the expression itself (last)
+		std::vector<Program> programs;
+		unsigned int dependencies;
+		unsigned int depth;
+
+		// parser
+		const char* position;
+		unsigned int nesting;
+		int parseSum(Program* program);
+		int parseProduct(Program* program);
+		int parseUnary(Program* program);
+		int parsePower(Program* program);
+		int parsePrimary(Program* program);
+		int parseCall(Program* program, const char* name);
+		int expect(char c);
+		void skipSpace();
+		int fail(const char* message);
+		static void addInstruction(Program* program, Opcode opcode, unsigned int index = 0, double value = 0.0);
+
+		const double* evaluateBlock(const Program& program, const double* const* grids, size_t offset, double radius, unsigned int firstColumn, unsigned int count, double dphi, const double* rowValues, double* scratch) const;
+
+		// not copyable
+		Expression(const Expression&);
+		Expression& operator=(const Expression&);
+};
+
+#endif
@@ -24,5 +24,5 @@ release {
 }
 
 # Input
-HEADERS += MainWidget.h OpenGLWidget.h Simulation.h config.h Palette.h PaletteWidget.h ColorWidget.h RocheLobe.h Vector.h Matrix.h OpenGLNavigationWidget.h FARGO.h version.h
-SOURCES += main.cpp MainWidget.cpp OpenGLWidget.cpp Simulation.cpp config.cpp Palette.cpp PaletteWidget.cpp ColorWidget.cpp RocheLobe.cpp OpenGLNavigationWidget.cpp FARGO.cpp
+HEADERS += MainWidget.h OpenGLWidget.h Simulation.h config.h Palette.h PaletteWidget.h ColorWidget.h RocheLobe.h Vector.h Matrix.h OpenGLNavigationWidget.h FARGO.h MappedFile.h Snapshot.h Prefetcher.h PlanetIndex.h Catalog.h SnapshotCache.h CompressedCache.h DirectoryWatcher.h Interpolation.h SIMD.h DerivedQuantities.h Expression.h FieldStatistics.h StatisticsIndex.h GridPyramid.h Colormap.h Pack.h BatchRenderer.h ScreenshotWriter.h VideoWriter.h StreamBuffer.h PackedFARGO.h version.h
+SOURCES += main.cpp MainWidget.cpp OpenGLWidget.cpp Simulation.cpp config.cpp Palette.cpp PaletteWidget.cpp ColorWidget.cpp RocheLobe.cpp OpenGLNavigationWidget.cpp FARGO.cpp MappedFile.cpp Snapshot.cpp Prefetcher.cpp PlanetIndex.cpp Catalog.cpp SnapshotCache.cpp CompressedCache.cpp DirectoryWatcher.cpp Interpolation.cpp DerivedQuantities.cpp Expression.cpp FieldStatistics.cpp StatisticsIndex.cpp GridPyramid.cpp Colormap.cpp Pack.cpp BatchRenderer.cpp ScreenshotWriter.cpp VideoWriter.cpp StreamBuffer.cpp PackedFARGO.cpp
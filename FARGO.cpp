@@ -1,4 +1,14 @@
 #include "FARGO.h"
+#include "Snapshot.h"
+#include "PlanetIndex.h"
+#include "Catalog.h"
+#include "SnapshotCache.h"
+#include "Pack.h"
+#include "DirectoryWatcher.h"
+#include "Interpolation.h"
+#include "DerivedQuantities.h"
+#include "Expression.h"
+#include "FieldStatistics.h"
 #include "config.h"
 #include <string.h>
 #include <libgen.h>
@@ -7,6 +17,12 @@
 #include <math.h>
 #include <float.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <QtConcurrentRun>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 FARGO::FARGO()
 {
@@ -17,17 +33,23 @@ FARGO::FARGO()
 	NPlanets = 0;
 	readGhostCells = true;
 	quantityType = DENSITY;
-	quantity = NULL;
+	preloadedQuantities = 0;
 	radii = NULL;
+	omegaFrame = 0.0;
+
+	bytesRead = 0;
+	bytesCopied = 0;
 
-	planetPositions = NULL;
-	planetVelocities = NULL;
 	planetMasses = NULL;
 	planetRadii = NULL;
+	planetIndex = NULL;
+	catalog = NULL;
+	watcher = NULL;
+	following = false;
+
+	cache = new SnapshotCache;
 
-	particlePositions = NULL;
-	particleVelocities = NULL;
-	particleMasses = NULL;
+	NParticles = 0;
 
 	if (version == FARGO_TWAM) {
 		readGhostCells = false;
@@ -40,26 +62,18 @@ FARGO::~FARGO()
 	free(outputDirectory);
 	free(planetConfigFilename);
 
-	free(planetPositions);
-	free(planetVelocities);
 	free(planetMasses);
 	free(planetRadii);
-
-	free(particlePositions);
-	free(particleVelocities);
-	free(particleMasses);
+	delete watcher;
+	delete planetIndex;
+	delete catalog;
+	delete cache;
 
 	delete [] radii;
-
-	if (quantity != NULL)
-		delete [] quantity;
 }
 
 int FARGO::loadFromFile(const char* filename)
 {
-	char buffer[512];
-	FILE *fd;
-
 	free(configFilename);
 	configFilename = (char*)malloc(1+strlen(filename));
 	strcpy(configFilename, filename);
@@ -71,6 +85,7 @@ int FARGO::loadFromFile(const char* filename)
 
 	rMin = config::value_as_double("Rmin");
 	rMax = config::value_as_double("Rmax");
+	omegaFrame = config::value_as_double_default("OmegaFrame", 0.0);
 	totalTimestep = config::value_as_unsigned_int("Ntot");
 	NRadial = config::value_as_unsigned_int("Nrad");
 	NAzimuthal = config::value_as_unsigned_int("Nsec");
@@ -156,6 +171,125 @@ int FARGO::loadFromFile(const char* filename)
 		planetConfigFilename = NULL;
 	}
 
+	// load particles
+	HasParticles = config::value_as_bool_default("IntegrateParticles", false);
+	NParticles = config::value_as_unsigned_int_default("NumberOfParticles", 0);
+
+	// use cached catalog of the output directory if nothing changed since it was written
+	delete catalog;
+	catalog = new Catalog;
+	catalog->setOutputDirectory(outputDirectory);
+	catalog->addDependency(configFilename, true);
+	if (planetConfigFilename != NULL) {
+		catalog->addDependency(planetConfigFilename, true);
+	}
+	catalog->addDependency(outputDirectory, false);
+
+	if (asprintf(&temp, "%s/used_rad.dat", outputDirectory)<0) {
+		fprintf(stderr, "Not enough memory.");
+		exit(-1);
+	}
+	// written once at the start of a run
+	catalog->addDependency(temp, true);
+	free(temp);
+
+	if (asprintf(&temp, "%s/Quantities.dat", outputDirectory)<0) {
+		fprintf(stderr, "Not enough memory.");
+		exit(-1);
+	}
+	catalog->addDependency(temp, false);
+	free(temp);
+
+	if ((catalog->load() == 0) && (catalog->NRadial == NRadial) && (catalog->NAzimuthal == NAzimuthal) && (catalog->radii.size() == NRadial+1) && (catalog->NPlanets > 0)) {
+		totalTimestep = catalog->totalTimestep;
+
+		radii = new double[NRadial+1];
+		memcpy(radii, &catalog->radii[0], (NRadial+1)*sizeof(double));
+
+		NPlanets = catalog->NPlanets;
+		planetMasses = (double*)malloc(NPlanets*sizeof(double));
+		planetRadii = (double*)malloc(NPlanets*sizeof(double));
+		memcpy(planetMasses, &catalog->planetMasses[0], NPlanets*sizeof(double));
+		memcpy(planetRadii, &catalog->planetRadii[0], NPlanets*sizeof(double));
+	} else {
+		int ret = loadOutputDirectory();
+
+		if (ret < 0)
+			return ret;
+	}
+
+	if (catalog->getNumberOfGaps(quantityType) > 0) {
+		fprintf(stderr, "%u timesteps are missing in '%s'.\n", catalog->getNumberOfGaps(quantityType), outputDirectory);
+	}
+
+	createInitialSnapshot();
+
+	// index planet files in background
+	delete planetIndex;
+	planetIndex = new PlanetIndex;
+	planetIndex->setMaximumTimestep(totalTimestep);
+
+	for (unsigned int i = 1; i < NPlanets; ++i) {
+		if (asprintf(&temp, "%s/planet%u.dat", outputDirectory, version == FARGO_TWAM ? i : i-1)<0) {
+			fprintf(stderr, "Not enough memory.");
+			exit(-1);
+		}
+		planetIndex->addFile(temp);
+		free(temp);
+	}
+
+	planetIndex->start();
+
+	config::clear_config();
+
+	loadTimestep(0);
+
+	emit dataUpdated();
+
+	return 0;
+}
+
+/**
+	creates the snapshot shown until timestep 0 is loaded, with the planets from the catalog
+*/
+void FARGO::createInitialSnapshot()
+{
+	snapshot = Snapshot::create();
+	Snapshot::Field& field = snapshot->fields[quantityType];
+	snapshot->resizeQuantity(quantityType, (NRadial + 1)*NAzimuthal);
+	for (unsigned int i = 0; i < (NRadial + 1)*NAzimuthal; ++i) {
+		field.buffer[i] = 0.0;
+	}
+	field.data = field.buffer;
+	field.statistics.reset();
+	field.statistics.add(field.buffer, (NRadial + 1)*NAzimuthal);
+	snapshot->quantityMask = 1u << quantityType;
+
+	snapshot->resizePlanets(NPlanets);
+	memcpy(snapshot->planetPositions, &catalog->planetPositions[0], NPlanets*3*sizeof(double));
+	memcpy(snapshot->planetVelocities, &catalog->planetVelocities[0], NPlanets*3*sizeof(double));
+
+	snapshot->resizeParticles(NParticles);
+	for (unsigned int i = 0; i < NParticles; ++i) {
+		snapshot->particlePositions[2*i+0] = 0.0;
+		snapshot->particlePositions[2*i+1] = 0.0;
+		snapshot->particleVelocities[2*i+0] = 0.0;
+		snapshot->particleVelocities[2*i+1] = 0.0;
+		snapshot->particleMasses[i] = 0.0;
+	}
+}
+
+/**
+	reads radii, planet configuration and last timestep and fills the catalog
+
+	Called by loadFromFile if there is no valid catalog of the output directory.
+*/
+int FARGO::loadOutputDirectory()
+{
+	char buffer[512];
+	char *temp;
+	FILE *fd;
+
 	// load radii
 	temp = new char[strlen(outputDirectory)+1+13];
 	sprintf(temp, "%s/used_rad.dat", outputDirectory);
@@ -173,24 +307,26 @@ int FARGO::loadFromFile(const char* filename)
 	if (!readGhostCells) {
 		if (fgets(buffer, sizeof(buffer), fd) == NULL) {
 			fprintf(stderr,"Not enough radii in radii file!\n");
+			fclose(fd);
 			return -3;
 		}
 	}
 	for (unsigned int i = 0; i <= NRadial; i++) {
 		if (fgets(buffer, sizeof(buffer), fd) == NULL) {
 			fprintf(stderr,"Not enough radii in radii file!\n");
+			fclose(fd);
 			return -3;
 		}
 		sscanf(buffer, "%lf", &radii[i]);
 	}
 
-	quantity = new double[(NRadial + 1)*NAzimuthal];
+	fclose(fd);
 
 	// load planets
 	NPlanets = 1;
 
-	planetPositions = (double*)malloc(3*sizeof(double));
-	planetVelocities = (double*)malloc(3*sizeof(double));
+	double* planetPositions = (double*)malloc(3*sizeof(double));
+	double* planetVelocities = (double*)malloc(3*sizeof(double));
 	planetMasses = (double*)malloc(1*sizeof(double));
 	planetRadii = (double*)malloc(1*sizeof(double));
 	// planet 0 is sun, positon (0,0,0)
@@ -210,6 +346,8 @@ int FARGO::loadFromFile(const char* filename)
 
 		if (fd == NULL) {
 			fprintf(stderr, "Error : can't find '%s'.\n", planetConfigFilename);
+			free(planetPositions);
+			free(planetVelocities);
 			return -1;
 		}
 		// read line by line
@@ -249,14 +387,6 @@ int FARGO::loadFromFile(const char* filename)
 		fclose(fd);
 	}
 
-	// load particles
-	HasParticles = config::value_as_bool_default("IntegrateParticles", false);
-	NParticles = config::value_as_unsigned_int_default("NumberOfParticles", 0);
-
-	particlePositions = (double*)malloc(2*NParticles*sizeof(double));
-	particleVelocities = (double*)malloc(2*NParticles*sizeof(double));
-	particleMasses = (double*)malloc(NParticles*sizeof(double));
-
 	// check for last timestep
 	if (version == FARGO_TWAM) {
 		temp = new char[strlen(outputDirectory)+1+15];
@@ -276,26 +406,259 @@ int FARGO::loadFromFile(const char* filename)
 		}
 	}
 
-	config::clear_config();
+	// save catalog for next time
+	catalog->scan();
+	catalog->NRadial = NRadial;
+	catalog->NAzimuthal = NAzimuthal;
+	catalog->totalTimestep = totalTimestep;
+	catalog->radii.assign(radii, radii+NRadial+1);
+	catalog->NPlanets = NPlanets;
+	catalog->planetMasses.assign(planetMasses, planetMasses+NPlanets);
+	catalog->planetRadii.assign(planetRadii, planetRadii+NPlanets);
+	catalog->planetPositions.assign(planetPositions, planetPositions+3*NPlanets);
+	catalog->planetVelocities.assign(planetVelocities, planetVelocities+3*NPlanets);
 
-	loadTimestep(0);
+	free(planetPositions);
+	free(planetVelocities);
 
-	emit dataUpdated();
+	if (catalog->save() < 0) {
+		fprintf(stderr, "Could not save catalog of '%s'.\n", outputDirectory);
+	}
 
 	return 0;
 }
 
+/**
+	splits particle records into position, velocity and mass arrays
+
+	Each record consists of 9 doubles: id, x, y, v_x, v_y, mass and three
+	values which are not used.
+*/
+static void deinterleaveParticles(const double* records, unsigned int count, double* positions, double* velocities, double* masses)
+{
+	for (unsigned int i = 0; i < count; ++i) {
+		const double* record = &records[9*i];
+
+#ifdef __SSE2__
+		_mm_storeu_pd(&positions[2*i], _mm_loadu_pd(&record[1]));
+		_mm_storeu_pd(&velocities[2*i], _mm_loadu_pd(&record[3]));
+#else
+		positions[2*i+0] = record[1];
+		positions[2*i+1] = record[2];
+		velocities[2*i+0] = record[3];
+		velocities[2*i+1] = record[4];
+#endif
+		masses[i] = record[5];
+	}
+}
+
 int FARGO::loadTimestep(unsigned int timestep)
 {
-	// TODO: On errors, memory leakage occurs!
+	SnapshotPointer newSnapshot;
+
+	int ret = fetchSnapshot(timestep, quantityType, &newSnapshot);
+
+	if (ret == 0) {
+		setSnapshot(newSnapshot);
+	}
+
+	return ret;
+}
+
+/**
+	gets a snapshot from the cache or loads it and adds it to the cache
+
+	\returns 0 on success, error code of loadSnapshot otherwise
+*/
+int FARGO::fetchSnapshot(unsigned int timestep, QuantityType type, SnapshotPointer* result)
+{
+	Region region = getRegionOfInterest();
+	ExpressionPointer currentExpression = getExpression();
+
+	*result = cache->find(timestep, type);
+
+	// a snapshot loaded for another region lacks parts of the grid
+	if (!result->isNull() && !(*result)->region.covers(region)) {
+		result->clear();
+	}
+
+	if (result->isNull()) {
+		SnapshotPointer newSnapshot = Snapshot::create();
+		newSnapshot->region = region;
+
+		// preload only quantities whose grids were written for this timestep
+		unsigned int mask = 1u << type;
+		catalogMutex.lock();
+		for (unsigned int other = 0; other < N_QUANTITY_TYPES; ++other) {
+			if ((preloadedQuantities & (1u << other)) && hasGridFiles(derived::getDependencies((QuantityType)other, currentExpression.data()), timestep, true)) {
+				mask |= 1u << other;
+			}
+		}
+		catalogMutex.unlock();
+
+		int ret = loadSnapshot(newSnapshot.data(), timestep, mask, true);
+
+		if (ret != 0)
+			return ret;
+
+		// values of an expression which was replaced meanwhile are not cached
+		if (getExpression() == currentExpression) {
+			cache->insert(newSnapshot);
+		}
+		*result = newSnapshot;
+	}
+
+	return 0;
+}
+
+/**
+	returns snapshot of timestep from cache or disk, a null pointer on errors
+*/
+SnapshotPointer FARGO::getSnapshot(unsigned int timestep, QuantityType type)
+{
+	SnapshotPointer result;
+
+	fetchSnapshot(timestep, type, &result);
+
+	return result;
+}
+
+SnapshotPointer FARGO::getCurrentSnapshot() const
+{
+	return snapshot;
+}
+
+SnapshotCache* FARGO::getSnapshotCache()
+{
+	return cache;
+}
+
+/**
+	sets the part of the grids loaded at full resolution by getSnapshot and loadTimestep
+
+	Snapshots which were loaded for another region are loaded again when they
+	are asked for.
+*/
+void FARGO::setRegionOfInterest(const Region& region)
+{
+	QMutexLocker locker(&regionMutex);
+
+	regionOfInterest = region;
+}
+
+/**
+	sets the expression of quantity EXPRESSION
+
+	Cached snapshots may hold values of the old expression, so the cache is
+	cleared, and the current timestep is loaded again if it is shown.
+*/
+void FARGO::setExpression(const ExpressionPointer& newExpression)
+{
+	expressionMutex.lock();
+	expression = newExpression;
+	expressionMutex.unlock();
+
+	cache->clear();
+
+	if (quantityType == EXPRESSION) {
+		loadTimestep(currentTimestep);
+	}
+}
+
+ExpressionPointer FARGO::getExpression() const
+{
+	QMutexLocker locker(&expressionMutex);
+
+	return expression;
+}
+
+Simulation::Region FARGO::getRegionOfInterest() const
+{
+	QMutexLocker locker(&regionMutex);
+
+	return regionOfInterest;
+}
+
+/**
+	reads planets, particles and grids of a timestep into a snapshot
+
+	Every grid file is read by its own task, while planets and particles are
+	read on the calling thread. Derived quantities are computed afterwards,
+	their grids are loaded as well. Only uses data which is constant after
+	loadFromFile, so it can be called from a loader thread while another
+	snapshot is shown.
+
+	\param snapshot snapshot to fill
+	\param timestep timestep to read
+	\param quantityMask quantities to read (bit 1 << type)
+	\param planets read planets and particles as well
+*/
+int FARGO::loadSnapshot(Snapshot* snapshot, unsigned int timestep, unsigned int quantityMask, bool planets) const
+{
+	snapshot->timestep = timestep;
+	snapshot->quantityMask = 0;
+
+	ExpressionPointer currentExpression = getExpression();
+
+	if ((quantityMask & (1u << EXPRESSION)) && currentExpression.isNull()) {
+		fprintf(stderr, "No expression set.\n");
+		return -1;
+	}
+
+	unsigned int gridMask = 0;
+	for (unsigned int type = 0; type < N_QUANTITY_TYPES; ++type) {
+		if (quantityMask & (1u << type)) {
+			gridMask |= derived::getDependencies((QuantityType)type, currentExpression.data());
+		}
+	}
+
+	QFuture<int> tasks[N_GRID_TYPES];
+	for (unsigned int type = 0; type < N_GRID_TYPES; ++type) {
+		if (gridMask & (1u << type)) {
+			tasks[type] = QtConcurrent::run(this, &FARGO::loadField, snapshot, (QuantityType)type, timestep);
+		}
+	}
+
+	int ret = planets ? loadPlanetsAndParticles(snapshot, timestep) : 0;
+
+	// always wait for all tasks, they write into snapshot
+	for (unsigned int type = 0; type < N_GRID_TYPES; ++type) {
+		if (gridMask & (1u << type)) {
+			int taskRet = tasks[type].result();
+
+			if (taskRet == 0) {
+				snapshot->quantityMask |= 1u << type;
+			} else if (ret == 0) {
+				ret = taskRet;
+			}
+		}
+	}
+
+	for (unsigned int type = N_GRID_TYPES; type < N_QUANTITY_TYPES; ++type) {
+		unsigned int dependencies = derived::getDependencies((QuantityType)type, currentExpression.data());
+
+		if ((quantityMask & (1u << type)) && ((snapshot->quantityMask & dependencies) == dependencies)) {
+			computeField(snapshot, (QuantityType)type, currentExpression.data());
+			snapshot->quantityMask |= 1u << type;
+		}
+	}
+
+	return ret;
+}
+
+/**
+	reads planet positions and particles of a timestep into a snapshot
+*/
+int FARGO::loadPlanetsAndParticles(Snapshot* snapshot, unsigned int timestep) const
+{
 	int ret = 0;
 
-	FILE *fd;
 	char *filename;
-	bool foundTimestep = false;
 
-	double* newPlanetPositions = (double*)malloc(NPlanets*3*sizeof(double));
-	double* newPlanetVelocities = (double*)malloc(NPlanets*3*sizeof(double));
+	snapshot->resizePlanets(NPlanets);
+
+	double* newPlanetPositions = snapshot->planetPositions;
+	double* newPlanetVelocities = snapshot->planetVelocities;
 
 	newPlanetPositions[0] = 0.0;
 	newPlanetPositions[1] = 0.0;
@@ -303,47 +666,18 @@ int FARGO::loadTimestep(unsigned int timestep)
 
 	newPlanetVelocities[0] = 0.0;
 	newPlanetVelocities[1] = 0.0;
-	newPlanetVelocities[1] = 0.0;
+	newPlanetVelocities[2] = 0.0;
 
 	for (unsigned int i = 1; i < NPlanets; ++i) {
-		filename = new char[strlen(outputDirectory)+1+10+(unsigned int)(log(NPlanets)/log(10)+1)];
+		ret = planetIndex->lookup(i-1, timestep, &newPlanetPositions[i*3], &newPlanetVelocities[i*3]);
 
-		if (version == FARGO_TWAM) {
-			sprintf(filename, "%s/planet%u.dat", outputDirectory, i);
-		} else {
-			sprintf(filename, "%s/planet%u.dat", outputDirectory, i-1);
-		}
+		newPlanetPositions[i*3+2] = 0.0;
+		newPlanetVelocities[i*3+2] = 0.0;
 
-		fd = fopen(filename,"r");
-		if (fd == NULL) {
-			fprintf(stderr, "Could not open '%s'.\n", filename);
-			delete [] filename;
+		if (ret == -1) {
+			fprintf(stderr, "Could not open planet file %u.\n", i);
 			return -1;
-		}
-		delete [] filename;
-		filename = NULL;
-
-		while (!feof(fd)) {
-			unsigned int timestepFile;
-			if (fscanf(fd, "%u %lf %lf %lf %lf %*f %*f %*f %*f %*f %*f %*f %*f %*f %*f",
-					&timestepFile,
-					&newPlanetPositions[i*3+0],
-					&newPlanetPositions[i*3+1],
-					&newPlanetVelocities[i*3+0],
-					&newPlanetVelocities[i*3+1]
-					)== EOF) {
-				fprintf(stderr, "File ended unexpected\n");
-				break;
-			}
-
-			if (timestepFile == timestep) {
-				foundTimestep = true;
-				break;
-			}
-		}
-		fclose(fd);
-
-		if (!foundTimestep) {
+		} else if (ret < 0) {
 			fprintf(stderr, "Timestep %u was not in file!\n", timestep);
 			return -3;
 		}
@@ -351,208 +685,730 @@ int FARGO::loadTimestep(unsigned int timestep)
 
 	// read particles
 	if (HasParticles) {
-		char *filename;
 		if (asprintf(&filename, "%s/particles%u.dat", outputDirectory, timestep)<0) {
 			fprintf(stderr, "Not enough memory!\n");
 			exit(EXIT_FAILURE);
 		}
 
-		// get filesize
+		// an empty file has no particles and cannot be mapped
 		struct stat filestatus;
-  		stat(filename, &filestatus);
-
- 		// update number of particles and array sizes
-  		NParticles = filestatus.st_size/(9*8);
-		particlePositions = (double*)realloc(particlePositions, 2*NParticles*sizeof(double));
-		particleVelocities = (double*)realloc(particleVelocities, 2*NParticles*sizeof(double));
-		particleMasses = (double*)realloc(particleMasses, NParticles*sizeof(double));
-
-		FILE *fd = fopen(filename, "r");
-
-		if (fd == NULL) {
+		if (stat(filename, &filestatus) < 0) {
 			fprintf(stderr, "Could not open '%s'.\n", filename);
+			free(filename);
 			return -1;
 		}
 
-		for (unsigned int i = 0; i < NParticles; ++i) {
-			size_t count = 0;
+		snapshot->resizeParticles(0);
 
-			fseek(fd, 8, SEEK_CUR);
-			count += fread(&particlePositions[i*2+0], sizeof(double), 1, fd);
-			count += fread(&particlePositions[i*2+1], sizeof(double), 1, fd);
-			count += fread(&particleVelocities[i*2+0], sizeof(double), 1, fd);
-			count += fread(&particleVelocities[i*2+1], sizeof(double), 1, fd);
-			count += fread(&particleMasses[i], sizeof(double), 1, fd);
-			fseek(fd, 16+8, SEEK_CUR);
+		if (filestatus.st_size > 0) {
+			MappedFile file;
 
-			if (count < 5) {
-				fprintf(stderr, "File '%s' ended to early!\n", filename);
-				exit(EXIT_FAILURE);
+			if (file.open(filename) < 0) {
+				fprintf(stderr, "Could not open '%s'.\n", filename);
+				free(filename);
+				return -1;
 			}
+
+			// the file may have changed since stat, only the mapped size is safe to read
+			snapshot->resizeParticles(file.getSize()/(9*8));
+
+			file.advise(MappedFile::SEQUENTIAL);
+			file.advise(MappedFile::WILLNEED);
+
+			deinterleaveParticles((const double*)file.getData(), snapshot->NParticles, snapshot->particlePositions, snapshot->particleVelocities, snapshot->particleMasses);
 		}
 
 		free(filename);
-		fclose(fd);
 	}
 
-	// read grid
-	switch (quantityType) {
+	return 0;
+}
+
+/**
+	reads the grid of one quantity of a timestep into a snapshot
+*/
+int FARGO::loadField(Snapshot* snapshot, QuantityType type, unsigned int timestep) const
+{
+	char *filename = getGridFilename(type, timestep);
+
+	if (filename == NULL)
+		return -1;
+
+	snapshot->resizeQuantity(type, (NRadial + 1)*NAzimuthal);
+
+	catalogMutex.lock();
+	bool map = !following;
+	catalogMutex.unlock();
+
+	// files of a running simulation are read with pread, which cannot fail with SIGBUS
+	int ret;
+	if (snapshot->region.isFull() && map) {
+		ret = loadGrid(snapshot, type, filename, (type == DENSITY) || (type == TEMPERATURE));
+	} else {
+		ret = loadGridRegion(snapshot, type, filename, (type == DENSITY) || (type == TEMPERATURE));
+	}
+
+	free(filename);
+
+	return ret;
+}
+
+/**
+	computes a derived quantity from the grids of a snapshot, which must already be loaded
+*/
+void FARGO::computeField(Snapshot* snapshot, QuantityType type, const Expression* expression) const
+{
+	Snapshot::Field& field = snapshot->fields[type];
+	snapshot->resizeQuantity(type, (NRadial + 1)*NAzimuthal);
+
+	const double* grids[N_GRID_TYPES];
+	for (unsigned int grid = 0; grid < N_GRID_TYPES; ++grid) {
+		grids[grid] = snapshot->getQuantity((QuantityType)grid);
+	}
+
+	derived::compute(type, grids, field.buffer, radii, NRadial, NAzimuthal, omegaFrame, &field.statistics, expression);
+	field.data = field.buffer;
+}
+
+/**
+	returns the name of the grid file of a quantity (to be freed by the caller)
+*/
+char* FARGO::getGridFilename(QuantityType type, unsigned int timestep) const
+{
+	int ret;
+	char *filename;
+
+	switch (type) {
 		case DENSITY:
-			filename = new char[strlen(outputDirectory)+1+12+(unsigned int)(log(timestep)/log(10)+1)];
-			sprintf(filename, "%s/gasdens%u.dat", outputDirectory, timestep);
-			ret = loadGrid(quantity, filename, true);
+			ret = asprintf(&filename, "%s/gasdens%u.dat", outputDirectory, timestep);
 			break;
 
 		case TEMPERATURE:
-			filename = new char[strlen(outputDirectory)+1+19+(unsigned int)(log(timestep)/log(10)+1)];
-			sprintf(filename, "%s/gasTemperature%u.dat", outputDirectory, timestep);
-			ret = loadGrid(quantity, filename, true);
+			ret = asprintf(&filename, "%s/gasTemperature%u.dat", outputDirectory, timestep);
 			break;
 
 		case V_RADIAL:
-			filename = new char[strlen(outputDirectory)+1+19+(unsigned int)(log(timestep)/log(10)+1)];
-			sprintf(filename, "%s/gasvrad%u.dat", outputDirectory, timestep);
-			ret = loadGrid(quantity, filename, false);
+			ret = asprintf(&filename, "%s/gasvrad%u.dat", outputDirectory, timestep);
 			break;
 
 		case V_AZIMUTHAL:
-			filename = new char[strlen(outputDirectory)+1+19+(unsigned int)(log(timestep)/log(10)+1)];
-			sprintf(filename, "%s/gasvtheta%u.dat", outputDirectory, timestep);
-			ret = loadGrid(quantity, filename, false);
+			ret = asprintf(&filename, "%s/gasvtheta%u.dat", outputDirectory, timestep);
 			break;
 
 		default:
-			break;
+			return NULL;
 	}
 
-	if (filename != NULL)
-		delete [] filename;
+	if (ret < 0) {
+		fprintf(stderr, "Not enough memory!\n");
+		exit(EXIT_FAILURE);
+	}
 
-	if (ret == 0) {
-		double* temp;
+	return filename;
+}
 
-		// copy planet positions
-		temp = planetPositions;
-		planetPositions = newPlanetPositions;
-		free(temp);
+/**
+	shows a snapshot loaded by loadSnapshot
+*/
+void FARGO::setSnapshot(const SnapshotPointer& newSnapshot)
+{
+	snapshot = newSnapshot;
+	currentTimestep = snapshot->timestep;
 
-		temp = planetVelocities;
-		planetVelocities = newPlanetVelocities;
-		free(temp);
+	emit dataUpdated();
+}
+
+/**
+	reads a two-dimensional FARGO polargrid
+
+	The file is memory mapped. Vector grids of FARGO_TWAM already have one value
+	per vertex and are exposed directly from the mapping without any copy, scalar
+	grids are interpolated from the mapping into quantity. Not used while
+	following a running simulation, which may rewrite the file.
+
+	\param snapshot snapshot to read grid into
+	\param type quantity of the grid
+	\param filename filename to read
+	\param scalar is this a scalar or vector grid
+*/
+int FARGO::loadGrid(Snapshot* snapshot, QuantityType type, const char* filename, bool scalar) const
+{
+	Snapshot::Field& field = snapshot->fields[type];
+	double* quantity = field.buffer;
+
+	MappedFile file;
+	if (file.open(filename) < 0) {
+		fprintf(stderr, "Could not open '%s'!\n", filename);
+		return -1;
+	}
 
-		currentTimestep = timestep;
+	size_t offset, count;
+	getGridLayout(scalar, &offset, &count);
 
-		emit dataUpdated();
+	if (file.getSize() < offset + count*sizeof(double)) {
+		fprintf(stderr, "Error while reading '%s' (%lu bytes).\n", filename, count*sizeof(double));
+		return -1;
 	}
 
-	return ret;
+	file.advise(MappedFile::SEQUENTIAL, offset, count*sizeof(double));
+	file.advise(MappedFile::WILLNEED, offset, count*sizeof(double));
+
+	const double* buffer = (const double*)((const char*)file.getData() + offset);
+	size_t copied = 0;
+
+	if (scalar) {
+		interpolateGrid(buffer, quantity, &field.statistics);
+		field.data = quantity;
+	} else if (version == FARGO_TWAM) {
+		field.data = buffer;
+		field.statistics.reset();
+		field.statistics.add(buffer, count);
+	} else {
+		memcpy(quantity, buffer, count*sizeof(double));
+		copied = count*sizeof(double);
+		field.data = quantity;
+		field.statistics.reset();
+		field.statistics.add(quantity, count);
+	}
+
+	// keep the mapping alive as long as data may point into it
+	field.file.swap(file);
+
+	statisticsMutex.lock();
+	bytesRead += count*sizeof(double);
+	bytesCopied += copied;
+	statisticsMutex.unlock();
+
+	return 0;
 }
 
 /**
-	reads a two-dimensional FARGO polargrid
+	reads size bytes at offset, continuing after short reads
+*/
+static int readFully(int fd, void* buffer, size_t size, off_t offset)
+{
+	char* position = (char*)buffer;
 
-	\param dest destination
-	\param filename filename to read
-	\param scalar is this a scalar or vector grid
+	while (size > 0) {
+		ssize_t count = pread(fd, position, size, offset);
+
+		if (count <= 0)
+			return -1;
+
+		position += count;
+		size -= count;
+		offset += count;
+	}
+
+	return 0;
+}
+
+/**
+	reads a grid at full resolution only inside the region of the snapshot
+
+	Rows of cells are contiguous in the file, so the band of rows of the region
+	(one more on every side for the interpolation) is read with pread, only
+	the window of columns of every row if the region does not span the whole
+	ring. Of the other rows only every region.stride-th (and the outermost)
+	is read and copied to the rows up to the next one.
 */
-int FARGO::loadGrid(double* dest, const char* filename, bool scalar)
+int FARGO::loadGridRegion(Snapshot* snapshot, QuantityType type, const char* filename, bool scalar) const
 {
-	FILE *fd = fopen(filename, "rb");
-	if (fd == NULL) {
+	Snapshot::Field& field = snapshot->fields[type];
+	const Region& region = snapshot->region;
+
+	size_t offset, count;
+	getGridLayout(scalar, &offset, &count);
+	const unsigned int cellRows = count/NAzimuthal;
+	const size_t rowSize = NAzimuthal*sizeof(double);
+
+	int fd = ::open(filename, O_RDONLY);
+	if (fd < 0) {
 		fprintf(stderr, "Could not open '%s'!\n", filename);
 		return -1;
 	}
 
-	double* buffer = new double[(scalar ? NRadial : NRadial + 1)*NAzimuthal];
+	struct stat buf;
+	if ((fstat(fd, &buf) < 0) || ((size_t)buf.st_size < offset + count*sizeof(double))) {
+		fprintf(stderr, "Error while reading '%s' (%lu bytes).\n", filename, count*sizeof(double));
+		::close(fd);
+		return -1;
+	}
 
-	// if we don't want to read ghost cells, skip the first NAzimuthal datapoints in file
-	if (!readGhostCells) {
-		if (fread(buffer, sizeof(double), NAzimuthal, fd)<NAzimuthal) {
-			fprintf(stderr, "Error while reading '%s' (%lu bytes).\n", filename,NAzimuthal*sizeof(double));
-			goto loadGrid_cleanUp;
+	// scalar grids are interpolated afterwards, vector grids are read in place
+	double* cells = scalar ? (double*)malloc(count*sizeof(double)) : field.buffer;
+
+	unsigned int firstRow = region.firstRow > 0 ? region.firstRow - 1 : 0;
+	unsigned int lastRow = region.firstRow + region.rows < cellRows ? region.firstRow + region.rows : cellRows - 1;
+	bool wholeRows = region.columns + 2 >= NAzimuthal;
+
+	size_t bytes = 0;
+	int ret = 0;
+
+	// whole rows: the band (if it spans the ring) and every stride-th row
+	for (unsigned int row = 0; (row < cellRows) && (ret == 0); ++row) {
+		bool inBand = (row >= firstRow) && (row <= lastRow);
+		bool coarse = (row % region.stride == 0) || (row == cellRows - 1);
+
+		if ((wholeRows && inBand) || coarse) {
+			ret = readFully(fd, &cells[(size_t)row*NAzimuthal], rowSize, offset + row*rowSize);
+			bytes += rowSize;
 		}
 	}
 
-	if (scalar) {
-		if (fread(buffer, sizeof(double), NRadial*NAzimuthal, fd)<NRadial*NAzimuthal) {
-			fprintf(stderr, "Error while reading '%s' (%lu bytes).\n", filename,NRadial*NAzimuthal*sizeof(double));
-			goto loadGrid_cleanUp;
+	// other rows are copies of the coarse row below
+	for (unsigned int row = 0; (row < cellRows) && (ret == 0); ++row) {
+		bool inBand = (row >= firstRow) && (row <= lastRow);
+		bool coarse = (row % region.stride == 0) || (row == cellRows - 1);
+
+		if (!(wholeRows && inBand) && !coarse) {
+			memcpy(&cells[(size_t)row*NAzimuthal], &cells[(size_t)(row - row % region.stride)*NAzimuthal], rowSize);
 		}
+	}
+
+	// window of columns in the band, it may wrap around
+	if (!wholeRows) {
+		unsigned int firstColumn = (region.firstColumn + NAzimuthal - 1) % NAzimuthal;
+		unsigned int columns = region.columns + 2;
+		unsigned int part = columns < NAzimuthal - firstColumn ? columns : NAzimuthal - firstColumn;
+
+		for (unsigned int row = firstRow; (row <= lastRow) && (ret == 0); ++row) {
+			double* rowCells = &cells[(size_t)row*NAzimuthal];
+			off_t rowOffset = offset + row*rowSize;
+
+			ret = readFully(fd, &rowCells[firstColumn], part*sizeof(double), rowOffset + firstColumn*sizeof(double));
 
-		// interpolate
-		for (unsigned int nRadial = 0; nRadial <= NRadial; ++nRadial) {
-			for (unsigned int nAzimuthal = 0; nAzimuthal < NAzimuthal; ++nAzimuthal) {
-				unsigned int index = nRadial*NAzimuthal + nAzimuthal;
-
-				if (nRadial == 0) {
-					dest[index] = 0.5*(buffer[index]+buffer[nAzimuthal == 0 ? index + NAzimuthal -1: index-1]);
-				} else if (nRadial == NRadial) {
-					dest[index] = 0.5*(buffer[index-NAzimuthal]+buffer[nAzimuthal == 0 ? index-NAzimuthal+NAzimuthal-1 : index-NAzimuthal-1]);
-				} else {
-					dest[index] = 0.25*(buffer[index]+buffer[nAzimuthal == 0 ? index + NAzimuthal -1: index-1]+buffer[index-NAzimuthal]+buffer[nAzimuthal == 0 ? index-NAzimuthal+NAzimuthal-1 : index-NAzimuthal-1]);
-				}
+			if ((ret == 0) && (part < columns)) {
+				ret = readFully(fd, rowCells, (columns - part)*sizeof(double), rowOffset);
 			}
+
+			bytes += columns*sizeof(double);
 		}
+	}
+
+	::close(fd);
+
+	if (ret < 0) {
+		fprintf(stderr, "Error while reading '%s'.\n", filename);
+		if (scalar)
+			free(cells);
+		return -1;
+	}
+
+	if (scalar) {
+		interpolateGrid(cells, field.buffer, &field.statistics);
+		free(cells);
+	} else {
+		field.statistics.reset();
+		field.statistics.add(field.buffer, count);
+	}
+
+	field.data = field.buffer;
+	field.file.close();
+
+	statisticsMutex.lock();
+	bytesRead += bytes;
+	statisticsMutex.unlock();
+
+	return 0;
+}
+
+/**
+	returns where the values of a grid start in its file and how many there are
+
+	\param scalar is this a scalar or vector grid
+	\param offset offset of the first value in bytes
+	\param count number of values
+*/
+void FARGO::getGridLayout(bool scalar, size_t* offset, size_t* count) const
+{
+	// if we don't want to read ghost cells, skip the first NAzimuthal datapoints in file
+	*offset = readGhostCells ? 0 : NAzimuthal*sizeof(double);
+
+	if (scalar) {
+		*count = NRadial*NAzimuthal;
+	} else if (version == FARGO_TWAM) {
+		*count = (NRadial+1)*NAzimuthal;
 	} else {
-		switch (version) {
-			case FARGO_TWAM:
-				if (fread(dest, sizeof(double), (NRadial+1)*NAzimuthal, fd)<(NRadial+1)*NAzimuthal) {
-					fprintf(stderr, "Error while reading '%s' (%lu bytes).\n", filename,(NRadial+1)*NAzimuthal*sizeof(double));
-					goto loadGrid_cleanUp;
-				}
-				break;
-
-			default:
-				if (fread(dest, sizeof(double), (NRadial)*NAzimuthal, fd)<(NRadial)*NAzimuthal) {
-					fprintf(stderr, "Error while reading '%s' (%lu bytes).\n", filename,(NRadial)*NAzimuthal*sizeof(double));
-					goto loadGrid_cleanUp;
-				}
-				break;
+		*count = NRadial*NAzimuthal;
+	}
+}
+
+/**
+	interpolates a scalar grid from cell centers to vertices
+
+	\param cells NRadial*NAzimuthal cell values
+	\param vertices (NRadial+1)*NAzimuthal vertex values
+	\param statistics statistics of the vertices, computed on the fly
+*/
+void FARGO::interpolateGrid(const double* cells, double* vertices, FieldStatistics* statistics) const
+{
+	interpolation::interpolate(cells, vertices, NRadial, NAzimuthal, statistics);
+}
+
+/**
+	writes all timesteps into a single pack file
+
+	\param filename pack to create
+	\param compressionLevel zlib level for chunks (0 for no compression)
+*/
+int FARGO::writePack(const char* filename, int compressionLevel)
+{
+	Pack pack;
+
+	pack.NRadial = NRadial;
+	pack.NAzimuthal = NAzimuthal;
+	pack.NTimesteps = totalTimestep + 1;
+	pack.rMin = rMin;
+	pack.rMax = rMax;
+	pack.omegaFrame = omegaFrame;
+	pack.twamLayout = (version == FARGO_TWAM);
+	pack.radii.assign(radii, radii + NRadial + 1);
+	pack.planetMasses.assign(planetMasses, planetMasses + NPlanets);
+	pack.planetRadii.assign(planetRadii, planetRadii + NPlanets);
+
+	if (pack.create(filename) < 0)
+		return -1;
+
+	Snapshot* temp = new Snapshot;
+	double* planets = (double*)malloc(NPlanets*6*sizeof(double));
+	double* particles = NULL;
+	int ret = 0;
+
+	for (unsigned int timestep = 0; (timestep <= totalTimestep) && (ret == 0); ++timestep) {
+		fprintf(stderr, "\rPacking timestep %u/%u", timestep, totalTimestep);
+
+		for (unsigned int type = 0; (type < N_GRID_TYPES) && (ret == 0); ++type) {
+			if (!catalog->hasTimestep(type, timestep))
+				continue;
+
+			char *gridFilename = getGridFilename((QuantityType)type, timestep);
+			bool scalar = (type == DENSITY) || (type == TEMPERATURE);
+			size_t offset, count;
+			getGridLayout(scalar, &offset, &count);
+
+			MappedFile file;
+			if ((file.open(gridFilename) < 0) || (file.getSize() < offset + count*sizeof(double))) {
+				fprintf(stderr, "\nSkipping '%s'.\n", gridFilename);
+			} else {
+				file.advise(MappedFile::SEQUENTIAL);
+				ret = pack.writeChunk(timestep, type, (const char*)file.getData() + offset, count*sizeof(double), compressionLevel);
+			}
+
+			free(gridFilename);
 		}
 
+		if ((ret != 0) || (loadPlanetsAndParticles(temp, timestep) != 0))
+			continue;
+
+		memcpy(planets, temp->planetPositions, NPlanets*3*sizeof(double));
+		memcpy(planets + NPlanets*3, temp->planetVelocities, NPlanets*3*sizeof(double));
+		ret = pack.writeChunk(timestep, Pack::PLANETS, planets, NPlanets*6*sizeof(double), compressionLevel);
+
+		if ((ret == 0) && HasParticles) {
+			unsigned int n = temp->NParticles;
+			particles = (double*)realloc(particles, (n*5+1)*sizeof(double));
+			memcpy(particles, temp->particlePositions, n*2*sizeof(double));
+			memcpy(particles + n*2, temp->particleVelocities, n*2*sizeof(double));
+			memcpy(particles + n*4, temp->particleMasses, n*sizeof(double));
+			ret = pack.writeChunk(timestep, Pack::PARTICLES, particles, n*5*sizeof(double), compressionLevel);
+		}
 	}
 
-loadGrid_cleanUp:
-	delete [] buffer;
-	fclose(fd);
+	fprintf(stderr, "\n");
 
-	return 0;
+	free(planets);
+	free(particles);
+	delete temp;
+
+	if (ret == 0) {
+		ret = pack.finish();
+	}
+
+	return ret;
 }
 
 void FARGO::setQuantityType(QuantityType type) {
 	if (quantityType != type) {
 		quantityType = type;
-		loadTimestep(currentTimestep);
+
+		// preloaded quantities are just shown, otherwise read from disk
+		if (!snapshot.isNull() && snapshot->hasQuantity(type)) {
+			emit dataUpdated();
+		} else {
+			loadTimestep(currentTimestep);
+		}
 	}
 }
 
+Simulation::QuantityType FARGO::getQuantityType() const
+{
+	return quantityType;
+}
 
-double FARGO::getMinimumValue(void) const {
-	double minimum = DBL_MAX;
+/**
+	sets the quantities which are loaded together with the current quantity, so
+	switching between them does not touch the disk
+*/
+void FARGO::setPreloadedQuantities(unsigned int mask)
+{
+	preloadedQuantities = mask;
+}
 
-	if (quantity != NULL) {
-		for (unsigned int i = 0; i < (NRadial + 1)*NAzimuthal; ++i) {
-			if (quantity[i] < minimum) {
-				minimum = quantity[i];
-			}
+unsigned int FARGO::getPreloadedQuantities() const
+{
+	return preloadedQuantities;
+}
+
+/**
+	watches the output directory for new timesteps of a running simulation
+*/
+void FARGO::setFollow(bool value)
+{
+	if (!value) {
+		delete watcher;
+		watcher = NULL;
+
+		catalogMutex.lock();
+		following = false;
+		catalogMutex.unlock();
+		return;
+	}
+
+	if ((watcher != NULL) || (outputDirectory == NULL))
+		return;
+
+	watcher = new DirectoryWatcher;
+	connect(watcher, SIGNAL(fileWritten(const QString&)), this, SLOT(fileWritten(const QString&)));
+
+	if (watcher->watch(outputDirectory) < 0) {
+		delete watcher;
+		watcher = NULL;
+		return;
+	}
+
+	catalogMutex.lock();
+	following = true;
+	catalogMutex.unlock();
+
+	// accessing a mapping of a file which is truncated and rewritten raises SIGBUS,
+	// so cached snapshots must not point into mapped grid files any more
+	cache->clear();
+
+	for (unsigned int type = 0; !snapshot.isNull() && (type < N_QUANTITY_TYPES); ++type) {
+		if (snapshot->fields[type].file.isOpen()) {
+			loadTimestep(currentTimestep);
+			break;
 		}
 	}
+}
 
-	return minimum;
+bool FARGO::getFollow() const
+{
+	return watcher != NULL;
 }
 
-double FARGO::getMaximumValue(void) const {
-	double maximum = -DBL_MAX;
+/**
+	checks if a timestep file has been written completely
+*/
+bool FARGO::isFileComplete(unsigned int kind, unsigned int timestep) const
+{
+	char *filename;
 
-	if (quantity != NULL) {
-		for (unsigned int i = 0; i < (NRadial + 1)*NAzimuthal; ++i) {
-			if (quantity[i] > maximum) {
-				maximum = quantity[i];
-			}
+	if (kind == Catalog::PARTICLES) {
+		if (asprintf(&filename, "%s/particles%u.dat", outputDirectory, timestep)<0) {
+			fprintf(stderr, "Not enough memory!\n");
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		filename = getGridFilename((QuantityType)kind, timestep);
+	}
+
+	struct stat filestatus;
+	int ret = stat(filename, &filestatus);
+	free(filename);
+
+	if (ret < 0)
+		return false;
+
+	size_t size = filestatus.st_size;
+
+	if (kind == Catalog::PARTICLES) {
+		return (size > 0) && (size % (9*8) == 0) && (size >= NParticles*9*8);
+	}
+
+	size_t offset, count;
+	getGridLayout((kind == DENSITY) || (kind == TEMPERATURE), &offset, &count);
+
+	return size >= offset + count*sizeof(double);
+}
+
+/**
+	adds timesteps and planet positions written by a running simulation
+*/
+void FARGO::fileWritten(const QString& name)
+{
+	QByteArray ascii = name.toAscii();
+	unsigned int kind, timestep, number;
+	int length = 0;
+
+	if (Catalog::parseFilename(ascii.constData(), &kind, &timestep) == 0) {
+		// grids are written in several chunks, wait for the last one
+		if (!isFileComplete(kind, timestep))
+			return;
+
+		// file may have been rewritten
+		cache->remove(timestep);
+		emit timestepWritten(timestep);
+
+		catalogMutex.lock();
+		catalog->addTimestep(kind, timestep);
+		catalogMutex.unlock();
+
+		if ((timestep > totalTimestep) && hasTimestep(timestep)) {
+			catalogMutex.lock();
+			totalTimestep = timestep;
+			catalog->totalTimestep = timestep;
+			catalogMutex.unlock();
+
+			if (planetIndex != NULL)
+				planetIndex->setMaximumTimestep(timestep);
+
+			emit timestepsAdded();
 		}
+	} else if ((sscanf(ascii.constData(), "planet%u.dat%n", &number, &length) == 1) && (length > 0) && (ascii.constData()[length] == 0) && (planetIndex != NULL)) {
+		// planet files are numbered from 1 in FARGO_TWAM and from 0 otherwise
+		unsigned int table = version == FARGO_TWAM ? number - 1 : number;
+
+		if ((number > 0 || version != FARGO_TWAM) && (table < planetIndex->getNumberOfFiles())) {
+			planetIndex->update(table);
+		}
+	}
+}
+
+/**
+	checks if all files of a timestep exist for the current quantity
+*/
+bool FARGO::hasTimestep(unsigned int timestep) const
+{
+	if (catalog == NULL)
+		return true;
+
+	QMutexLocker locker(&catalogMutex);
+
+	ExpressionPointer currentExpression = getExpression();
+
+	if (!hasGridFiles(derived::getDependencies(quantityType, currentExpression.data()), timestep, false))
+		return false;
+
+	if (HasParticles && catalog->hasTimesteps(Catalog::PARTICLES) && !catalog->hasTimestep(Catalog::PARTICLES, timestep))
+		return false;
+
+	return true;
+}
+
+unsigned int FARGO::getQuantitiesOfTimestep(unsigned int timestep) const
+{
+	unsigned int mask = 0;
+	ExpressionPointer currentExpression = getExpression();
+
+	QMutexLocker locker(&catalogMutex);
+
+	for (unsigned int type = 0; type < N_QUANTITY_TYPES; ++type) {
+		if ((type == EXPRESSION) && currentExpression.isNull())
+			continue;
+
+		if (hasGridFiles(derived::getDependencies((QuantityType)type, currentExpression.data()), timestep, false))
+			mask |= 1u << type;
+	}
+
+	return mask;
+}
+
+/**
+	checks if the grid files (bit 1 << type) of a timestep were written, catalogMutex must be locked
+
+	\param strict if false, quantities without any timestep in the catalog (e.g.
+	unreadable directory) and a missing catalog count as written, so they are
+	just tried to be loaded
+*/
+bool FARGO::hasGridFiles(unsigned int grids, unsigned int timestep, bool strict) const
+{
+	if (catalog == NULL)
+		return !strict;
+
+	for (unsigned int type = 0; type < N_GRID_TYPES; ++type) {
+		if (!(grids & (1u << type)))
+			continue;
+
+		if (!strict && !catalog->hasTimesteps(type))
+			continue;
+
+		if (!catalog->hasTimestep(type, timestep))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+	finds the next existing timestep, skipping gaps in the output
+
+	\param timestep timestep to start from
+	\param stride minimum distance to timestep (negative to search backwards)
+	\returns next existing timestep or -1 if there is none
+*/
+int FARGO::getNextTimestep(unsigned int timestep, int stride) const
+{
+	long long next = (long long)timestep + stride;
+	int step = stride < 0 ? -1 : 1;
+
+	// grows on the GUI thread while following, this may run on the prefetcher
+	catalogMutex.lock();
+	unsigned int last = totalTimestep;
+	catalogMutex.unlock();
+
+	while ((next >= 0) && (next <= last)) {
+		if (hasTimestep(next))
+			return next;
+
+		next += step;
 	}
 
-	return maximum;
+	return -1;
+}
+
+
+double FARGO::getMinimumValue(void) const {
+	const FieldStatistics* statistics = getStatistics();
+
+	return statistics != NULL ? statistics->minimum : DBL_MAX;
+}
+
+double FARGO::getMaximumValue(void) const {
+	const FieldStatistics* statistics = getStatistics();
+
+	return statistics != NULL ? statistics->maximum : -DBL_MAX;
+}
+
+/**
+	the statistics index is kept in the output directory
+*/
+unsigned long long FARGO::getStamp() const
+{
+	return catalog != NULL ? catalog->getStamp() : 0;
+}
+
+char* FARGO::getStatisticsFilename(bool cacheDirectory) const
+{
+	return Catalog::getSidecarFilename(outputDirectory, "stats", cacheDirectory);
+}
+
+const FieldStatistics* FARGO::getStatistics() const {
+	if (snapshot.isNull() || !snapshot->hasQuantity(quantityType))
+		return NULL;
+
+	return &snapshot->fields[quantityType].statistics;
 }
 
 unsigned int FARGO::getNumberOfPlanets() const
@@ -562,12 +1418,12 @@ unsigned int FARGO::getNumberOfPlanets() const
 
 const double* FARGO::getPlanetPosition(unsigned int number) const
 {
-	return &planetPositions[number*3];
+	return &snapshot->planetPositions[number*3];
 }
 
 const double* FARGO::getPlanetVelocity(unsigned int number) const
 {
-	return &planetVelocities[number*3];
+	return &snapshot->planetVelocities[number*3];
 }
 
 const double* FARGO::getPlanetMass(unsigned int number) const
@@ -587,6 +1443,8 @@ unsigned int FARGO::getCurrentTimestep() const
 
 unsigned int FARGO::getLastTimeStep() const
 {
+	QMutexLocker locker(&catalogMutex);
+
 	return totalTimestep;
 }
 
@@ -611,23 +1469,35 @@ const double* FARGO::getRadii() const {
 }
 
 const double* FARGO::getQuantity() const {
-	return quantity;
+	return snapshot.isNull() ? NULL : snapshot->getQuantity(quantityType);
+}
+
+unsigned long long FARGO::getBytesRead() const {
+	return bytesRead;
+}
+
+unsigned long long FARGO::getBytesCopied() const {
+	return bytesCopied;
 }
 
 unsigned int FARGO::getNumberOfParticles() const {
-	return NParticles;
+	return snapshot.isNull() ? 0 : snapshot->NParticles;
+}
+
+const double* FARGO::getParticlePositions() const {
+	return snapshot->particlePositions;
 }
 
 const double* FARGO::getParticlePosition(unsigned int number) const {
-	return &particlePositions[number*2];
+	return &snapshot->particlePositions[number*2];
 }
 
 const double* FARGO::getParticleVelocity(unsigned int number) const {
-	return &particleVelocities[number*2];
+	return &snapshot->particleVelocities[number*2];
 }
 
 const double* FARGO::getParticleMass(unsigned int number) const {
-	return &particleMasses[number];
+	return &snapshot->particleMasses[number];
 }
 
 bool FARGO::getHasParticles() const {
@@ -2,6 +2,14 @@
 #define _FARGO_H_
 
 #include "Simulation.h"
+#include <QMutex>
+#include <QString>
+#include <stddef.h>
+
+class PlanetIndex;
+class Catalog;
+class DirectoryWatcher;
+class FieldStatistics;
 
 class FARGO : public Simulation
 {
@@ -17,6 +25,7 @@ class FARGO : public Simulation
 		FARGO();
 		~FARGO();
 		int loadFromFile(const char* filename);
+		int writePack(const char* filename, int compressionLevel);
 
 		// planet stuff
 		unsigned int getNumberOfPlanets() const;
@@ -27,6 +36,7 @@ class FARGO : public Simulation
 
 		// particle stuff
 		unsigned int getNumberOfParticles() const;
+		const double* getParticlePositions() const;
 		const double* getParticlePosition(unsigned int number) const;
 		const double* getParticleVelocity(unsigned int number) const;
 		const double* getParticleMass(unsigned int number) const;
@@ -35,6 +45,9 @@ class FARGO : public Simulation
 		int loadTimestep(unsigned int timestep);
 		unsigned int getCurrentTimestep() const;
 		unsigned int getLastTimeStep() const;
+		bool hasTimestep(unsigned int timestep) const;
+		unsigned int getQuantitiesOfTimestep(unsigned int timestep) const;
+		int getNextTimestep(unsigned int timestep, int stride) const;
 		unsigned int getNRadial() const;
 		unsigned int getNAzimuthal() const;
 		double getRMin() const;
@@ -42,14 +55,37 @@ class FARGO : public Simulation
 		const double* getRadii() const;
 		const double* getQuantity() const;
 		void setQuantityType(Simulation::QuantityType type);
+		Simulation::QuantityType getQuantityType() const;
+		void setPreloadedQuantities(unsigned int mask);
+		unsigned int getPreloadedQuantities() const;
+		void setFollow(bool value);
+		bool getFollow() const;
+
+		int loadSnapshot(Snapshot* snapshot, unsigned int timestep, unsigned int quantityMask, bool planets) const;
+		SnapshotPointer getSnapshot(unsigned int timestep, Simulation::QuantityType type);
+		void setSnapshot(const SnapshotPointer& snapshot);
+		SnapshotPointer getCurrentSnapshot() const;
+		SnapshotCache* getSnapshotCache();
+		void setRegionOfInterest(const Simulation::Region& region);
+		Simulation::Region getRegionOfInterest() const;
+		void setExpression(const ExpressionPointer& expression);
+		ExpressionPointer getExpression() const;
 
 		double getMinimumValue(void) const;
 		double getMaximumValue(void) const;
+		const FieldStatistics* getStatistics() const;
+		unsigned long long getStamp() const;
+		char* getStatisticsFilename(bool cacheDirectory) const;
+
+		// I/O statistics
+		unsigned long long getBytesRead() const;
+		unsigned long long getBytesCopied() const;
 
-	private:
+	protected:
 		Version version;
 
 		QuantityType quantityType;
+		unsigned int preloadedQuantities;
 		bool readGhostCells;
 		char *configFilename;
 		char *planetConfigFilename;
@@ -60,26 +96,63 @@ class FARGO : public Simulation
 		unsigned int currentTimestep;
 		double rMin;
 		double rMax;
+		// angular velocity of the frame v_phi is written in
+		double omegaFrame;
 
 		// planests
 		unsigned int NPlanets;
-		double* planetPositions;
-		double* planetVelocities;
 		double* planetMasses;
 		double* planetRadii;
+		PlanetIndex* planetIndex;
 
 		// particles
 		bool HasParticles;
 		unsigned int NParticles;
-		double *particlePositions;
-		double *particleVelocities;
-		double *particleMasses;
-
 
 		double* radii;
-		double* quantity;
 
-		int loadGrid(double* dest, const char* filename, bool scalar);
+		Catalog* catalog;
+		/// protects catalog, totalTimestep and following while following a running simulation
+		mutable QMutex catalogMutex;
+		int loadOutputDirectory();
+
+		DirectoryWatcher* watcher;
+		/// grid files may be rewritten, so they are read instead of mapped
+		bool following;
+		bool isFileComplete(unsigned int kind, unsigned int timestep) const;
+		bool hasGridFiles(unsigned int grids, unsigned int timestep, bool strict) const;
+
+		// currently shown timestep
+		SnapshotPointer snapshot;
+		SnapshotCache* cache;
+		int fetchSnapshot(unsigned int timestep, Simulation::QuantityType type, SnapshotPointer* result);
+
+		/// region new snapshots are loaded with
+		Simulation::Region regionOfInterest;
+		mutable QMutex regionMutex;
+
+		/// expression of quantity EXPRESSION, replaced as a whole
+		ExpressionPointer expression;
+		mutable QMutex expressionMutex;
+		void createInitialSnapshot();
+
+		mutable QMutex statisticsMutex;
+		mutable unsigned long long bytesRead;
+		mutable unsigned long long bytesCopied;
+
+		// loading of one timestep, overwritten by readers of other formats
+		virtual int loadPlanetsAndParticles(Snapshot* snapshot, unsigned int timestep) const;
+		virtual int loadField(Snapshot* snapshot, Simulation::QuantityType type, unsigned int timestep) const;
+
+		char* getGridFilename(Simulation::QuantityType type, unsigned int timestep) const;
+		void getGridLayout(bool scalar, size_t* offset, size_t* count) const;
+		int loadGrid(Snapshot* snapshot, Simulation::QuantityType type, const char* filename, bool scalar) const;
+		int loadGridRegion(Snapshot* snapshot, Simulation::QuantityType type, const char* filename, bool scalar) const;
+		void interpolateGrid(const double* cells, double* vertices, FieldStatistics* statistics) const;
+		void computeField(Snapshot* snapshot, Simulation::QuantityType type, const Expression* expression) const;
+
+	private slots:
+		void fileWritten(const QString& name);
 
 	signals:
 		void dataUpdated();
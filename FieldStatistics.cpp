@@ -0,0 +1,128 @@
+#include "FieldStatistics.h"
+#include <float.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+FieldStatistics::FieldStatistics()
+{
+	reset();
+}
+
+void FieldStatistics::reset()
+{
+	minimum = DBL_MAX;
+	maximum = -DBL_MAX;
+	sum = 0.0;
+	positiveMinimum = DBL_MAX;
+	positiveMaximum = 0.0;
+	count = 0;
+	positiveCount = 0;
+	nanCount = 0;
+	infCount = 0;
+}
+
+void FieldStatistics::addValue(double value)
+{
+	if (isnan(value)) {
+		nanCount++;
+		return;
+	}
+
+	if (isinf(value)) {
+		infCount++;
+		return;
+	}
+
+	if (value < minimum)
+		minimum = value;
+	if (value > maximum)
+		maximum = value;
+	sum += value;
+	count++;
+
+	if (value > 0.0) {
+		if (value < positiveMinimum)
+			positiveMinimum = value;
+		if (value > positiveMaximum)
+			positiveMaximum = value;
+		positiveCount++;
+	}
+}
+
+/**
+	adds values, meant to be called on data which was just written and is still in cache
+*/
+void FieldStatistics::add(const double* values, size_t count)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	if (count >= 2) {
+		const __m128d zero = _mm_setzero_pd();
+		const __m128d largest = _mm_set1_pd(DBL_MAX);
+		__m128d vectorMinimum = largest;
+		__m128d vectorMaximum = _mm_set1_pd(-DBL_MAX);
+		__m128d vectorSum = zero;
+		__m128d vectorPositiveMinimum = largest;
+		__m128d vectorPositiveMaximum = zero;
+		unsigned long long finiteCount = 0;
+		unsigned long long vectorPositiveCount = 0;
+
+		for (; i + 2 <= count; i += 2) {
+			__m128d value = _mm_loadu_pd(&values[i]);
+
+			// value - value is 0 for finite values and NaN otherwise
+			if (_mm_movemask_pd(_mm_cmpeq_pd(_mm_sub_pd(value, value), zero)) != 3) {
+				addValue(values[i]);
+				addValue(values[i+1]);
+				continue;
+			}
+
+			vectorMinimum = _mm_min_pd(vectorMinimum, value);
+			vectorMaximum = _mm_max_pd(vectorMaximum, value);
+			vectorSum = _mm_add_pd(vectorSum, value);
+			finiteCount += 2;
+
+			__m128d positive = _mm_cmpgt_pd(value, zero);
+			vectorPositiveMinimum = _mm_min_pd(vectorPositiveMinimum, _mm_or_pd(_mm_and_pd(positive, value), _mm_andnot_pd(positive, largest)));
+			vectorPositiveMaximum = _mm_max_pd(vectorPositiveMaximum, _mm_and_pd(positive, value));
+			vectorPositiveCount += __builtin_popcount(_mm_movemask_pd(positive));
+		}
+
+		double lanes[2];
+
+		_mm_storeu_pd(lanes, vectorMinimum);
+		minimum = fmin(minimum, fmin(lanes[0], lanes[1]));
+		_mm_storeu_pd(lanes, vectorMaximum);
+		maximum = fmax(maximum, fmax(lanes[0], lanes[1]));
+		_mm_storeu_pd(lanes, vectorSum);
+		sum += lanes[0] + lanes[1];
+		_mm_storeu_pd(lanes, vectorPositiveMinimum);
+		positiveMinimum = fmin(positiveMinimum, fmin(lanes[0], lanes[1]));
+		_mm_storeu_pd(lanes, vectorPositiveMaximum);
+		positiveMaximum = fmax(positiveMaximum, fmax(lanes[0], lanes[1]));
+
+		this->count += finiteCount;
+		positiveCount += vectorPositiveCount;
+	}
+#endif
+
+	for (; i < count; ++i) {
+		addValue(values[i]);
+	}
+}
+
+void FieldStatistics::merge(const FieldStatistics& other)
+{
+	minimum = fmin(minimum, other.minimum);
+	maximum = fmax(maximum, other.maximum);
+	sum += other.sum;
+	positiveMinimum = fmin(positiveMinimum, other.positiveMinimum);
+	positiveMaximum = fmax(positiveMaximum, other.positiveMaximum);
+	count += other.count;
+	positiveCount += other.positiveCount;
+	nanCount += other.nanCount;
+	infCount += other.infCount;
+}
@@ -0,0 +1,37 @@
+#ifndef _FIELDSTATISTICS_H_
+#define _FIELDSTATISTICS_H_
+
+#include <stddef.h>
+
+/**
+	summary of the values of one grid, accumulated while it is decoded
+
+	Minimum, maximum and mean only include finite values, the positive
+	minimum and maximum are the limits for a logarithmic scale.
+*/
+class FieldStatistics
+{
+	public:
+		FieldStatistics();
+
+		void reset();
+		void add(const double* values, size_t count);
+		void merge(const FieldStatistics& other);
+
+		inline double getMean() const { return count > 0 ? sum/count : 0.0; }
+
+		double minimum;
+		double maximum;
+		double sum;
+		double positiveMinimum;
+		double positiveMaximum;
+		unsigned long long count;
+		unsigned long long positiveCount;
+		unsigned long long nanCount;
+		unsigned long long infCount;
+
+	private:
+		inline void addValue(double value);
+};
+
+#endif
@@ -0,0 +1,182 @@
+#include "GridPyramid.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+GridPyramid::GridPyramid()
+{
+	NLevels = 0;
+	grid = NULL;
+	reduction = MEAN;
+
+	for (unsigned int level = 0; level < maximumLevels; ++level) {
+		rows[level] = 0;
+		columns[level] = 0;
+		values[level] = NULL;
+		valid[level] = false;
+	}
+}
+
+GridPyramid::~GridPyramid()
+{
+	for (unsigned int level = 1; level < maximumLevels; ++level) {
+		free(values[level]);
+	}
+}
+
+/**
+	sets the size of the grid (NRadial+1 rows of NAzimuthal vertices) and computes the number of levels
+*/
+void GridPyramid::setSize(unsigned int NRadial, unsigned int NAzimuthal)
+{
+	for (unsigned int level = 1; level < maximumLevels; ++level) {
+		free(values[level]);
+		values[level] = NULL;
+	}
+
+	rows[0] = NRadial + 1;
+	columns[0] = NAzimuthal;
+	NLevels = 1;
+
+	while ((NLevels < maximumLevels) && (rows[NLevels-1]/2 + 1 >= minimumRows) && ((columns[NLevels-1] + 1)/2 >= minimumColumns)) {
+		// the last row is always kept, as it is the outer border
+		rows[NLevels] = rows[NLevels-1]/2 + 1;
+		columns[NLevels] = (columns[NLevels-1] + 1)/2;
+		NLevels++;
+	}
+
+	grid = NULL;
+	invalidate();
+}
+
+/**
+	sets the values of level 0, all coarser levels are recomputed when needed
+
+	\param values (NRadial+1)*NAzimuthal vertex values, must stay valid until the next call
+*/
+void GridPyramid::setGrid(const double* values)
+{
+	grid = values;
+	invalidate();
+}
+
+void GridPyramid::setReduction(Reduction reduction)
+{
+	if (this->reduction != reduction) {
+		this->reduction = reduction;
+		invalidate();
+	}
+}
+
+void GridPyramid::invalidate()
+{
+	values[0] = const_cast<double*>(grid);
+	valid[0] = grid != NULL;
+
+	for (unsigned int level = 1; level < maximumLevels; ++level) {
+		valid[level] = false;
+	}
+}
+
+/**
+	returns the values of a level, computing it and all levels in between if needed
+*/
+const double* GridPyramid::getLevel(unsigned int level)
+{
+	if ((level >= NLevels) || (grid == NULL))
+		return NULL;
+
+	for (unsigned int current = 1; current <= level; ++current) {
+		if (!valid[current]) {
+			reduce(current);
+		}
+	}
+
+	return values[level];
+}
+
+/**
+	computes a level from the one below
+*/
+void GridPyramid::reduce(unsigned int level)
+{
+	const unsigned int sourceRows = rows[level-1];
+	const unsigned int sourceColumns = columns[level-1];
+	const double* source = values[level-1];
+
+	if (values[level] == NULL) {
+		values[level] = (double*)malloc((size_t)rows[level]*columns[level]*sizeof(double));
+
+		if (values[level] == NULL) {
+			fprintf(stderr, "Not enough memory!\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	static const double weights[3] = { 0.25, 0.5, 0.25 };
+
+	for (unsigned int row = 0; row < rows[level]; ++row) {
+		unsigned int center = 2*row < sourceRows ? 2*row : sourceRows - 1;
+		double* out = &values[level][(size_t)row*columns[level]];
+
+		// neighbour rows outside of the grid are left out
+		const double* sourceRow[3];
+		double rowWeight[3];
+		for (unsigned int k = 0; k < 3; ++k) {
+			bool inside = (center + k >= 1) && (center + k - 1 < sourceRows);
+			sourceRow[k] = inside ? &source[(size_t)(center + k - 1)*sourceColumns] : NULL;
+			rowWeight[k] = inside ? weights[k] : 0.0;
+		}
+		double rowNorm = 1.0/(rowWeight[0] + rowWeight[1] + rowWeight[2]);
+
+		for (unsigned int column = 0; column < columns[level]; ++column) {
+			// azimuthal neighbours are periodic
+			unsigned int c = 2*column;
+			unsigned int neighbour[3] = { c == 0 ? sourceColumns - 1 : c - 1, c, c + 1 < sourceColumns ? c + 1 : 0 };
+
+			double sum = 0.0;
+			double minimum = sourceRow[1][c];
+			double maximum = sourceRow[1][c];
+
+			for (unsigned int k = 0; k < 3; ++k) {
+				if (sourceRow[k] == NULL)
+					continue;
+
+				sum += rowWeight[k]*(0.25*sourceRow[k][neighbour[0]] + 0.5*sourceRow[k][neighbour[1]] + 0.25*sourceRow[k][neighbour[2]]);
+
+				if (reduction == EXTREMA) {
+					for (unsigned int l = 0; l < 3; ++l) {
+						if (sourceRow[k][neighbour[l]] < minimum)
+							minimum = sourceRow[k][neighbour[l]];
+						if (sourceRow[k][neighbour[l]] > maximum)
+							maximum = sourceRow[k][neighbour[l]];
+					}
+				}
+			}
+
+			double mean = sum*rowNorm;
+
+			if (reduction == EXTREMA) {
+				out[column] = maximum - mean >= mean - minimum ? maximum : minimum;
+			} else {
+				out[column] = mean;
+			}
+		}
+	}
+
+	valid[level] = true;
+}
+
+/**
+	returns the memory of the coarse levels in bytes
+*/
+size_t GridPyramid::getMemoryUsage() const
+{
+	size_t result = 0;
+
+	for (unsigned int level = 1; level < NLevels; ++level) {
+		if (values[level] != NULL)
+			result += (size_t)rows[level]*columns[level]*sizeof(double);
+	}
+
+	return result;
+}
@@ -0,0 +1,66 @@
+#ifndef _GRIDPYRAMID_H_
+#define _GRIDPYRAMID_H_
+
+#include <stddef.h>
+
+/**
+	multi-resolution copies of a vertex grid for rendering large grids
+
+	Every level halves the number of vertex rows and columns of the level
+	below, level 0 is the grid itself. Vertex (i, j) of level k sits at vertex
+	(min(i*2^k, NRadial), j*2^k) of level 0, so the geometry of a level only
+	depends on the grid size. The value of a coarse vertex is the weighted mean
+	(1/4, 1/2, 1/4 in both directions) of the 3x3 vertices around it, or the
+	one of their minimum and maximum which is further from that mean, so both
+	peaks and troughs survive. Levels are computed when they are first asked for.
+*/
+class GridPyramid
+{
+	public:
+		enum Reduction {
+			MEAN,
+			EXTREMA
+		};
+
+		// levels are not made smaller than this
+		static const unsigned int minimumRows = 4;
+		static const unsigned int minimumColumns = 16;
+
+		GridPyramid();
+		~GridPyramid();
+
+		void setSize(unsigned int NRadial, unsigned int NAzimuthal);
+		void setGrid(const double* values);
+		void setReduction(Reduction reduction);
+		inline Reduction getReduction() const { return reduction; }
+
+		inline unsigned int getNumberOfLevels() const { return NLevels; }
+		inline unsigned int getNRadial(unsigned int level) const { return rows[level] - 1; }
+		inline unsigned int getNAzimuthal(unsigned int level) const { return columns[level]; }
+		inline unsigned int getRadialIndex(unsigned int level, unsigned int row) const { return (row << level) < rows[0] ? row << level : rows[0] - 1; }
+		const double* getLevel(unsigned int level);
+		size_t getMemoryUsage() const;
+
+	private:
+		static const unsigned int maximumLevels = 16;
+
+		unsigned int NLevels;
+		unsigned int rows[maximumLevels];
+		unsigned int columns[maximumLevels];
+
+		// values[0] points to the grid, the other levels are owned
+		const double* grid;
+		double* values[maximumLevels];
+		bool valid[maximumLevels];
+
+		Reduction reduction;
+
+		void reduce(unsigned int level);
+		void invalidate();
+
+		// not copyable
+		GridPyramid(const GridPyramid&);
+		GridPyramid& operator=(const GridPyramid&);
+};
+
+#endif
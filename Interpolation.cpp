@@ -0,0 +1,284 @@
+#include "Interpolation.h"
+#include "FieldStatistics.h"
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QElapsedTimer>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include "SIMD.h"
+
+namespace interpolation {
+
+using namespace simd;
+
+// grids with fewer vertices are not split across threads
+static const unsigned int minimumParallelSize = 256*1024;
+
+/**
+	vertices of the innermost or outermost row, mean of two cells of row
+
+	Sums are built in the same order as in interpolateReference, so the
+	results are identical.
+*/
+static inline void edgeRow(const double* row, double* out, unsigned int NAzimuthal)
+{
+	// wrap column
+	out[0] = 0.5*(row[0]+row[NAzimuthal-1]);
+
+	unsigned int i = 1;
+
+#ifdef SIMD_ENABLED
+	const Vector half = set1(0.5);
+
+	for (; i + vectorWidth <= NAzimuthal; i += vectorWidth) {
+		store(&out[i], mul(half, add(load(&row[i]), load(&row[i-1]))));
+	}
+#endif
+
+	for (; i < NAzimuthal; ++i) {
+		out[i] = 0.5*(row[i]+row[i-1]);
+	}
+}
+
+/**
+	vertices between two rows of cells, mean of four cells
+*/
+static inline void innerRow(const double* row, const double* below, double* out, unsigned int NAzimuthal)
+{
+	// wrap column
+	out[0] = 0.25*(row[0]+row[NAzimuthal-1]+below[0]+below[NAzimuthal-1]);
+
+	unsigned int i = 1;
+
+#ifdef SIMD_ENABLED
+	const Vector quarter = set1(0.25);
+
+	for (; i + vectorWidth <= NAzimuthal; i += vectorWidth) {
+		Vector sum = add(add(add(load(&row[i]), load(&row[i-1])), load(&below[i])), load(&below[i-1]));
+		store(&out[i], mul(quarter, sum));
+	}
+#endif
+
+	for (; i < NAzimuthal; ++i) {
+		out[i] = 0.25*(row[i]+row[i-1]+below[i]+below[i-1]);
+	}
+}
+
+/**
+	interpolates the vertex rows firstRow to lastRow-1
+
+	\param cells NRadial*NAzimuthal cell values
+	\param vertices (NRadial+1)*NAzimuthal vertex values
+	\param statistics statistics to add the vertices to (may be NULL)
+*/
+void interpolateRows(const double* cells, double* vertices, unsigned int NRadial, unsigned int NAzimuthal, unsigned int firstRow, unsigned int lastRow, FieldStatistics* statistics)
+{
+	for (unsigned int nRadial = firstRow; nRadial < lastRow; ++nRadial) {
+		double* out = &vertices[nRadial*NAzimuthal];
+
+		if (nRadial == 0) {
+			edgeRow(cells, out, NAzimuthal);
+		} else if (nRadial == NRadial) {
+			edgeRow(&cells[(nRadial-1)*NAzimuthal], out, NAzimuthal);
+		} else {
+			innerRow(&cells[nRadial*NAzimuthal], &cells[(nRadial-1)*NAzimuthal], out, NAzimuthal);
+		}
+
+		if (statistics != NULL) {
+			statistics->add(out, NAzimuthal);
+		}
+	}
+}
+
+/**
+	interpolates a range of rows on a thread of the interpolation pool
+*/
+class RowTask : public QRunnable
+{
+	public:
+		RowTask(const double* cells, double* vertices, unsigned int NRadial, unsigned int NAzimuthal, unsigned int firstRow, unsigned int lastRow, FieldStatistics* statistics, QSemaphore* done)
+		: cells(cells), vertices(vertices), NRadial(NRadial), NAzimuthal(NAzimuthal), firstRow(firstRow), lastRow(lastRow), statistics(statistics), done(done)
+		{
+		}
+
+		void run()
+		{
+			interpolateRows(cells, vertices, NRadial, NAzimuthal, firstRow, lastRow, statistics);
+			done->release();
+		}
+
+	private:
+		const double* cells;
+		double* vertices;
+		unsigned int NRadial;
+		unsigned int NAzimuthal;
+		unsigned int firstRow;
+		unsigned int lastRow;
+		FieldStatistics* statistics;
+		QSemaphore* done;
+};
+
+/**
+	returns the pool for row tasks
+
+	It is separate from the global pool, because grids are loaded by tasks in
+	the global pool which wait for their row tasks.
+*/
+static QThreadPool* getPool()
+{
+	static QThreadPool pool;
+
+	return &pool;
+}
+
+/**
+	interpolates a whole grid, large grids are split into blocks of rows for several threads
+*/
+void interpolate(const double* cells, double* vertices, unsigned int NRadial, unsigned int NAzimuthal, FieldStatistics* statistics)
+{
+	unsigned int rows = NRadial + 1;
+	unsigned int threads = QThread::idealThreadCount() > 1 ? QThread::idealThreadCount() : 1;
+
+	if (statistics != NULL) {
+		statistics->reset();
+	}
+
+	if ((threads == 1) || ((size_t)rows*NAzimuthal < minimumParallelSize)) {
+		interpolateRows(cells, vertices, NRadial, NAzimuthal, 0, rows, statistics);
+		return;
+	}
+
+	unsigned int rowsPerTask = (rows + threads - 1)/threads;
+	unsigned int tasks = 0;
+	QSemaphore done;
+
+	// every task accumulates its own statistics
+	std::vector<FieldStatistics> partial(threads);
+
+	for (unsigned int first = rowsPerTask; first < rows; first += rowsPerTask) {
+		unsigned int last = first + rowsPerTask < rows ? first + rowsPerTask : rows;
+		getPool()->start(new RowTask(cells, vertices, NRadial, NAzimuthal, first, last, statistics != NULL ? &partial[tasks] : NULL, &done));
+		tasks++;
+	}
+
+	// first block on this thread
+	interpolateRows(cells, vertices, NRadial, NAzimuthal, 0, rowsPerTask, statistics);
+
+	done.acquire(tasks);
+
+	if (statistics != NULL) {
+		for (unsigned int i = 0; i < tasks; ++i) {
+			statistics->merge(partial[i]);
+		}
+	}
+}
+
+/**
+	straightforward interpolation, kept to verify and benchmark the kernel
+*/
+void interpolateReference(const double* cells, double* vertices, unsigned int NRadial, unsigned int NAzimuthal)
+{
+	const double* buffer = cells;
+	double* quantity = vertices;
+
+	for (unsigned int nRadial = 0; nRadial <= NRadial; ++nRadial) {
+		for (unsigned int nAzimuthal = 0; nAzimuthal < NAzimuthal; ++nAzimuthal) {
+			unsigned int index = nRadial*NAzimuthal + nAzimuthal;
+
+			if (nRadial == 0) {
+				quantity[index] = 0.5*(buffer[index]+buffer[nAzimuthal == 0 ? index + NAzimuthal -1: index-1]);
+			} else if (nRadial == NRadial) {
+				quantity[index] = 0.5*(buffer[index-NAzimuthal]+buffer[nAzimuthal == 0 ? index-NAzimuthal+NAzimuthal-1 : index-NAzimuthal-1]);
+			} else {
+				quantity[index] = 0.25*(buffer[index]+buffer[nAzimuthal == 0 ? index + NAzimuthal -1: index-1]+buffer[index-NAzimuthal]+buffer[nAzimuthal == 0 ? index-NAzimuthal+NAzimuthal-1 : index-NAzimuthal-1]);
+			}
+		}
+	}
+}
+
+const char* getInstructionSet()
+{
+	return instructionSet;
+}
+
+/**
+	compares reference, single threaded and parallel interpolation on a random grid
+
+	\returns 0 if all results are identical, -1 otherwise
+*/
+int benchmark(unsigned int NRadial, unsigned int NAzimuthal, unsigned int repetitions)
+{
+	double* cells = (double*)malloc((size_t)NRadial*NAzimuthal*sizeof(double));
+	double* reference = (double*)malloc((size_t)(NRadial+1)*NAzimuthal*sizeof(double));
+	double* vertices = (double*)malloc((size_t)(NRadial+1)*NAzimuthal*sizeof(double));
+
+	if ((cells == NULL) || (reference == NULL) || (vertices == NULL)) {
+		fprintf(stderr, "Not enough memory!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	srand(1);
+	for (size_t i = 0; i < (size_t)NRadial*NAzimuthal; ++i) {
+		cells[i] = exp(10.0*rand()/RAND_MAX);
+	}
+
+	size_t bytes = ((size_t)NRadial + (NRadial+1))*NAzimuthal*sizeof(double);
+	int ret = 0;
+
+	printf("Interpolating %u x %u cells, %u repetitions, %s\n", NRadial, NAzimuthal, repetitions, instructionSet);
+
+	for (unsigned int variant = 0; variant < 3; ++variant) {
+		double* out = variant == 0 ? reference : vertices;
+		QElapsedTimer timer;
+		timer.start();
+
+		for (unsigned int repetition = 0; repetition < repetitions; ++repetition) {
+			switch (variant) {
+				case 0:
+					interpolateReference(cells, out, NRadial, NAzimuthal);
+					break;
+
+				case 1:
+					interpolateRows(cells, out, NRadial, NAzimuthal, 0, NRadial+1);
+					break;
+
+				default:
+					interpolate(cells, out, NRadial, NAzimuthal);
+					break;
+			}
+		}
+
+		double seconds = timer.nsecsElapsed()*1e-9/repetitions;
+		static const char* names[] = { "reference", "kernel, 1 thread", "kernel, parallel" };
+
+		printf("%-18s %8.3f ms %8.2f GB/s", names[variant], seconds*1e3, bytes/seconds*1e-9);
+
+		if (variant > 0) {
+			size_t differences = 0;
+
+			for (size_t i = 0; i < (size_t)(NRadial+1)*NAzimuthal; ++i) {
+				if (vertices[i] != reference[i])
+					differences++;
+			}
+
+			printf(" %lu differences", differences);
+
+			if (differences > 0)
+				ret = -1;
+		}
+
+		printf("\n");
+	}
+
+	free(cells);
+	free(reference);
+	free(vertices);
+
+	return ret;
+}
+
+}
@@ -0,0 +1,23 @@
+#ifndef _INTERPOLATION_H_
+#define _INTERPOLATION_H_
+
+class FieldStatistics;
+
+/**
+	interpolation of scalar grids from cell centers to vertices
+
+	A vertex gets the mean of the (up to) four cells touching it, the
+	azimuthal direction is periodic. Statistics of the vertices are
+	accumulated row by row while the row is still in cache.
+*/
+namespace interpolation {
+
+void interpolate(const double* cells, double* vertices, unsigned int NRadial, unsigned int NAzimuthal, FieldStatistics* statistics = 0);
+void interpolateRows(const double* cells, double* vertices, unsigned int NRadial, unsigned int NAzimuthal, unsigned int firstRow, unsigned int lastRow, FieldStatistics* statistics = 0);
+void interpolateReference(const double* cells, double* vertices, unsigned int NRadial, unsigned int NAzimuthal);
+const char* getInstructionSet();
+int benchmark(unsigned int NRadial, unsigned int NAzimuthal, unsigned int repetitions);
+
+}
+
+#endif
@@ -9,7 +9,14 @@
 #include <QInputDialog>
 #include <float.h>
 #include "Simulation.h"
+#include "Snapshot.h"
+#include "SnapshotCache.h"
+#include "CompressedCache.h"
+#include "FieldStatistics.h"
+#include "Expression.h"
 #include "FARGO.h"
+#include "PackedFARGO.h"
+#include "Pack.h"
 #include "util.h"
 #include "version.h"
 
@@ -20,10 +27,19 @@ MainWidget::MainWidget(QWidget *parent)
 
 	fps = 10.0;
 	skip = 0;
+	direction = 1;
+
+	prefetcher = new Prefetcher(this);
+	prefetcher->setLookAhead(settings->value("prefetchDepth", 8).toUInt());
+	prefetcher->start();
+
+	statisticsIndex = new StatisticsIndex(this);
+
+	videoWriter = new VideoWriter;
 
 	openGLWidget = new OpenGLWidget(this);
 	paletteWidget = new PaletteWidget(openGLWidget->getPalette(),0);
-	connect(paletteWidget, SIGNAL(paletteUpdated()), openGLWidget, SLOT(updateFromGrid()));
+	connect(paletteWidget, SIGNAL(paletteUpdated()), openGLWidget, SLOT(updateFromPalette()));
 
 	createMenu();
 	createButtons();
@@ -45,6 +61,13 @@ MainWidget::MainWidget(QWidget *parent)
 
 	connect(timer, SIGNAL(timeout()), this, SLOT(timerUpdate()));
 
+	regionTimer = new QTimer(this);
+	regionTimer->setSingleShot(true);
+	regionTimer->setInterval(250);
+
+	connect(regionTimer, SIGNAL(timeout()), this, SLOT(applyVisibleRegion()));
+	connect(openGLWidget, SIGNAL(visibleRegionChanged()), regionTimer, SLOT(start()));
+
 	setSimulation(NULL);
 
 	// restore settings
@@ -83,6 +106,14 @@ MainWidget::MainWidget(QWidget *parent)
 					quantityVRadialAction->toggle();
 				} else if (args[i+1] == "vazimuthal") {
 					quantityVAzimuthalAction->toggle();
+				} else if (args[i+1] == "vorticity") {
+					quantityVorticityAction->toggle();
+				} else if (args[i+1] == "vortensity") {
+					quantityVortensityAction->toggle();
+				} else if (args[i+1] == "toomreq") {
+					quantityToomreQAction->toggle();
+				} else if (args[i+1] == "massflux") {
+					quantityMassFluxAction->toggle();
 				} else {
 					fprintf(stderr, "Invalid quantity: '%s'!\n", args[i+1].toAscii().constData());
 				}
@@ -92,6 +123,21 @@ MainWidget::MainWidget(QWidget *parent)
 			i++;
 		}
 
+		if ((args[i] == "-e") || (args[i] == "--expression")) {
+			if (args.count() > i+1) {
+				QString error;
+
+				if (setExpression(args[i+1], &error) < 0) {
+					fprintf(stderr, "%s\n", error.toAscii().constData());
+				} else if (!quantityExpressionAction->isChecked()) {
+					quantityExpressionAction->toggle();
+				}
+			} else {
+				fprintf(stderr, "Please provide expression to show!\n");
+			}
+			i++;
+		}
+
 		if ((args[i] == "-l") || (args[i] == "--logarithmic")) {
 			setLogarithmicAction->setChecked(true);
 		}
@@ -107,7 +153,11 @@ MainWidget::MainWidget(QWidget *parent)
 			printf("  -a | --autoscale                 autoscale\n");
 			printf("  -l | --logarithmic               logarithmic scale\n");
 			printf("  -i | --linear                    linear scale\n");
-			printf("  -q | --quantity <quantity>       select quantity (density, temperature, vradial, vazimuthal)\n");
+			printf("  -q | --quantity <quantity>       select quantity (density, temperature, vradial, vazimuthal,\n");
+			printf("                                   vorticity, vortensity, toomreq, massflux)\n");
+			printf("  -e | --expression <expression>   show expression, e.g. \"dens/azimean(dens)-1\"\n");
+			printf("\nFrames of a range of timesteps are rendered without a window by\n");
+			printf("%s --render <simulation> <output directory> [options], see --render --help\n", args[0].toAscii().constData());
 			printf("\nAll arguments are executed in the order given in the command line,\n");
 			printf("so e.g. it is a good idea to autoscale (-a) after loading a simulation file (-s)\n");
 		}
@@ -117,6 +167,15 @@ MainWidget::MainWidget(QWidget *parent)
 
 MainWidget::~MainWidget()
 {
+	prefetcher->setSimulation(NULL);
+	delete prefetcher;
+
+	statisticsIndex->setSimulation(NULL);
+	delete statisticsIndex;
+
+	openGLWidget->setVideoWriter(NULL);
+	delete videoWriter;
+
 	delete openGLWidget;
 	delete paletteWidget;
 }
@@ -154,6 +213,16 @@ void MainWidget::createMenu()
 	openGLWidget->updateSaveScreenshots(false);
 	connect(saveScreenshotsAction, SIGNAL(toggled(bool)), openGLWidget, SLOT(updateSaveScreenshots(bool)));
 
+	setScreenshotOutputAction = optionsMenu->addAction(tr("Set Screenshot &Output..."));
+	connect(setScreenshotOutputAction, SIGNAL(triggered()), this, SLOT(triggeredSetScreenshotOutput()));
+	openGLWidget->getScreenshotWriter()->setPattern(settings->value("screenshotPattern", "/tmp/image_%1.png").toString());
+	openGLWidget->getScreenshotWriter()->setCompressionLevel(settings->value("screenshotCompressionLevel", 6).toInt());
+
+	recordVideoAction = optionsMenu->addAction(tr("Record &Video..."));
+	recordVideoAction->setCheckable(true);
+	recordVideoAction->setChecked(false);
+	connect(recordVideoAction, SIGNAL(toggled(bool)), this, SLOT(toggledRecordVideo(bool)));
+
 	setWindowSizeAction = optionsMenu->addAction(tr("Set &Window Size"));
 	connect(setWindowSizeAction, SIGNAL(triggered()), this, SLOT(triggeredSetWindowSize()));
 
@@ -175,6 +244,61 @@ void MainWidget::createMenu()
 	autoscaleAction = optionsMenu->addAction(tr("&Autoscale"));
 	connect(autoscaleAction, SIGNAL(triggered()), this, SLOT(triggeredAutoscale()));
 
+	autoscaleEveryFrameAction = optionsMenu->addAction(tr("Autoscale &Every Frame"));
+	autoscaleEveryFrameAction->setCheckable(true);
+	autoscaleEveryFrameAction->setChecked(settings->value("autoscaleEveryFrame", false).toBool());
+	connect(autoscaleEveryFrameAction, SIGNAL(toggled(bool)), this, SLOT(toggledAutoscaleEveryFrame(bool)));
+
+	autoscaleWholeRunAction = optionsMenu->addAction(tr("Autoscale &Whole Run"));
+	connect(autoscaleWholeRunAction, SIGNAL(triggered()), this, SLOT(triggeredAutoscaleWholeRun()));
+
+	autoscalePercentilesAction = optionsMenu->addAction(tr("Autoscale to &Percentiles"));
+	connect(autoscalePercentilesAction, SIGNAL(triggered()), this, SLOT(triggeredAutoscalePercentiles()));
+
+	buildStatisticsIndexAction = optionsMenu->addAction(tr("&Build Statistics Index"));
+	connect(buildStatisticsIndexAction, SIGNAL(triggered()), this, SLOT(triggeredBuildStatisticsIndex()));
+
+	visibleRegionAction = optionsMenu->addAction(tr("Load &Visible Region Only"));
+	visibleRegionAction->setCheckable(true);
+	visibleRegionAction->setChecked(settings->value("visibleRegionOnly", false).toBool());
+	connect(visibleRegionAction, SIGNAL(toggled(bool)), this, SLOT(toggledVisibleRegion(bool)));
+
+	optionsMenu->addSeparator();
+
+	playReverseAction = optionsMenu->addAction(tr("Play &Reverse"));
+	playReverseAction->setCheckable(true);
+	playReverseAction->setChecked(false);
+	connect(playReverseAction, SIGNAL(toggled(bool)), this, SLOT(toggledPlayReverse(bool)));
+
+	loopAction = optionsMenu->addAction(tr("L&oop Playback"));
+	loopAction->setCheckable(true);
+	loopAction->setChecked(false);
+
+	followAction = optionsMenu->addAction(tr("&Follow Running Simulation"));
+	followAction->setCheckable(true);
+	followAction->setChecked(settings->value("follow", false).toBool());
+	connect(followAction, SIGNAL(toggled(bool)), this, SLOT(toggledFollow(bool)));
+
+	followJumpAction = optionsMenu->addAction(tr("&Jump to Newest Timestep"));
+	followJumpAction->setCheckable(true);
+	followJumpAction->setChecked(settings->value("followJump", false).toBool());
+	connect(followJumpAction, SIGNAL(toggled(bool)), this, SLOT(toggledFollowJump(bool)));
+
+	setPrefetchDepthAction = optionsMenu->addAction(tr("Set Prefetch &Depth"));
+	connect(setPrefetchDepthAction, SIGNAL(triggered()), this, SLOT(triggeredSetPrefetchDepth()));
+
+	setCacheBudgetAction = optionsMenu->addAction(tr("Set &Cache Size"));
+	connect(setCacheBudgetAction, SIGNAL(triggered()), this, SLOT(triggeredSetCacheBudget()));
+
+	setCompressedCacheAction = optionsMenu->addAction(tr("Set C&ompressed Cache"));
+	connect(setCompressedCacheAction, SIGNAL(triggered()), this, SLOT(triggeredSetCompressedCache()));
+
+	pinRangeAction = optionsMenu->addAction(tr("Pin &Range in Cache"));
+	connect(pinRangeAction, SIGNAL(triggered()), this, SLOT(triggeredPinRange()));
+
+	playbackStatisticsAction = optionsMenu->addAction(tr("Playback S&tatistics"));
+	connect(playbackStatisticsAction, SIGNAL(triggered()), this, SLOT(triggeredPlaybackStatistics()));
+
 	menuBar->addMenu(optionsMenu);
 
 	// quantity
@@ -201,6 +325,60 @@ void MainWidget::createMenu()
 	connect(quantityVAzimuthalAction, SIGNAL(toggled(bool)), this, SLOT(toggledQuantityVAzimuthal(bool)));
 
 	quantityMenu->addActions(quantityActionGroup->actions());
+	quantityMenu->addSeparator();
+
+	// computed while loading from the grids above
+	quantityVorticityAction = quantityActionGroup->addAction(tr("V&orticity"));
+	quantityVorticityAction->setCheckable(true);
+	connect(quantityVorticityAction, SIGNAL(toggled(bool)), this, SLOT(toggledQuantityVorticity(bool)));
+
+	quantityVortensityAction = quantityActionGroup->addAction(tr("Vort&ensity"));
+	quantityVortensityAction->setCheckable(true);
+	connect(quantityVortensityAction, SIGNAL(toggled(bool)), this, SLOT(toggledQuantityVortensity(bool)));
+
+	quantityToomreQAction = quantityActionGroup->addAction(tr("Toomre &Q"));
+	quantityToomreQAction->setCheckable(true);
+	connect(quantityToomreQAction, SIGNAL(toggled(bool)), this, SLOT(toggledQuantityToomreQ(bool)));
+
+	quantityMassFluxAction = quantityActionGroup->addAction(tr("&Mass Flux"));
+	quantityMassFluxAction->setCheckable(true);
+	connect(quantityMassFluxAction, SIGNAL(toggled(bool)), this, SLOT(toggledQuantityMassFlux(bool)));
+
+	quantityMenu->addAction(quantityVorticityAction);
+	quantityMenu->addAction(quantityVortensityAction);
+	quantityMenu->addAction(quantityToomreQAction);
+	quantityMenu->addAction(quantityMassFluxAction);
+	quantityMenu->addSeparator();
+
+	quantityExpressionAction = quantityActionGroup->addAction(tr("E&xpression"));
+	quantityExpressionAction->setCheckable(true);
+	connect(quantityExpressionAction, SIGNAL(toggled(bool)), this, SLOT(toggledQuantityExpression(bool)));
+	quantityMenu->addAction(quantityExpressionAction);
+
+	setExpressionAction = quantityMenu->addAction(tr("&Set Expression..."));
+	connect(setExpressionAction, SIGNAL(triggered()), this, SLOT(triggeredSetExpression()));
+	quantityMenu->addSeparator();
+
+	// quantities loaded together with the shown one, so switching to them is instant
+	preloadMenu = quantityMenu->addMenu(tr("&Preload"));
+	unsigned int preloadedQuantities = settings->value("preloadedQuantities", 0).toUInt();
+
+	preloadActions[Simulation::DENSITY] = preloadMenu->addAction(tr("&Density"));
+	preloadActions[Simulation::TEMPERATURE] = preloadMenu->addAction(tr("&Temperature"));
+	preloadActions[Simulation::V_RADIAL] = preloadMenu->addAction(tr("&VRadial"));
+	preloadActions[Simulation::V_AZIMUTHAL] = preloadMenu->addAction(tr("V&Azimuthal"));
+	preloadMenu->addSeparator();
+	preloadActions[Simulation::VORTICITY] = preloadMenu->addAction(tr("V&orticity"));
+	preloadActions[Simulation::VORTENSITY] = preloadMenu->addAction(tr("Vort&ensity"));
+	preloadActions[Simulation::TOOMRE_Q] = preloadMenu->addAction(tr("Toomre &Q"));
+	preloadActions[Simulation::MASS_FLUX] = preloadMenu->addAction(tr("&Mass Flux"));
+	preloadActions[Simulation::EXPRESSION] = preloadMenu->addAction(tr("E&xpression"));
+
+	for (unsigned int type = 0; type < Simulation::N_QUANTITY_TYPES; ++type) {
+		preloadActions[type]->setCheckable(true);
+		preloadActions[type]->setChecked(preloadedQuantities & (1u << type));
+		connect(preloadActions[type], SIGNAL(toggled(bool)), this, SLOT(toggledPreloadQuantity(bool)));
+	}
 
 	// view
 	viewMenu = new QMenu(tr("&View"), this);
@@ -275,6 +453,30 @@ void MainWidget::createMenu()
 	openGLWidget->updateUseMultisampling(true);
 	connect(useMultisampling, SIGNAL(toggled(bool)), openGLWidget, SLOT(updateUseMultisampling(bool)));
 
+	useShadersAction = viewMenu->addAction(tr("Color in &Shaders"));
+	useShadersAction->setCheckable(true);
+	useShadersAction->setChecked(settings->value("useShaders", true).toBool());
+	openGLWidget->updateUseShaders(useShadersAction->isChecked());
+	connect(useShadersAction, SIGNAL(toggled(bool)), this, SLOT(toggledUseShaders(bool)));
+
+	meshFreeDiskAction = viewMenu->addAction(tr("Mesh-&Free Disk"));
+	meshFreeDiskAction->setCheckable(true);
+	meshFreeDiskAction->setChecked(settings->value("meshFreeDisk", false).toBool());
+	openGLWidget->updateMeshFreeDisk(meshFreeDiskAction->isChecked());
+	connect(meshFreeDiskAction, SIGNAL(toggled(bool)), this, SLOT(toggledMeshFreeDisk(bool)));
+
+	levelOfDetailAction = viewMenu->addAction(tr("&Level of Detail"));
+	levelOfDetailAction->setCheckable(true);
+	levelOfDetailAction->setChecked(true);
+	openGLWidget->updateLevelOfDetail(true);
+	connect(levelOfDetailAction, SIGNAL(toggled(bool)), openGLWidget, SLOT(updateLevelOfDetail(bool)));
+
+	levelOfDetailExtremaAction = viewMenu->addAction(tr("Coarse Levels Keep E&xtrema"));
+	levelOfDetailExtremaAction->setCheckable(true);
+	levelOfDetailExtremaAction->setChecked(false);
+	openGLWidget->updateLevelOfDetailExtrema(false);
+	connect(levelOfDetailExtremaAction, SIGNAL(toggled(bool)), openGLWidget, SLOT(updateLevelOfDetailExtrema(bool)));
+
 	menuBar->addMenu(viewMenu);
 
 	// help
@@ -384,18 +586,70 @@ void MainWidget::createButtons()
 
 void MainWidget::timerUpdate()
 {
-	unsigned int currentTimestep = simulation->getCurrentTimestep();
+	// wait for the encoder instead of piling up screenshots
+	if (saveScreenshotsAction->isChecked() && openGLWidget->getScreenshotWriter()->isFull()) {
+		return;
+	}
+	if (videoWriter->isOpen() && videoWriter->isFull()) {
+		return;
+	}
+
+	int stride = direction*(1+(int)skip);
+	int nextTimestep = simulation->getNextTimestep(simulation->getCurrentTimestep(), stride);
+
+	// loop over the pinned range or the whole simulation
+	if (loopAction->isChecked()) {
+		SnapshotCache* cache = simulation->getSnapshotCache();
+		unsigned int first = cache->hasPinnedRange() ? cache->getPinnedFirst() : 0;
+		unsigned int last = cache->hasPinnedRange() ? cache->getPinnedLast() : simulation->getLastTimeStep();
+
+		if ((nextTimestep < (int)first) || (nextTimestep > (int)last)) {
+			unsigned int start = direction > 0 ? first : last;
+			nextTimestep = simulation->hasTimestep(start) ? (int)start : simulation->getNextTimestep(start, direction);
+		}
+	}
+
+	if (nextTimestep < 0) {
+		clickedStop();
+		return;
+	}
+
+	// use the snapshot decoded by the prefetcher, load it ourself on a miss
+	SnapshotPointer snapshot = prefetcher->take(nextTimestep);
 
-	if ((currentTimestep == simulation->getLastTimeStep()) || (simulation->loadTimestep(currentTimestep+1+skip)<0)) {
+	if (!snapshot.isNull()) {
+		simulation->setSnapshot(snapshot);
+	} else if (simulation->loadTimestep(nextTimestep)<0) {
 		clickedStop();
 	}
 }
 
+/**
+	restarts the prefetcher behind the current timestep if we are playing
+*/
+void MainWidget::restartPrefetching()
+{
+	if ((simulation == NULL) || (!timer->isActive()))
+		return;
+
+	int stride = direction*(1+(int)skip);
+	int nextTimestep = simulation->getNextTimestep(simulation->getCurrentTimestep(), stride);
+
+	if (nextTimestep >= 0) {
+		prefetcher->startPlayback(nextTimestep, stride);
+	}
+}
+
 void MainWidget::updateFromSimulation()
 {
 	if (simulation != NULL) {
 		timestepLineEdit->setText(QString("%1").arg(simulation->getCurrentTimestep()));
 		timelineSlider->setValue(simulation->getCurrentTimestep());
+
+		// statistics were computed while loading, so this is free
+		if (autoscaleEveryFrameAction->isChecked()) {
+			autoscale(false);
+		}
 	}
 }
 
@@ -405,9 +659,11 @@ void MainWidget::clickedPlayPause(bool value)
 		// button is in pause mode
 		if (value) {
 			timer->stop();
+			prefetcher->stopPlayback();
 			timestepLineEdit->setReadOnly(false);
 		} else {
 			timer->start();
+			restartPrefetching();
 			timestepLineEdit->setReadOnly(true);
 		}
 	} else {
@@ -417,12 +673,14 @@ void MainWidget::clickedPlayPause(bool value)
 		playPauseButton->setToolTip(tr("Pause"));
 		timestepLineEdit->setReadOnly(true);
 		timer->start();
+		restartPrefetching();
 	}
 }
 
 void MainWidget::clickedStop()
 {
 	timer->stop();
+	prefetcher->stopPlayback();
 
 	playPauseButton->setCheckable(false);
 	playPauseButton->setIcon(style()->standardIcon(QStyle::SP_MediaPlay));
@@ -487,6 +745,7 @@ void MainWidget::fpsUpdate()
 void MainWidget::skipUpdate()
 {
 	skip = skipLineEdit->text().toInt();
+	restartPrefetching();
 }
 
 void MainWidget::timestepUpdate()
@@ -497,6 +756,8 @@ void MainWidget::timestepUpdate()
 void MainWidget::setSimulation(Simulation *simulation)
 {
 	this->simulation = simulation;
+	prefetcher->setSimulation(simulation);
+	statisticsIndex->setSimulation(simulation);
 
 	if (simulation == NULL) {
 		timelineSlider->setEnabled(false);
@@ -510,7 +771,9 @@ void MainWidget::setSimulation(Simulation *simulation)
 		quantityActionGroup->setEnabled(false);
 	} else {
 		connect(simulation, SIGNAL(dataUpdated()), this, SLOT(updateFromSimulation()));
-		connect(simulation, SIGNAL(dataUpdated()), openGLWidget, SLOT(updateFromGrid()));
+		connect(simulation, SIGNAL(dataUpdated()), openGLWidget, SLOT(updateFromData()));
+		connect(simulation, SIGNAL(timestepsAdded()), this, SLOT(addedTimesteps()));
+		connect(simulation, SIGNAL(timestepWritten(unsigned int)), statisticsIndex, SLOT(removeTimestep(unsigned int)));
 
 		timelineSlider->setEnabled(true);
 		playPauseButton->setEnabled(true);
@@ -525,6 +788,21 @@ void MainWidget::setSimulation(Simulation *simulation)
 		timelineSlider->setMinimum(0);
 		timelineSlider->setMaximum(simulation->getLastTimeStep());
 
+		simulation->getSnapshotCache()->setBudget((size_t)settings->value("cacheSize", 512).toUInt()*1024*1024);
+		simulation->setPreloadedQuantities(settings->value("preloadedQuantities", 0).toUInt());
+
+		Expression* expression = new Expression;
+		if (expression->parse(settings->value("expression", "log10(dens)").toString().toAscii().constData()) == 0) {
+			simulation->setExpression(ExpressionPointer(expression));
+		} else {
+			delete expression;
+		}
+
+		// the view of the new disk decides about its region
+		regionTimer->start();
+		applyCompressedCacheSettings();
+		simulation->setFollow(followAction->isChecked());
+
 		openGLWidget->setSimulation(simulation);
 
 		updateFromSimulation();
@@ -550,15 +828,25 @@ void MainWidget::triggeredOpen()
 void MainWidget::loadSimulation(QString filename)
 {
 	if (filename.isNull()) {
+		prefetcher->setSimulation(NULL);
+		statisticsIndex->setSimulation(NULL);
 		delete simulation;
 		simulation = NULL;
 	} else {
+		clickedStop();
+		prefetcher->setSimulation(NULL);
+		statisticsIndex->setSimulation(NULL);
 		delete simulation;
 		setSimulation(NULL);
-		simulation = new FARGO;
 
 		char *full_filename = realpath(filename.toAscii().data(), NULL);;
 
+		if ((full_filename != NULL) && Pack::isPack(full_filename)) {
+			simulation = new PackedFARGO;
+		} else {
+			simulation = new FARGO;
+		}
+
 		if ((full_filename != NULL) && (simulation->loadFromFile(full_filename) == 0)) {
 			setSimulation(simulation);
 			settings->setValue("lastSimulation", filename);
@@ -592,6 +880,83 @@ void MainWidget::triggeredSetWindowSize()
 	setMinimumSize(QSize(width+30,height+80));
 }
 
+void MainWidget::triggeredSetScreenshotOutput()
+{
+	ScreenshotWriter* writer = openGLWidget->getScreenshotWriter();
+	bool ok;
+
+	QString pattern = QInputDialog::getText(this, tr("Screenshot Output"), tr("Filename (%1 is replaced by the timestep):"), QLineEdit::Normal, writer->getPattern(), &ok);
+	if (!ok) {
+		return;
+	}
+
+	if (!pattern.contains("%1")) {
+		QMessageBox msgBox;
+		msgBox.setText(tr("The filename must contain %1 for the timestep."));
+		msgBox.exec();
+		return;
+	}
+
+	int level = QInputDialog::getInt(this, tr("Screenshot Output"), tr("PNG compression level (0 fastest, 9 smallest):"), writer->getCompressionLevel(), 0, 9, 1, &ok);
+	if (!ok) {
+		return;
+	}
+
+	writer->setPattern(pattern);
+	writer->setCompressionLevel(level);
+	settings->setValue("screenshotPattern", pattern);
+	settings->setValue("screenshotCompressionLevel", level);
+}
+
+void MainWidget::toggledUseShaders(bool value)
+{
+	settings->setValue("useShaders", value);
+	openGLWidget->updateUseShaders(value);
+}
+
+void MainWidget::toggledMeshFreeDisk(bool value)
+{
+	settings->setValue("meshFreeDisk", value);
+	openGLWidget->updateMeshFreeDisk(value);
+}
+
+/**
+	streams every painted frame into a Y4M file or into a command like ffmpeg
+*/
+void MainWidget::toggledRecordVideo(bool value)
+{
+	if (!value) {
+		if (videoWriter->isOpen()) {
+			openGLWidget->setVideoWriter(NULL);
+			unsigned int frames = videoWriter->getFrames();
+			QMessageBox msgBox;
+			if (videoWriter->close() != 0) {
+				msgBox.setText(tr("Writing the video failed."));
+			} else {
+				msgBox.setText(tr("Recorded %1 frames.").arg(frames));
+			}
+			msgBox.exec();
+		}
+		return;
+	}
+
+	bool ok;
+	QString output = QInputDialog::getText(this, tr("Record Video"), tr("Y4M file, or |command reading the stream from stdin:"), QLineEdit::Normal, settings->value("videoOutput", "| ffmpeg -y -f yuv4mpegpipe -i - -c:v libx264 -pix_fmt yuv420p /tmp/movie.mp4").toString(), &ok);
+
+	if (ok && (videoWriter->open(output, (unsigned int)(fps + 0.5)) == 0)) {
+		settings->setValue("videoOutput", output);
+		openGLWidget->setVideoWriter(videoWriter);
+	} else {
+		if (ok) {
+			QMessageBox msgBox;
+			msgBox.setText(QString("Failed to open '%1'.").arg(output));
+			msgBox.exec();
+		}
+		// unchecking calls us again, but nothing is open
+		recordVideoAction->setChecked(false);
+	}
+}
+
 void MainWidget::triggeredEditPalette()
 {
 	paletteWidget->show();
@@ -602,7 +967,8 @@ void MainWidget::toggledQuantityTemperature(bool value)
 {
 	if (value) {
 		simulation->setQuantityType(Simulation::TEMPERATURE);
-		openGLWidget->updateFromGrid();
+		openGLWidget->updateFromData();
+		restartPrefetching();
 	}
 }
 
@@ -610,7 +976,8 @@ void MainWidget::toggledQuantityDensity(bool value)
 {
 	if (value) {
 		simulation->setQuantityType(Simulation::DENSITY);
-		openGLWidget->updateFromGrid();
+		openGLWidget->updateFromData();
+		restartPrefetching();
 	}
 }
 
@@ -618,7 +985,8 @@ void MainWidget::toggledQuantityVRadial(bool value)
 {
 	if (value) {
 		simulation->setQuantityType(Simulation::V_RADIAL);
-		openGLWidget->updateFromGrid();
+		openGLWidget->updateFromData();
+		restartPrefetching();
 	}
 }
 
@@ -626,7 +994,117 @@ void MainWidget::toggledQuantityVAzimuthal(bool value)
 {
 	if (value) {
 		simulation->setQuantityType(Simulation::V_AZIMUTHAL);
-		openGLWidget->updateFromGrid();
+		openGLWidget->updateFromData();
+		restartPrefetching();
+	}
+}
+
+void MainWidget::toggledQuantityVorticity(bool value)
+{
+	if (value) {
+		simulation->setQuantityType(Simulation::VORTICITY);
+		openGLWidget->updateFromData();
+		restartPrefetching();
+	}
+}
+
+void MainWidget::toggledQuantityVortensity(bool value)
+{
+	if (value) {
+		simulation->setQuantityType(Simulation::VORTENSITY);
+		openGLWidget->updateFromData();
+		restartPrefetching();
+	}
+}
+
+void MainWidget::toggledQuantityToomreQ(bool value)
+{
+	if (value) {
+		simulation->setQuantityType(Simulation::TOOMRE_Q);
+		openGLWidget->updateFromData();
+		restartPrefetching();
+	}
+}
+
+void MainWidget::toggledQuantityMassFlux(bool value)
+{
+	if (value) {
+		simulation->setQuantityType(Simulation::MASS_FLUX);
+		openGLWidget->updateFromData();
+		restartPrefetching();
+	}
+}
+
+void MainWidget::toggledQuantityExpression(bool value)
+{
+	if (value) {
+		simulation->setQuantityType(Simulation::EXPRESSION);
+		openGLWidget->updateFromData();
+		restartPrefetching();
+	}
+}
+
+void MainWidget::triggeredSetExpression()
+{
+	bool ok;
+	QString text = QInputDialog::getText(this, tr("Expression"), tr("Expression (e.g. log10(dens)*vrad, dens/azimean(dens)-1):"), QLineEdit::Normal, settings->value("expression", "log10(dens)").toString(), &ok);
+
+	if (!ok)
+		return;
+
+	QString error;
+
+	if (setExpression(text, &error) < 0) {
+		QMessageBox msgBox;
+		msgBox.setText(error);
+		msgBox.exec();
+	} else if (!quantityExpressionAction->isChecked()) {
+		quantityExpressionAction->toggle();
+	}
+}
+
+/**
+	parses an expression, stores it in the settings and hands it to the simulation
+
+	\returns 0 on success, -1 if the expression is invalid (error is set)
+*/
+int MainWidget::setExpression(const QString& text, QString* error)
+{
+	Expression* expression = new Expression;
+
+	if (expression->parse(text.toAscii().constData()) < 0) {
+		*error = expression->getError();
+		delete expression;
+		return -1;
+	}
+
+	settings->setValue("expression", text);
+
+	if (simulation != NULL) {
+		simulation->setExpression(ExpressionPointer(expression));
+		restartPrefetching();
+	} else {
+		delete expression;
+	}
+
+	return 0;
+}
+
+void MainWidget::toggledPreloadQuantity(bool)
+{
+	unsigned int mask = 0;
+
+	for (unsigned int type = 0; type < Simulation::N_QUANTITY_TYPES; ++type) {
+		if (preloadActions[type]->isChecked()) {
+			mask |= 1u << type;
+		}
+	}
+
+	settings->setValue("preloadedQuantities", mask);
+
+	if (simulation != NULL) {
+		simulation->setPreloadedQuantities(mask);
+		restartPrefetching();
 	}
 }
 
@@ -683,11 +1161,147 @@ void MainWidget::triggeredSetMaximumValue()
 	}
 }
 
+/**
+	checks if the vertices of inner are part of outer (columns modulo NAzimuthal)
+*/
+static bool containsRegion(const Simulation::Region& outer, const Simulation::Region& inner, unsigned int NAzimuthal)
+{
+	if (outer.isFull())
+		return true;
+
+	if ((inner.firstRow < outer.firstRow) || (inner.firstRow + inner.rows > outer.firstRow + outer.rows))
+		return false;
+
+	if (outer.columns >= NAzimuthal)
+		return true;
+
+	unsigned int offset = (inner.firstColumn + NAzimuthal - outer.firstColumn) % NAzimuthal;
+
+	return offset + inner.columns <= outer.columns;
+}
+
+void MainWidget::toggledVisibleRegion(bool value)
+{
+	settings->setValue("visibleRegionOnly", value);
+
+	if (value) {
+		applyVisibleRegion();
+	} else if ((simulation != NULL) && !simulation->getRegionOfInterest().isFull()) {
+		simulation->setRegionOfInterest(Simulation::Region());
+		simulation->loadTimestep(simulation->getCurrentTimestep());
+		restartPrefetching();
+	}
+}
+
+/**
+	loads the part of the disk in view at full resolution and the rest from
+	every 8th row
+
+	The region is only changed if the view left the current one or the
+	current one got much larger than needed.
+*/
+void MainWidget::applyVisibleRegion()
+{
+	if ((simulation == NULL) || !visibleRegionAction->isChecked())
+		return;
+
+	const unsigned int NRadial = simulation->getNRadial();
+	const unsigned int NAzimuthal = simulation->getNAzimuthal();
+	const double* radii = simulation->getRadii();
+
+	double rMin, rMax, phiMin, phiWidth;
+	bool bounded = openGLWidget->getVisibleRegion(&rMin, &rMax, &phiMin, &phiWidth);
+
+	Simulation::Region visible;
+	Simulation::Region region;
+
+	if (bounded && (rMin <= radii[NRadial]) && (rMax >= radii[0])) {
+		// vertex rows and columns in view, and with a margin of 25%
+		for (unsigned int k = 0; k < 2; ++k) {
+			double margin = k == 0 ? 0.0 : 0.25;
+			double dr = margin*(rMax - rMin);
+			double dphi = margin*phiWidth;
+
+			unsigned int first = 0;
+			while ((first < NRadial) && (radii[first+1] < rMin - dr))
+				first++;
+			unsigned int last = NRadial;
+			while ((last > first) && (radii[last-1] > rMax + dr))
+				last--;
+
+			double columnWidth = 2.0*M_PI/NAzimuthal;
+			int firstColumn = (int)floor((phiMin - dphi)/columnWidth);
+			unsigned int columns = (unsigned int)ceil((phiWidth + 2.0*dphi)/columnWidth) + 1;
+
+			Simulation::Region& target = k == 0 ? visible : region;
+			target.firstRow = first;
+			target.rows = last - first + 1;
+			target.firstColumn = (unsigned int)(((firstColumn % (int)NAzimuthal) + (int)NAzimuthal) % (int)NAzimuthal);
+			target.columns = min(columns, NAzimuthal);
+			target.stride = 8;
+		}
+
+		// a large part of the grid is loaded faster in one piece
+		if ((double)region.rows*region.columns > 0.25*(NRadial+1)*NAzimuthal) {
+			region = Simulation::Region();
+		}
+	}
+
+	Simulation::Region current = simulation->getRegionOfInterest();
+
+	if (!current.isFull() && !region.isFull() && containsRegion(current, visible, NAzimuthal) && ((double)current.rows*current.columns < 4.0*region.rows*region.columns))
+		return;
+
+	if (current == region)
+		return;
+
+	simulation->setRegionOfInterest(region);
+	simulation->loadTimestep(simulation->getCurrentTimestep());
+	restartPrefetching();
+}
+
 void MainWidget::triggeredAutoscale()
 {
-	double maximum = simulation->getMaximumValue();
-	double minimum = simulation->getMinimumValue();
+	autoscale(true);
+}
 
+void MainWidget::toggledAutoscaleEveryFrame(bool value)
+{
+	settings->setValue("autoscaleEveryFrame", value);
+
+	if (value) {
+		autoscale(false);
+	}
+}
+
+/**
+	sets the value range to the range of the current quantity
+
+	For a logarithmic scale only the positive values are used.
+
+	\param save store the new range in the settings
+*/
+void MainWidget::autoscale(bool save)
+{
+	if (simulation == NULL)
+		return;
+
+	const FieldStatistics* statistics = simulation->getStatistics();
+
+	if ((statistics == NULL) || (statistics->count == 0))
+		return;
+
+	if (openGLWidget->getLogarithmic()) {
+		if (statistics->positiveCount > 0) {
+			setValueRange(statistics->positiveMinimum, statistics->positiveMaximum, save);
+		}
+	} else {
+		setValueRange(statistics->minimum, statistics->maximum, save);
+	}
+}
+
+void MainWidget::setValueRange(double minimum, double maximum, bool save)
+{
 	if (maximum > openGLWidget->getMinimumValue()) {
 		openGLWidget->setMaximumValue(maximum);
 		openGLWidget->setMinimumValue(minimum);
@@ -696,11 +1310,299 @@ void MainWidget::triggeredAutoscale()
 		openGLWidget->setMaximumValue(maximum);
 	}
 
-	settings->setValue("minimumValue", openGLWidget->getMinimumValue());
-	settings->setValue("maximumValue", openGLWidget->getMaximumValue());
+	if (save) {
+		settings->setValue("minimumValue", openGLWidget->getMinimumValue());
+		settings->setValue("maximumValue", openGLWidget->getMaximumValue());
+	}
+}
+
+/**
+	sets the value range to the range of the current quantity over all timesteps
+*/
+void MainWidget::triggeredAutoscaleWholeRun()
+{
+	if (simulation == NULL)
+		return;
+
+	FieldStatistics statistics;
+
+	if (!statisticsIndex->getStatistics(simulation->getQuantityType(), 0, simulation->getLastTimeStep(), &statistics)) {
+		triggeredBuildStatisticsIndex();
+		return;
+	}
+
+	if (openGLWidget->getLogarithmic()) {
+		if (statistics.positiveCount > 0) {
+			setValueRange(statistics.positiveMinimum, statistics.positiveMaximum, true);
+		}
+	} else if (statistics.count > 0) {
+		setValueRange(statistics.minimum, statistics.maximum, true);
+	}
+}
+
+/**
+	sets the value range to percentiles of the current quantity over a range of timesteps
+*/
+void MainWidget::triggeredAutoscalePercentiles()
+{
+	if (simulation == NULL)
+		return;
+
+	if (statisticsIndex->getNumberOfEntries(simulation->getQuantityType(), 0, simulation->getLastTimeStep()) == 0) {
+		triggeredBuildStatisticsIndex();
+		return;
+	}
+
+	bool ok;
+
+	int first = QInputDialog::getInt(this, tr("Autoscale to Percentiles"), tr("First timestep:"), 0, 0, simulation->getLastTimeStep(), 1, &ok);
+	if (!ok)
+		return;
+
+	int last = QInputDialog::getInt(this, tr("Autoscale to Percentiles"), tr("Last timestep:"), simulation->getLastTimeStep(), first, simulation->getLastTimeStep(), 1, &ok);
+	if (!ok)
+		return;
+
+	double lower = QInputDialog::getDouble(this, tr("Autoscale to Percentiles"), tr("Lower percentile:"), settings->value("lowerPercentile", 1.0).toDouble(), 0.0, 100.0, 2, &ok);
+	if (!ok)
+		return;
+
+	double upper = QInputDialog::getDouble(this, tr("Autoscale to Percentiles"), tr("Upper percentile:"), settings->value("upperPercentile", 99.0).toDouble(), lower, 100.0, 2, &ok);
+	if (!ok)
+		return;
+
+	settings->setValue("lowerPercentile", lower);
+	settings->setValue("upperPercentile", upper);
+
+	double minimum, maximum;
+
+	if (statisticsIndex->getPercentiles(simulation->getQuantityType(), first, last, lower, upper, openGLWidget->getLogarithmic(), &minimum, &maximum)) {
+		setValueRange(minimum, maximum, true);
+	} else {
+		QMessageBox msgBox;
+		msgBox.setText(QString("No values in timesteps %1 - %2!").arg(first).arg(last));
+		msgBox.exec();
+	}
+}
+
+/**
+	indexes all timesteps which are not indexed yet in the background
+*/
+void MainWidget::triggeredBuildStatisticsIndex()
+{
+	if (simulation == NULL)
+		return;
+
+	if (statisticsIndex->isRunning()) {
+		QMessageBox::information(this, tr("Statistics Index"), QString("Indexing timesteps, %1 of %2 done.").arg(statisticsIndex->getDone()).arg(statisticsIndex->getTotal()));
+		return;
+	}
+
+	statisticsIndex->start(false);
+
+	if (statisticsIndex->isRunning()) {
+		QMessageBox::information(this, tr("Statistics Index"), QString("Indexing %1 timesteps in the background.").arg(statisticsIndex->getTotal()));
+	}
 }
 
 void MainWidget::triggeredResetCamera()
 {
 	openGLWidget->resetCamera();
 }
+
+void MainWidget::toggledPlayReverse(bool value)
+{
+	direction = value ? -1 : 1;
+	restartPrefetching();
+}
+
+void MainWidget::triggeredSetPrefetchDepth()
+{
+	bool ok;
+	int value = QInputDialog::getInt(this, tr("Prefetch Depth"), tr("Number of timesteps to load in advance:"), prefetcher->getLookAhead(), 1, 1024, 1, &ok);
+
+	if (ok) {
+		prefetcher->setLookAhead(value);
+		settings->setValue("prefetchDepth", value);
+	}
+}
+
+void MainWidget::triggeredSetCacheBudget()
+{
+	bool ok;
+	int value = QInputDialog::getInt(this, tr("Cache Size"), tr("Memory for cached timesteps (MB):"), settings->value("cacheSize", 512).toUInt(), 0, 1024*1024, 64, &ok);
+
+	if (ok) {
+		settings->setValue("cacheSize", value);
+
+		if (simulation != NULL) {
+			simulation->getSnapshotCache()->setBudget((size_t)value*1024*1024);
+		}
+	}
+}
+
+void MainWidget::toggledFollow(bool value)
+{
+	settings->setValue("follow", value);
+
+	if (simulation != NULL) {
+		simulation->setFollow(value);
+	}
+}
+
+void MainWidget::toggledFollowJump(bool value)
+{
+	settings->setValue("followJump", value);
+}
+
+/**
+	extends the timeline when a running simulation wrote new timesteps
+*/
+void MainWidget::addedTimesteps()
+{
+	if (simulation == NULL)
+		return;
+
+	timelineSlider->setMaximum(simulation->getLastTimeStep());
+
+	// keep an existing index complete
+	if (!statisticsIndex->isRunning() && (statisticsIndex->getNumberOfEntries(simulation->getQuantityType(), 0, simulation->getLastTimeStep()) > 0)) {
+		statisticsIndex->start(false);
+	}
+
+	if (followJumpAction->isChecked() && !timer->isActive()) {
+		simulation->loadTimestep(simulation->getLastTimeStep());
+	}
+}
+
+void MainWidget::triggeredSetCompressedCache()
+{
+	QStringList modes;
+	modes << tr("Off") << tr("Lossless") << tr("Quantized");
+
+	bool ok;
+	int mode = settings->value("compressedCacheMode", CompressedCache::OFF).toInt();
+	QString item = QInputDialog::getItem(this, tr("Compressed Cache"), tr("Keep evicted timesteps compressed:"), modes, mode, false, &ok);
+
+	if (!ok)
+		return;
+
+	mode = modes.indexOf(item);
+
+	if (mode == CompressedCache::QUANTIZED) {
+		double errorBound = QInputDialog::getDouble(this, tr("Compressed Cache"), tr("Maximum error relative to largest value:"), settings->value("compressedCacheErrorBound", 1e-4).toDouble(), 0.0, 1.0, 6, &ok);
+
+		if (!ok)
+			return;
+
+		settings->setValue("compressedCacheErrorBound", errorBound);
+	}
+
+	if (mode != CompressedCache::OFF) {
+		int size = QInputDialog::getInt(this, tr("Compressed Cache"), tr("Memory for compressed timesteps (MB):"), settings->value("compressedCacheSize", 1024).toUInt(), 0, 1024*1024, 64, &ok);
+
+		if (!ok)
+			return;
+
+		settings->setValue("compressedCacheSize", size);
+	}
+
+	settings->setValue("compressedCacheMode", mode);
+
+	applyCompressedCacheSettings();
+}
+
+void MainWidget::applyCompressedCacheSettings()
+{
+	if (simulation == NULL)
+		return;
+
+	CompressedCache* compressed = simulation->getSnapshotCache()->getCompressedCache();
+
+	compressed->setMode((CompressedCache::Mode)settings->value("compressedCacheMode", CompressedCache::OFF).toInt(), settings->value("compressedCacheErrorBound", 1e-4).toDouble());
+	compressed->setBudget((size_t)settings->value("compressedCacheSize", 1024).toUInt()*1024*1024);
+}
+
+void MainWidget::triggeredPinRange()
+{
+	if (simulation == NULL)
+		return;
+
+	SnapshotCache* cache = simulation->getSnapshotCache();
+	bool ok;
+
+	int first = QInputDialog::getInt(this, tr("Pin Range"), tr("First timestep to keep in cache (-1 to unpin):"), cache->hasPinnedRange() ? (int)cache->getPinnedFirst() : (int)simulation->getCurrentTimestep(), -1, simulation->getLastTimeStep(), 1, &ok);
+
+	if (!ok)
+		return;
+
+	if (first < 0) {
+		cache->clearPinnedRange();
+		return;
+	}
+
+	int last = QInputDialog::getInt(this, tr("Pin Range"), tr("Last timestep to keep in cache:"), cache->hasPinnedRange() ? (int)cache->getPinnedLast() : first, first, simulation->getLastTimeStep(), 1, &ok);
+
+	if (ok) {
+		cache->setPinnedRange(first, last);
+	}
+}
+
+void MainWidget::triggeredPlaybackStatistics()
+{
+	QString text = QString("Prefetch depth: %1\nPrefetch hits: %2\nPrefetch stalls: %3\nPrefetch misses: %4").arg(prefetcher->getLookAhead()).arg(prefetcher->getHits()).arg(prefetcher->getStalls()).arg(prefetcher->getMisses());
+
+	if (simulation != NULL) {
+		SnapshotCache* cache = simulation->getSnapshotCache();
+
+		text += QString("\n\nCached timesteps: %1\nCache usage: %2 of %3 MB\nCache hits: %4\nCache misses: %5\nCache evictions: %6")
+			.arg(cache->getNumberOfEntries())
+			.arg(cache->getUsage()/(1024*1024))
+			.arg(cache->getBudget()/(1024*1024))
+			.arg(cache->getHits())
+			.arg(cache->getMisses())
+			.arg(cache->getEvictions());
+
+		if (cache->hasPinnedRange()) {
+			text += QString("\nPinned timesteps: %1 - %2").arg(cache->getPinnedFirst()).arg(cache->getPinnedLast());
+		}
+
+		const FARGO* fargo = dynamic_cast<const FARGO*>(simulation);
+
+		if (fargo != NULL) {
+			text += QString("\nGrid data read: %1 MB (copied: %2 MB)")
+				.arg(fargo->getBytesRead()/(1024.0*1024.0), 0, 'f', 1)
+				.arg(fargo->getBytesCopied()/(1024.0*1024.0), 0, 'f', 1);
+		}
+
+		unsigned int indexed = statisticsIndex->getNumberOfEntries(simulation->getQuantityType(), 0, simulation->getLastTimeStep());
+		text += QString("\nIndexed timesteps: %1 of %2").arg(indexed).arg(simulation->getLastTimeStep() + 1);
+
+		if (statisticsIndex->isRunning()) {
+			text += QString(" (indexing %1 of %2)").arg(statisticsIndex->getDone()).arg(statisticsIndex->getTotal());
+		}
+
+		CompressedCache* compressed = cache->getCompressedCache();
+
+		if (compressed->getMode() != CompressedCache::OFF) {
+			text += QString("\n\nCompressed timesteps: %1\nCompressed usage: %2 of %3 MB\nCompression ratio: %4\nCompressed hits: %5\nCompressed misses: %6\nDecode throughput: %7 MB/s")
+				.arg(compressed->getNumberOfEntries())
+				.arg(compressed->getUsage()/(1024*1024))
+				.arg(compressed->getBudget()/(1024*1024))
+				.arg(compressed->getCompressionRatio(), 0, 'f', 2)
+				.arg(compressed->getHits())
+				.arg(compressed->getMisses())
+				.arg(compressed->getDecodeThroughput()/(1024*1024), 0, 'f', 0);
+		}
+
+		size_t geometry, quadGeometry, stream;
+		openGLWidget->getDiskMemoryUsage(&geometry, &quadGeometry, &stream);
+
+		text += QString("\n\nDisk geometry: %1 MB (as quads with normals: %2 MB)\nDisk colors and values: %3 MB")
+			.arg(geometry/(1024.0*1024.0), 0, 'f', 1)
+			.arg(quadGeometry/(1024.0*1024.0), 0, 'f', 1)
+			.arg(stream/(1024.0*1024.0), 0, 'f', 1);
+	}
+
+	QMessageBox::information(this, tr("Playback Statistics"), text);
+}
@@ -20,6 +20,8 @@
 #include "OpenGLWidget.h"
 #include "PaletteWidget.h"
 #include "Simulation.h"
+#include "Prefetcher.h"
+#include "StatisticsIndex.h"
 
 class MainWidget : public QWidget
 {
@@ -53,6 +55,10 @@ class MainWidget : public QWidget
 		void triggeredAbout();
 		void triggeredEditPalette();
 		void triggeredSetWindowSize();
+		void triggeredSetScreenshotOutput();
+		void toggledRecordVideo(bool value);
+		void toggledUseShaders(bool value);
+		void toggledMeshFreeDisk(bool value);
 		void changedTimeline(int value);
 		void fpsUpdate();
 		void skipUpdate();
@@ -61,20 +67,48 @@ class MainWidget : public QWidget
 		void toggledQuantityDensity(bool value);
 		void toggledQuantityVRadial(bool value);
 		void toggledQuantityVAzimuthal(bool value);
+		void toggledQuantityVorticity(bool value);
+		void toggledQuantityVortensity(bool value);
+		void toggledQuantityToomreQ(bool value);
+		void toggledQuantityMassFlux(bool value);
+		void toggledQuantityExpression(bool value);
+		void triggeredSetExpression();
+		void toggledPreloadQuantity(bool value);
 		void toogledSetLogarithmic(bool value);
 		void triggeredSetMinimumValue();
 		void triggeredSetMaximumValue();
 		void triggeredAutoscale();
+		void toggledAutoscaleEveryFrame(bool value);
+		void triggeredAutoscaleWholeRun();
+		void triggeredAutoscalePercentiles();
+		void triggeredBuildStatisticsIndex();
 		void triggeredResetCamera();
+		void toggledPlayReverse(bool value);
+		void triggeredSetPrefetchDepth();
+		void triggeredSetCacheBudget();
+		void triggeredSetCompressedCache();
+		void toggledFollow(bool value);
+		void toggledFollowJump(bool value);
+		void addedTimesteps();
+		void triggeredPinRange();
+		void triggeredPlaybackStatistics();
+		void toggledVisibleRegion(bool value);
+		void applyVisibleRegion();
 
 	private:
 		void createMenu();
 		void createButtons();
+		void restartPrefetching();
+		void applyCompressedCacheSettings();
+		void autoscale(bool save);
+		void setValueRange(double minimum, double maximum, bool save);
+		int setExpression(const QString& text, QString* error);
 
 		QMenuBar* menuBar;
 
 		QMenu* fileMenu;
 		QMenu* quantityMenu;
+		QMenu* preloadMenu;
 		QMenu* viewMenu;
 		QMenu* optionsMenu;
 		QMenu* helpMenu;
@@ -95,17 +129,44 @@ class MainWidget : public QWidget
 		QAction* showDiskBorderAction;
 		QAction* showKeyAction;
 		QAction* useMultisampling;
+		QAction* useShadersAction;
+		QAction* meshFreeDiskAction;
+		QAction* levelOfDetailAction;
+		QAction* levelOfDetailExtremaAction;
 		QAction* saveScreenshotsAction;
+		QAction* setScreenshotOutputAction;
+		QAction* recordVideoAction;
 		QAction* setWindowSizeAction;
 		QAction* setLogarithmicAction;
 		QAction* setMinimumValueAction;
 		QAction* setMaximumValueAction;
 		QAction* autoscaleAction;
+		QAction* autoscaleEveryFrameAction;
+		QAction* autoscaleWholeRunAction;
+		QAction* autoscalePercentilesAction;
+		QAction* buildStatisticsIndexAction;
+		QAction* playReverseAction;
+		QAction* loopAction;
+		QAction* followAction;
+		QAction* followJumpAction;
+		QAction* setPrefetchDepthAction;
+		QAction* setCacheBudgetAction;
+		QAction* setCompressedCacheAction;
+		QAction* pinRangeAction;
+		QAction* playbackStatisticsAction;
+		QAction* visibleRegionAction;
 		QAction* editPaletteAction;
 		QAction* quantityDensityAction;
 		QAction* quantityTemperatureAction;
 		QAction* quantityVRadialAction;
 		QAction* quantityVAzimuthalAction;
+		QAction* quantityVorticityAction;
+		QAction* quantityVortensityAction;
+		QAction* quantityToomreQAction;
+		QAction* quantityMassFluxAction;
+		QAction* quantityExpressionAction;
+		QAction* setExpressionAction;
+		QAction* preloadActions[Simulation::N_QUANTITY_TYPES];
 
 		QToolButton* playPauseButton;
 		QToolButton* stopButton;
@@ -126,12 +187,18 @@ class MainWidget : public QWidget
 		QVBoxLayout* mainLayout;
 
 		QTimer* timer;
+		// waits for the camera to settle before loading another region
+		QTimer* regionTimer;
 
 		QSettings* settings;
 
 		Simulation* simulation;
+		Prefetcher* prefetcher;
+		StatisticsIndex* statisticsIndex;
+		VideoWriter* videoWriter;
 		double fps;
 		unsigned int skip;
+		int direction;
 
 	protected:
 
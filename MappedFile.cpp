@@ -0,0 +1,122 @@
+#include "MappedFile.h"
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::MappedFile()
+{
+	data = NULL;
+	size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+/**
+	maps a file read-only into memory
+
+	\param filename file to map
+	\returns 0 on success, -1 if the file cannot be opened or mapped
+*/
+int MappedFile::open(const char* filename)
+{
+	close();
+
+	int fd = ::open(filename, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+
+	struct stat filestatus;
+	if ((fstat(fd, &filestatus) < 0) || (filestatus.st_size == 0)) {
+		::close(fd);
+		return -1;
+	}
+
+	void* address = mmap(NULL, filestatus.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	// the mapping stays valid after the descriptor is closed
+	::close(fd);
+
+	if (address == MAP_FAILED) {
+		return -1;
+	}
+
+	data = address;
+	size = filestatus.st_size;
+
+	return 0;
+}
+
+void MappedFile::close()
+{
+	if (data != NULL) {
+		munmap(data, size);
+	}
+
+	data = NULL;
+	size = 0;
+}
+
+/**
+	gives the kernel a hint how a range of the mapping will be accessed
+
+	\param advice access pattern
+	\param offset start of range in bytes
+	\param length length of range in bytes (0 means up to the end of the file)
+*/
+void MappedFile::advise(Advice advice, size_t offset, size_t length) const
+{
+	if ((data == NULL) || (offset >= size))
+		return;
+
+	if ((length == 0) || (offset + length > size)) {
+		length = size - offset;
+	}
+
+	// madvise wants a page aligned start address
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	size_t alignedOffset = offset - offset % pageSize;
+	length += offset - alignedOffset;
+
+	int flag;
+	switch (advice) {
+		case SEQUENTIAL:
+			flag = MADV_SEQUENTIAL;
+			break;
+
+		case RANDOM:
+			flag = MADV_RANDOM;
+			break;
+
+		case WILLNEED:
+			flag = MADV_WILLNEED;
+			break;
+
+		case DONTNEED:
+			flag = MADV_DONTNEED;
+			break;
+
+		default:
+			flag = MADV_NORMAL;
+			break;
+	}
+
+	madvise((char*)data + alignedOffset, length, flag);
+}
+
+void MappedFile::swap(MappedFile& other)
+{
+	void* tempData = data;
+	size_t tempSize = size;
+
+	data = other.data;
+	size = other.size;
+
+	other.data = tempData;
+	other.size = tempSize;
+}
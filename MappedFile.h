@@ -0,0 +1,41 @@
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include <stddef.h>
+
+/**
+	read-only memory mapping of a whole file
+*/
+class MappedFile
+{
+	public:
+		enum Advice {
+			NORMAL,
+			SEQUENTIAL,
+			RANDOM,
+			WILLNEED,
+			DONTNEED
+		};
+
+		MappedFile();
+		~MappedFile();
+
+		int open(const char* filename);
+		void close();
+		void advise(Advice advice, size_t offset = 0, size_t length = 0) const;
+		void swap(MappedFile& other);
+
+		inline bool isOpen() const { return data != NULL; }
+		inline const void* getData() const { return data; }
+		inline size_t getSize() const { return size; }
+
+	private:
+		void* data;
+		size_t size;
+
+		// not copyable
+		MappedFile(const MappedFile&);
+		MappedFile& operator=(const MappedFile&);
+};
+
+#endif
@@ -7,12 +7,121 @@
 #endif
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <float.h>
 #include <QWheelEvent>
+#include <QGLFramebufferObject>
+#include <QTimer>
+#include <vector>
+#include <algorithm>
 
 GLuint textures[1];
 
+// generic attribute of the raw values (0 would alias gl_Vertex)
+static const GLuint valueAttribute = 1;
+
+/**
+	position in the palette from the raw value, lighting like the fixed
+	function pipeline with GL_COLOR_MATERIAL (global ambient plus diffuse
+	light 0) if GL_LIGHTING is on
+*/
+static const char* const diskVertexShader =
+	"#version 120\n"
+	"attribute float value;\n"
+	"uniform float offset;\n"
+	"uniform float scale;\n"
+	"uniform bool logarithmic;\n"
+	"uniform float size;\n"
+	"uniform bool lit;\n"
+	"varying float position;\n"
+	"varying vec3 lighting;\n"
+	"void main()\n"
+	"{\n"
+	"	float x = value;\n"
+	"	if (logarithmic) {\n"
+	"		x = value > 0.0 ? log2(value) : offset - 1.0;\n"
+	"	}\n"
+	"	position = clamp((x - offset)*scale + 0.5, 0.5, size - 0.5);\n"
+	"	lighting = vec3(1.0);\n"
+	"	if (lit) {\n"
+	"		vec3 normal = normalize(gl_NormalMatrix*gl_Normal);\n"
+	"		vec3 vertex = vec3(gl_ModelViewMatrix*gl_Vertex);\n"
+	"		vec3 light = normalize(gl_LightSource[0].position.xyz - vertex);\n"
+	"		lighting = gl_LightModel.ambient.rgb + gl_LightSource[0].diffuse.rgb*max(dot(normal, light), 0.0);\n"
+	"	}\n"
+	"	gl_Position = ftransform();\n"
+	"}\n";
+
+/**
+	annulus in the disk plane, the fragment shader finds the vertex row of
+	the radius in the row texture and samples the field texture
+*/
+static const char* const annulusVertexShader =
+	"#version 120\n"
+	"uniform bool lit;\n"
+	"varying vec2 planePosition;\n"
+	"varying vec3 lighting;\n"
+	"void main()\n"
+	"{\n"
+	"	planePosition = gl_Vertex.xy;\n"
+	"	lighting = vec3(1.0);\n"
+	"	if (lit) {\n"
+	"		vec3 normal = normalize(gl_NormalMatrix*gl_Normal);\n"
+	"		vec3 vertex = vec3(gl_ModelViewMatrix*gl_Vertex);\n"
+	"		vec3 light = normalize(gl_LightSource[0].position.xyz - vertex);\n"
+	"		lighting = gl_LightModel.ambient.rgb + gl_LightSource[0].diffuse.rgb*max(dot(normal, light), 0.0);\n"
+	"	}\n"
+	"	gl_Position = ftransform();\n"
+	"}\n";
+
+static const char* const annulusFragmentShader =
+	"#version 120\n"
+	"uniform sampler2D field;\n"
+	"uniform sampler1D rows;\n"
+	"uniform sampler1D palette;\n"
+	"uniform float rMin;\n"
+	"uniform float rMax;\n"
+	"uniform float rowSamples;\n"
+	"uniform vec2 fieldSize;\n"
+	"uniform float columnsPerRadian;\n"
+	"uniform float offset;\n"
+	"uniform float scale;\n"
+	"uniform bool logarithmic;\n"
+	"uniform float size;\n"
+	"varying vec2 planePosition;\n"
+	"varying vec3 lighting;\n"
+	"void main()\n"
+	"{\n"
+	"	float r = length(planePosition);\n"
+	"	if ((r < rMin) || (r > rMax)) {\n"
+	"		discard;\n"
+	"	}\n"
+	"	float u = (r - rMin)/(rMax - rMin);\n"
+	"	float row = texture1D(rows, (u*(rowSamples - 1.0) + 0.5)/rowSamples).r;\n"
+	"	float column = atan(planePosition.y, planePosition.x)*columnsPerRadian;\n"
+	"	float value = texture2D(field, vec2((column + 0.5)/fieldSize.x, (row + 0.5)/fieldSize.y)).r;\n"
+	"	float x = value;\n"
+	"	if (logarithmic) {\n"
+	"		x = value > 0.0 ? log2(value) : offset - 1.0;\n"
+	"	}\n"
+	"	float position = clamp((x - offset)*scale + 0.5, 0.5, size - 0.5);\n"
+	"	vec4 color = texture1D(palette, position/size);\n"
+	"	gl_FragColor = vec4(min(color.rgb*lighting, 1.0), color.a);\n"
+	"}\n";
+
+static const char* const diskFragmentShader =
+	"#version 120\n"
+	"uniform sampler1D palette;\n"
+	"uniform float size;\n"
+	"varying float position;\n"
+	"varying vec3 lighting;\n"
+	"void main()\n"
+	"{\n"
+	"	vec4 color = texture1D(palette, position/size);\n"
+	"	gl_FragColor = vec4(min(color.rgb*lighting, 1.0), color.a);\n"
+	"}\n";
+
 OpenGLWidget::OpenGLWidget(QWidget *parent)
 : OpenGLNavigationWidget(QGLFormat(QGL::SampleBuffers), parent), simulation(NULL)
 {
@@ -53,10 +162,57 @@ OpenGLWidget::OpenGLWidget(QWidget *parent)
 	initDone = false;
 
 	gridChanged = true;
+
+	diskLevels = NULL;
+	NDiskLevels = 0;
+	diskLevel = 0;
+	dataChanged = true;
+	paletteChanged = true;
+	streamChanged = true;
+	streamCollectScheduled = false;
+	supportPrimitiveRestart = false;
+	synchronousStream = false;
+	renderingImage = false;
+	fieldTextureSerial = 0;
+	rowsTextureLevel = -1;
+	meshFreeDisk = false;
+	annulusProgram = 0;
+	maximumTextureSize = 0;
+	useShaders = true;
+	diskProgram = 0;
+	paletteTexture = 0;
+	levelOfDetail = true;
+	levelOfDetailPixels = 2.0;
+
+	visibleBounded = false;
+	visibleRMin = 0.0;
+	visibleRMax = 0.0;
+	visiblePhiMin = 0.0;
+	visiblePhiWidth = 2.0*M_PI;
+
+	saveScreenshots = false;
+	screenshotWriter = new ScreenshotWriter;
+	videoWriter = NULL;
+	for (unsigned int i = 0; i < NReadbacks; ++i) {
+		readbacks[i].buffer = 0;
+		readbacks[i].bufferSize = 0;
+		readbacks[i].pending = false;
+	}
+	nextReadback = 0;
+	supportAsyncReadback = false;
+	collectScheduled = false;
 }
 
 OpenGLWidget::~OpenGLWidget()
 {
+	// write the screenshots still in flight
+	makeCurrent();
+	cleanUpReadbacks();
+	delete screenshotWriter;
+
+	cleanUpShaders();
+	diskStream.cleanUp();
+
 	// cleanUp
 	this->setSimulation(NULL);
 
@@ -80,6 +236,7 @@ void OpenGLWidget::setSimulation(Simulation* simulation)
 	resetCamera();
 
 	gridChanged = true;
+	dataChanged = true;
 
 	update();
 }
@@ -151,6 +308,15 @@ void OpenGLWidget::initializeGL()
 		fprintf(stderr, "Error: %s\n", glewGetErrorString(err));
 	}
 
+	initShaders();
+	diskStream.init();
+
+	// otherwise the bands of a chunk are joined by degenerate triangles
+	supportPrimitiveRestart = GLEW_VERSION_3_1;
+
+	// fences tell when a readback into a pixel buffer is done
+	supportAsyncReadback = (GLEW_VERSION_3_2 || GLEW_ARB_sync) && (GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object);
+
 
 	initSky();
 
@@ -207,14 +373,201 @@ void OpenGLWidget::renderParticles()
 	if (simulation == NULL)
 		return;
 
+	if (simulation->getNumberOfParticles() == 0)
+		return;
+
 	glColor3f(0.5,0.5,0.5);
 	glPointSize(2.0);
-	glBegin(GL_POINTS);
-	for (unsigned int i = 0; i < simulation->getNumberOfParticles(); ++i) {
-		glVertex3f(simulation->getParticlePosition(i)[0], simulation->getParticlePosition(i)[1], 0);
+
+	// positions are stored as x,y pairs, so draw them directly
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(2, GL_DOUBLE, 0, simulation->getParticlePositions());
+	glDrawArrays(GL_POINTS, 0, simulation->getNumberOfParticles());
+	glDisableClientState(GL_VERTEX_ARRAY);
+
+}
+
+/**
+	compiles a shader, prints the log on failure
+
+	\returns the shader, 0 on failure
+*/
+static GLuint compileShader(GLenum type, const char* source)
+{
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+
+	GLint status;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+
+	if (status != GL_TRUE) {
+		char log[1024];
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		fprintf(stderr, "Could not compile shader: %s\n", log);
+		glDeleteShader(shader);
+		return 0;
 	}
-	glEnd();
 
+	return shader;
+}
+
+/**
+	compiles and links a program, the attribute "value" is bound to valueAttribute
+
+	\returns the program, 0 on failure
+*/
+static GLuint createProgram(const char* vertexSource, const char* fragmentSource)
+{
+	GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource);
+	GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+
+	if ((vertexShader == 0) || (fragmentShader == 0)) {
+		glDeleteShader(vertexShader);
+		glDeleteShader(fragmentShader);
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	glBindAttribLocation(program, valueAttribute, "value");
+	glLinkProgram(program);
+
+	// the program keeps them
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	GLint status;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+
+	if (status != GL_TRUE) {
+		char log[1024];
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		fprintf(stderr, "Could not link shader program: %s\n", log);
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+/**
+	creates the programs coloring the disk from raw values, without GLSL 1.20
+	(OpenGL 2.1) the disk is colored on the CPU, without float textures there
+	is no mesh-free disk
+*/
+void OpenGLWidget::initShaders()
+{
+	diskProgram = 0;
+	annulusProgram = 0;
+	paletteTexture = 0;
+	fieldTexture = 0;
+	rowsTexture = 0;
+
+	if (!GLEW_VERSION_2_1) {
+		return;
+	}
+
+	GLuint program = createProgram(diskVertexShader, diskFragmentShader);
+	if (program == 0) {
+		return;
+	}
+
+	diskProgram = program;
+	diskOffsetLocation = glGetUniformLocation(program, "offset");
+	diskScaleLocation = glGetUniformLocation(program, "scale");
+	diskLogarithmicLocation = glGetUniformLocation(program, "logarithmic");
+	diskPaletteLocation = glGetUniformLocation(program, "palette");
+	diskLitLocation = glGetUniformLocation(program, "lit");
+
+	// the size is fixed
+	glUseProgram(program);
+	glUniform1f(glGetUniformLocation(program, "size"), (GLfloat)Colormap::tableSize);
+	glUseProgram(0);
+
+	glGenTextures(1, &paletteTexture);
+	glBindTexture(GL_TEXTURE_1D, paletteTexture);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_1D, 0);
+
+	// upload the table with the next frame
+	paletteChanged = true;
+
+	if (!GLEW_VERSION_3_0 && !GLEW_ARB_texture_float) {
+		return;
+	}
+
+	program = createProgram(annulusVertexShader, annulusFragmentShader);
+	if (program == 0) {
+		return;
+	}
+
+	annulusProgram = program;
+	annulus.offset = glGetUniformLocation(program, "offset");
+	annulus.scale = glGetUniformLocation(program, "scale");
+	annulus.logarithmic = glGetUniformLocation(program, "logarithmic");
+	annulus.lit = glGetUniformLocation(program, "lit");
+	annulus.rMin = glGetUniformLocation(program, "rMin");
+	annulus.rMax = glGetUniformLocation(program, "rMax");
+	annulus.fieldSize = glGetUniformLocation(program, "fieldSize");
+	annulus.columnsPerRadian = glGetUniformLocation(program, "columnsPerRadian");
+
+	// texture units and sizes are fixed
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "palette"), 0);
+	glUniform1i(glGetUniformLocation(program, "field"), 1);
+	glUniform1i(glGetUniformLocation(program, "rows"), 2);
+	glUniform1f(glGetUniformLocation(program, "size"), (GLfloat)Colormap::tableSize);
+	glUniform1f(glGetUniformLocation(program, "rowSamples"), (GLfloat)rowSamples);
+	glUseProgram(0);
+
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maximumTextureSize);
+
+	glGenTextures(1, &fieldTexture);
+	glBindTexture(GL_TEXTURE_2D, fieldTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenTextures(1, &rowsTexture);
+	glBindTexture(GL_TEXTURE_1D, rowsTexture);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_1D, 0);
+}
+
+void OpenGLWidget::cleanUpShaders()
+{
+	if (diskProgram != 0) {
+		glDeleteProgram(diskProgram);
+		diskProgram = 0;
+	}
+
+	if (paletteTexture != 0) {
+		glDeleteTextures(1, &paletteTexture);
+		paletteTexture = 0;
+	}
+
+	if (annulusProgram != 0) {
+		glDeleteProgram(annulusProgram);
+		annulusProgram = 0;
+	}
+
+	if (fieldTexture != 0) {
+		glDeleteTextures(1, &fieldTexture);
+		fieldTexture = 0;
+	}
+
+	if (rowsTexture != 0) {
+		glDeleteTextures(1, &rowsTexture);
+		rowsTexture = 0;
+	}
 }
 
 void OpenGLWidget::initEverything() {
@@ -389,111 +742,360 @@ void OpenGLWidget::renderRocheLobe()
 
 void OpenGLWidget::initDisk()
 {
-	unsigned int bufferSize;
-
 	if (simulation == NULL)
 		return;
 
-	unsigned int index;
+	// only the level sizes are computed here, levels are built when they are needed
+	pyramid.setSize(simulation->getNRadial(), simulation->getNAzimuthal());
+
+	NDiskLevels = pyramid.getNumberOfLevels();
+	diskLevels = new DiskLevel[NDiskLevels];
+
+	for (unsigned int level = 0; level < NDiskLevels; ++level) {
+		diskLevels[level].created = false;
+	}
+
+	diskLevel = 0;
+	rowsTextureLevel = -1;
+	dataChanged = true;
+}
+
+/**
+	creates vertices and indices of a level of detail, colors and values are
+	streamed by renderDisk
+
+	Vertices are only x and y (the normal is (0, 0, 1) everywhere). The band
+	between two rows is a triangle strip, the bands of a chunk are separated
+	by primitive restarts (OpenGL 3.1) or degenerate triangles. Indices are
+	relative to the first vertex of the chunk, so every chunk uses the same
+	indices, which are 16 bit as long as two rows have less than 65535
+	vertices.
+*/
+void OpenGLWidget::initDiskLevel(unsigned int level)
+{
+	DiskLevel& disk = diskLevels[level];
+	const unsigned int NRadial = pyramid.getNRadial(level);
+	const unsigned int NAzimuthal = pyramid.getNAzimuthal(level);
+	const size_t NVertices = (size_t)(NRadial+1)*NAzimuthal;
 
 	// vertices
-	glGenBuffers(1, &diskVerticesVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, diskVerticesVBO);
+	glGenBuffers(1, &disk.verticesVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, disk.verticesVBO);
 
-	bufferSize = 3*((simulation->getNRadial()+1)*simulation->getNAzimuthal())*sizeof(GLfloat);
-	GLfloat *bufferVertices = (GLfloat*)malloc(bufferSize);
+	size_t verticesSize = 2*NVertices*sizeof(GLfloat);
+	GLfloat *bufferVertices = (GLfloat*)malloc(verticesSize);
+
+	for (unsigned int nRadial = 0; nRadial <= NRadial; ++nRadial) {
+		double radius = simulation->getRadii()[pyramid.getRadialIndex(level, nRadial)];
+		GLfloat* row = &bufferVertices[2*(size_t)nRadial*NAzimuthal];
 
-	for (unsigned int nRadial = 0; nRadial <= simulation->getNRadial(); ++nRadial) {
-		for (unsigned int nAzimuthal = 0; nAzimuthal < simulation->getNAzimuthal(); ++nAzimuthal) {
-			index =  nRadial * simulation->getNAzimuthal() + nAzimuthal;
-			bufferVertices[3*index+0] = simulation->getRadii()[nRadial]*cos(2.0*M_PI/simulation->getNAzimuthal()*nAzimuthal);
-			bufferVertices[3*index+1] = simulation->getRadii()[nRadial]*sin(2.0*M_PI/simulation->getNAzimuthal()*nAzimuthal);
-			bufferVertices[3*index+2] = 0;
+		for (unsigned int nAzimuthal = 0; nAzimuthal < NAzimuthal; ++nAzimuthal) {
+			row[2*nAzimuthal+0] = radius*cos(2.0*M_PI/simulation->getNAzimuthal()*((size_t)nAzimuthal << level));
+			row[2*nAzimuthal+1] = radius*sin(2.0*M_PI/simulation->getNAzimuthal()*((size_t)nAzimuthal << level));
 		}
 	}
 
-	glBufferData(GL_ARRAY_BUFFER, bufferSize, bufferVertices, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, verticesSize, bufferVertices, GL_STATIC_DRAW);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	free(bufferVertices);
 
-	// indices
-	glGenBuffers(1, &diskIndicesVBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, diskIndicesVBO);
-
-	bufferSize = 4*((simulation->getNRadial())*simulation->getNAzimuthal())*sizeof(GLuint);
-	GLuint* bufferIndices = (GLuint*)malloc(bufferSize);
-
-	// set indices (tells open gl which vertices belong to a quad)
-	for (unsigned int nRadial = 0; nRadial < simulation->getNRadial(); ++nRadial) {
-		for (unsigned int nAzimuthal = 0; nAzimuthal < simulation->getNAzimuthal(); ++nAzimuthal) {
-			index = nRadial * simulation->getNAzimuthal() + nAzimuthal;
-			bufferIndices[4*index+0] = index;
-			bufferIndices[4*index+1] = index+simulation->getNAzimuthal();
-			if (nAzimuthal == simulation->getNAzimuthal()-1) {
-				bufferIndices[4*index+2] = index+1;
-				bufferIndices[4*index+3] = index+1-simulation->getNAzimuthal();
+	// indices of one chunk
+	if (2*NAzimuthal < 0xFFFF) {
+		disk.indexType = GL_UNSIGNED_SHORT;
+		disk.restartIndex = 0xFFFF;
+		disk.bandsPerChunk = 0xFFFF/NAzimuthal - 1;
+	} else {
+		disk.indexType = GL_UNSIGNED_INT;
+		disk.restartIndex = 0xFFFFFFFF;
+		disk.bandsPerChunk = max(1u, (1u << 20)/NAzimuthal);
+	}
+	disk.bandsPerChunk = min(disk.bandsPerChunk, NRadial);
+
+	const size_t NIndices = getDiskChunkIndices(NAzimuthal, disk.bandsPerChunk);
+	const size_t indexSize = (disk.indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+	std::vector<GLuint> indices;
+	indices.reserve(NIndices);
+
+	for (unsigned int band = 0; band < disk.bandsPerChunk; ++band) {
+		GLuint inner = band*NAzimuthal;
+		GLuint outer = inner + NAzimuthal;
+
+		if (band > 0) {
+			if (supportPrimitiveRestart) {
+				indices.push_back(disk.restartIndex);
 			} else {
-				bufferIndices[4*index+2] = index+simulation->getNAzimuthal()+1;
-				bufferIndices[4*index+3] = index+1;
+				// two more indices keep the winding of the next band
+				GLuint last = indices.back();
+				indices.push_back(last);
+				indices.push_back(inner);
 			}
 		}
+
+		for (unsigned int nAzimuthal = 0; nAzimuthal <= NAzimuthal; ++nAzimuthal) {
+			indices.push_back(inner + nAzimuthal % NAzimuthal);
+			indices.push_back(outer + nAzimuthal % NAzimuthal);
+		}
+	}
+
+	glGenBuffers(1, &disk.indicesVBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, disk.indicesVBO);
+
+	if (disk.indexType == GL_UNSIGNED_SHORT) {
+		std::vector<GLushort> shortIndices(indices.begin(), indices.end());
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, NIndices*indexSize, &shortIndices[0], GL_STATIC_DRAW);
+	} else {
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, NIndices*indexSize, &indices[0], GL_STATIC_DRAW);
 	}
 
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, bufferSize, bufferIndices, GL_STATIC_DRAW);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-	free(bufferIndices);
+	disk.memoryUsage = verticesSize + NIndices*indexSize;
+	disk.created = true;
+}
+
+/**
+	GPU memory of the disk for the levels created so far
 
-	// normals
-	glGenBuffers(1, &diskNormalsVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, diskNormalsVBO);
+	\param geometry vertices and indices
+	\param quadGeometry the same levels as quads with 32 bit indices and normals per vertex
+	\param stream colors or values in the stream slots
+*/
+void OpenGLWidget::getDiskMemoryUsage(size_t* geometry, size_t* quadGeometry, size_t* stream) const
+{
+	*geometry = 0;
+	*quadGeometry = 0;
+	*stream = diskStream.getMemoryUsage();
 
-	bufferSize = 3*((simulation->getNRadial()+1)*simulation->getNAzimuthal())*sizeof(GLfloat);
-	GLfloat *bufferNormals = (GLfloat*)malloc(bufferSize);
+	for (unsigned int level = 0; level < NDiskLevels; ++level) {
+		if (diskLevels[level].created) {
+			const size_t NVertices = (size_t)(pyramid.getNRadial(level)+1)*pyramid.getNAzimuthal(level);
+			const size_t NCells = (size_t)pyramid.getNRadial(level)*pyramid.getNAzimuthal(level);
 
-	for (unsigned int nRadial = 0; nRadial <= simulation->getNRadial(); ++nRadial) {
-		for (unsigned int nAzimuthal = 0; nAzimuthal < simulation->getNAzimuthal(); ++nAzimuthal) {
-			index =  nRadial * simulation->getNAzimuthal() + nAzimuthal;
-			bufferNormals[3*index+0] = 0.0;
-			bufferNormals[3*index+1] = 0.0;
-			bufferNormals[3*index+2] = 1.0;
+			*geometry += diskLevels[level].memoryUsage;
+			*quadGeometry += NVertices*2*3*sizeof(GLfloat) + NCells*4*sizeof(GLuint);
 		}
 	}
+}
 
-	glBufferData(GL_ARRAY_BUFFER, bufferSize, bufferNormals, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+/**
+	\returns number of indices of a chunk with bands strips
+*/
+size_t OpenGLWidget::getDiskChunkIndices(unsigned int NAzimuthal, unsigned int bands) const
+{
+	return (size_t)bands*2*(NAzimuthal+1) + (size_t)(bands-1)*(supportPrimitiveRestart ? 1 : 2);
+}
+
+/**
+	draws the triangle strips of a level chunk by chunk
 
-	free(bufferNormals);
+	\param data buffer with 4 bytes per vertex, colors or values (0 for none)
+	\param colors data holds colors, otherwise the values of valueAttribute
+*/
+void OpenGLWidget::drawDiskLevel(unsigned int level, GLuint data, bool colors)
+{
+	const DiskLevel& disk = diskLevels[level];
+	const unsigned int NRadial = pyramid.getNRadial(level);
+	const unsigned int NAzimuthal = pyramid.getNAzimuthal(level);
+
+	if (supportPrimitiveRestart) {
+		glEnable(GL_PRIMITIVE_RESTART);
+		glPrimitiveRestartIndex(disk.restartIndex);
+	}
 
-	// colors
-	glGenBuffers(1, &diskColorsVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, diskColorsVBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, disk.indicesVBO);
 
-	bufferSize = 4*((simulation->getNRadial()+1)*simulation->getNAzimuthal())*sizeof(GLfloat);
-	GLfloat *bufferColors = (GLfloat*)malloc(bufferSize);
+	for (unsigned int firstBand = 0; firstBand < NRadial; firstBand += disk.bandsPerChunk) {
+		const unsigned int bands = min(disk.bandsPerChunk, NRadial - firstBand);
+		const size_t firstVertex = (size_t)firstBand*NAzimuthal;
 
-	for (unsigned int nRadial = 0; nRadial <= simulation->getNRadial(); ++nRadial) {
-		for (unsigned int nAzimuthal = 0; nAzimuthal < simulation->getNAzimuthal(); ++nAzimuthal) {
-			index =  nRadial * simulation->getNAzimuthal() + nAzimuthal;
-			bufferColors[4*index+0] = 1.0;
-			bufferColors[4*index+1] = 1.0;
-			bufferColors[4*index+2] = 1.0;
-			bufferColors[4*index+3] = 1.0;
+		// the base vertex is in the pointers, so indices stay small
+		glBindBuffer(GL_ARRAY_BUFFER, disk.verticesVBO);
+		glVertexPointer(2, GL_FLOAT, 0, (const GLvoid*)(firstVertex*2*sizeof(GLfloat)));
+
+		if (data != 0) {
+			glBindBuffer(GL_ARRAY_BUFFER, data);
+
+			if (colors) {
+				glColorPointer(4, GL_UNSIGNED_BYTE, 0, (const GLvoid*)(firstVertex*4*sizeof(GLubyte)));
+			} else {
+				glVertexAttribPointer(valueAttribute, 1, GL_FLOAT, GL_FALSE, 0, (const GLvoid*)(firstVertex*sizeof(GLfloat)));
+			}
 		}
+
+		glDrawElements(GL_TRIANGLE_STRIP, getDiskChunkIndices(NAzimuthal, bands), disk.indexType, 0);
 	}
 
-	glBufferData(GL_ARRAY_BUFFER, bufferSize, bufferColors, GL_STATIC_DRAW);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-	free(bufferColors);
-
+	if (supportPrimitiveRestart) {
+		glDisable(GL_PRIMITIVE_RESTART);
+	}
 }
 
 void OpenGLWidget::cleanUpDisk()
 {
-	glDeleteBuffers(1, &diskVerticesVBO);
-	glDeleteBuffers(1, &diskIndicesVBO);
+	for (unsigned int level = 0; level < NDiskLevels; ++level) {
+		if (diskLevels[level].created) {
+			glDeleteBuffers(1, &diskLevels[level].verticesVBO);
+			glDeleteBuffers(1, &diskLevels[level].indicesVBO);
+		}
+	}
+
+	delete [] diskLevels;
+	diskLevels = NULL;
+	NDiskLevels = 0;
+
+	// the fill in flight reads the pyramid, which gets a new size
+	diskStream.collect(true);
+	diskStream.invalidate();
+	pyramidSnapshot.clear();
+	rowsTextureLevel = -1;
+}
+
+/**
+	chooses the coarsest level whose cells are still smaller than levelOfDetailPixels on screen
+
+	The cell size is taken at the point of the disk nearest to the camera, so
+	no part of the disk is shown coarser than that.
+*/
+unsigned int OpenGLWidget::chooseDiskLevel()
+{
+	if (!levelOfDetail || (NDiskLevels <= 1))
+		return 0;
+
+	const double* radii = simulation->getRadii();
+	const unsigned int NRadial = simulation->getNRadial();
+
+	// nearest point of the disk
+	double distanceInPlane = sqrt(cameraPosition[0]*cameraPosition[0] + cameraPosition[1]*cameraPosition[1]);
+	double radius = min(max(distanceInPlane, radii[0]), radii[NRadial]);
+	double distance = sqrt((distanceInPlane-radius)*(distanceInPlane-radius) + cameraPosition[2]*cameraPosition[2]);
+
+	if (distance <= 0.0)
+		return 0;
+
+	// size of a level 0 cell there
+	unsigned int nRadial = 0;
+	while ((nRadial < NRadial-1) && (radii[nRadial+1] < radius))
+		nRadial++;
+	double cellSize = min(radii[nRadial+1]-radii[nRadial], 2.0*M_PI*radius/simulation->getNAzimuthal());
+
+	// field of view is 60 degrees (see resizeGL)
+	double pixels = cellSize*height()/(2.0*distance*tan(M_PI/6.0));
+
+	unsigned int level = 0;
+	while ((level+1 < NDiskLevels) && (2.0*pixels <= levelOfDetailPixels)) {
+		pixels *= 2.0;
+		level++;
+	}
+
+	return level;
+}
+
+/**
+	finds the part of the disk plane which is in view
+
+	Rays through a raster of points of the viewport are intersected with the
+	plane. If one of them misses it (or hits it behind the far plane), the
+	view is not bounded.
+*/
+void OpenGLWidget::updateVisibleRegion()
+{
+	GLdouble modelview[16];
+	GLdouble projection[16];
+	GLint viewport[4];
+
+	glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
+	glGetDoublev(GL_PROJECTION_MATRIX, projection);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	const unsigned int samples = 16;
+	bool bounded = true;
+	double rMin = DBL_MAX;
+	double rMax = 0.0;
+	std::vector<double> angles;
+
+	for (unsigned int i = 0; (i <= samples) && bounded; ++i) {
+		for (unsigned int j = 0; (j <= samples) && bounded; ++j) {
+			GLdouble windowX = viewport[0] + (GLdouble)viewport[2]*i/samples;
+			GLdouble windowY = viewport[1] + (GLdouble)viewport[3]*j/samples;
+			GLdouble nearPoint[3], farPoint[3];
+
+			gluUnProject(windowX, windowY, 0.0, modelview, projection, viewport, &nearPoint[0], &nearPoint[1], &nearPoint[2]);
+			gluUnProject(windowX, windowY, 1.0, modelview, projection, viewport, &farPoint[0], &farPoint[1], &farPoint[2]);
+
+			double dz = farPoint[2] - nearPoint[2];
+			double t = fabs(dz) > 0.0 ? -nearPoint[2]/dz : -1.0;
+
+			if ((t < 0.0) || (t > 1.0)) {
+				bounded = false;
+				break;
+			}
+
+			double x = nearPoint[0] + t*(farPoint[0]-nearPoint[0]);
+			double y = nearPoint[1] + t*(farPoint[1]-nearPoint[1]);
+			double r = sqrt(x*x+y*y);
+
+			rMin = min(rMin, r);
+			rMax = max(rMax, r);
+			angles.push_back(atan2(y, x));
+		}
+	}
+
+	double phiMin = 0.0;
+	double phiWidth = 2.0*M_PI;
+
+	if (bounded) {
+		// the whole ring is in view if the center is
+		GLdouble centerX, centerY, centerZ;
+		gluProject(0.0, 0.0, 0.0, modelview, projection, viewport, &centerX, &centerY, &centerZ);
+
+		if ((centerX >= viewport[0]) && (centerX <= viewport[0]+viewport[2]) && (centerY >= viewport[1]) && (centerY <= viewport[1]+viewport[3]) && (centerZ >= 0.0) && (centerZ <= 1.0)) {
+			rMin = 0.0;
+		} else {
+			// the angles in view are all but the largest gap between them
+			std::sort(angles.begin(), angles.end());
+
+			double gap = angles.front() + 2.0*M_PI - angles.back();
+			phiMin = angles.front();
+
+			for (unsigned int i = 1; i < angles.size(); ++i) {
+				if (angles[i] - angles[i-1] > gap) {
+					gap = angles[i] - angles[i-1];
+					phiMin = angles[i];
+				}
+			}
+
+			phiWidth = 2.0*M_PI - gap;
+		}
+	}
+
+	if ((bounded != visibleBounded) || (bounded && ((rMin != visibleRMin) || (rMax != visibleRMax) || (phiMin != visiblePhiMin) || (phiWidth != visiblePhiWidth)))) {
+		visibleBounded = bounded;
+		visibleRMin = rMin;
+		visibleRMax = rMax;
+		visiblePhiMin = phiMin;
+		visiblePhiWidth = phiWidth;
+
+		emit visibleRegionChanged();
+	}
+}
+
+/**
+	returns the part of the disk plane in the last frame
+
+	\returns false if the view is not bounded (e.g. the horizon is visible)
+*/
+bool OpenGLWidget::getVisibleRegion(double* rMin, double* rMax, double* phiMin, double* phiWidth) const
+{
+	*rMin = visibleRMin;
+	*rMax = visibleRMax;
+	*phiMin = visiblePhiMin;
+	*phiWidth = visiblePhiWidth;
+
+	return visibleBounded;
 }
 
 void OpenGLWidget::initGrid()
@@ -504,133 +1106,346 @@ void OpenGLWidget::initGrid()
 	// nothing to be done here, as grid is already created by initDisk()
 }
 
-void OpenGLWidget::renderDisk()
+/**
+	hands new data to the pyramid, everything uploaded from it is outdated
+*/
+void OpenGLWidget::updatePyramid()
 {
-	if (simulation == NULL)
-		return;
+	if (dataChanged) {
+		pyramidSnapshot = simulation->getCurrentSnapshot();
+		pyramid.setGrid(simulation->getQuantity());
+		dataChanged = false;
+		streamChanged = true;
+	}
+}
 
-	unsigned int index;
+/**
+	bakes the palette into the lookup table and its texture if it changed
+*/
+void OpenGLWidget::updatePaletteTable()
+{
+	if (paletteChanged) {
+		colormap.setPalette(*palette);
+		paletteChanged = false;
+		gridChanged = true;
+
+		if (paletteTexture != 0) {
+			glBindTexture(GL_TEXTURE_1D, paletteTexture);
+			glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, Colormap::tableSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, colormap.getTable());
+			glBindTexture(GL_TEXTURE_1D, 0);
+		}
+	}
+}
 
-	if (gridChanged) {
-		// colors
-		glBindBuffer(GL_ARRAY_BUFFER, diskColorsVBO);
+/**
+	values of a level of detail (as floats) or their colors for the disk stream
+*/
+class LevelFill : public StreamBuffer::Fill
+{
+	public:
+		/**
+			\param colormap colors of the values, NULL for the values themselves
+		*/
+		LevelFill(GridPyramid* pyramid, unsigned int level, const SnapshotPointer& snapshot, const Colormap* colormap, double minimumValue, double maximumValue, bool logarithmic) : pyramid(pyramid), level(level), snapshot(snapshot), colormap(colormap), minimumValue(minimumValue), maximumValue(maximumValue), logarithmic(logarithmic)
+		{
+		}
 
-		unsigned int bufferSize = 4*((simulation->getNRadial()+1)*simulation->getNAzimuthal())*sizeof(GLfloat);
-		GLfloat *bufferColors = (GLfloat*)malloc(bufferSize);
+		void fill(void* data)
+		{
+			const size_t count = (size_t)(pyramid->getNRadial(level)+1)*pyramid->getNAzimuthal(level);
+			const double* quantity = pyramid->getLevel(level);
 
-		// set colors
-		if (simulation->getQuantity() != NULL) {
-			for (unsigned int nRadial = 0; nRadial <= simulation->getNRadial(); ++nRadial) {
-				for (unsigned int nAzimuthal = 0; nAzimuthal < simulation->getNAzimuthal(); ++nAzimuthal) {
-					index =  nRadial * simulation->getNAzimuthal() + nAzimuthal;
-					diskColor(&bufferColors[4*index], simulation->getQuantity()[index], minimumValue, maximumValue, logarithmicScale);
+			if (quantity == NULL) {
+				memset(data, 0, 4*count);
+			} else if (colormap != NULL) {
+				colormap->map(quantity, count, (unsigned char*)data, minimumValue, maximumValue, logarithmic);
+			} else {
+				GLfloat* values = (GLfloat*)data;
+
+				for (size_t i = 0; i < count; ++i) {
+					values[i] = quantity[i];
 				}
 			}
+		}
+
+	private:
+		GridPyramid* pyramid;
+		unsigned int level;
+		// keeps level 0 alive
+		SnapshotPointer snapshot;
+		const Colormap* colormap;
+		double minimumValue;
+		double maximumValue;
+		bool logarithmic;
+};
+
+/**
+	brings the colors (or raw values) of a level into the disk stream
+
+	New data of the same level, i.e. a new timestep or new colors, is filled
+	by the worker while the last complete slot is drawn, so that frame may be
+	one timestep behind. Another level and synchronousStream wait for the
+	fill. The pyramid and the colormap are only changed while no fill is in
+	flight.
+
+	\returns true if the newest slot holds the level
+*/
+bool OpenGLWidget::streamDiskLevel(unsigned int level, bool colors)
+{
+	const int key = (level << 1) | (colors ? 1 : 0);
+	const bool wait = synchronousStream || (diskStream.getKey() != key);
+
+	if (diskStream.isBusy()) {
+		diskStream.collect(wait);
+
+		if (diskStream.isBusy()) {
+			return true;
+		}
+	}
+
+	updatePyramid();
+	updatePaletteTable();
+
+	if (!streamChanged && !(colors && gridChanged) && (diskStream.getKey() == key)) {
+		return true;
+	}
+
+	LevelFill* fill = new LevelFill(&pyramid, level, pyramidSnapshot, colors ? &colormap : NULL, minimumValue, maximumValue, logarithmicScale);
+	size_t size = 4*(size_t)(pyramid.getNRadial(level)+1)*pyramid.getNAzimuthal(level);
+
+	if (diskStream.start(fill, size, key, wait) == 0) {
+		streamChanged = false;
+		if (colors) {
 			gridChanged = false;
 		}
+	}
+
+	// paint again when the fill is done (or a slot is free)
+	if ((diskStream.isBusy() || !wait) && !streamCollectScheduled) {
+		streamCollectScheduled = true;
+		QTimer::singleShot(5, this, SLOT(collectDiskStream()));
+	}
 
-		glBufferData(GL_ARRAY_BUFFER, bufferSize, bufferColors, GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return diskStream.getKey() == key;
+}
+
+void OpenGLWidget::collectDiskStream()
+{
+	streamCollectScheduled = false;
 
-		free(bufferColors);
+	// the slot is unmapped while painting
+	if (diskStream.isBusy() && !diskStream.isFinished()) {
+		streamCollectScheduled = true;
+		QTimer::singleShot(5, this, SLOT(collectDiskStream()));
+	} else {
+		update();
 	}
+}
+
+void OpenGLWidget::renderDisk()
+{
+	if ((simulation == NULL) || (diskLevels == NULL))
+		return;
+
+	const bool shaded = useShaders && (diskProgram != 0);
+
+	// raw values for the shaders, otherwise RGBA bytes from the lookup table
+	if (!streamDiskLevel(diskLevel, !shaded))
+		return;
 
 	glPushMatrix();
 
-	// activate arrays
+	// activate arrays, the normal is the same for all vertices
 	glEnableClientState(GL_VERTEX_ARRAY);
-	glEnableClientState(GL_NORMAL_ARRAY);
-	glEnableClientState(GL_COLOR_ARRAY);
+	glNormal3f(0.0f, 0.0f, 1.0f);
 
-	// bind VBOs and set data
-	glBindBuffer(GL_ARRAY_BUFFER, diskVerticesVBO);
-	glVertexPointer(3, GL_FLOAT, 0, 0);
+	if (shaded) {
+		double offset, scale;
+		Colormap::getTransform(minimumValue, maximumValue, logarithmicScale, &offset, &scale);
 
-	glBindBuffer(GL_ARRAY_BUFFER, diskNormalsVBO);
-	glNormalPointer(GL_FLOAT, 0, 0);
+		glUseProgram(diskProgram);
+		glUniform1f(diskOffsetLocation, offset);
+		glUniform1f(diskScaleLocation, scale);
+		glUniform1i(diskLogarithmicLocation, logarithmicScale ? 1 : 0);
+		glUniform1i(diskPaletteLocation, 0);
+		glUniform1i(diskLitLocation, glIsEnabled(GL_LIGHTING) ? 1 : 0);
 
-	glBindBuffer(GL_ARRAY_BUFFER, diskColorsVBO);
-	glColorPointer(4, GL_FLOAT, 0, 0);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_1D, paletteTexture);
 
-	// bind VBO for index array
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, diskIndicesVBO);
-	glDrawElements(GL_QUADS, 4*((simulation->getNRadial())*simulation->getNAzimuthal()), GL_UNSIGNED_INT, 0);
+		glEnableVertexAttribArray(valueAttribute);
+	} else {
+		glEnableClientState(GL_COLOR_ARRAY);
+	}
 
-	// bind with 0, so, switch back to normal pointer operation
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0); // for indices
+	drawDiskLevel(diskLevel, diskStream.getBuffer(), !shaded);
+	diskStream.fence();
 
 	// deactivate vertex array
 	glDisableClientState(GL_VERTEX_ARRAY);
-	glDisableClientState(GL_NORMAL_ARRAY);
-	glDisableClientState(GL_COLOR_ARRAY);
+
+	if (shaded) {
+		glDisableVertexAttribArray(valueAttribute);
+		glBindTexture(GL_TEXTURE_1D, 0);
+		glUseProgram(0);
+	} else {
+		glDisableClientState(GL_COLOR_ARRAY);
+	}
 
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
 	glPopMatrix();
 }
 
+/**
+	draws the disk as one annulus, the fragment shader samples the field
+
+	The field is a float texture of the level of detail (or the finest level
+	fitting into a texture), so neither vertices nor indices of the grid are
+	needed. Coarse levels with an odd number of columns are slightly
+	stretched in azimuth next to phi = 0.
+*/
+void OpenGLWidget::renderAnnulus()
+{
+	if ((simulation == NULL) || (diskLevels == NULL))
+		return;
+
+	unsigned int level = diskLevel;
+	while ((level + 1 < NDiskLevels) && ((pyramid.getNAzimuthal(level) > (unsigned int)maximumTextureSize) || (pyramid.getNRadial(level) + 1 > (unsigned int)maximumTextureSize))) {
+		++level;
+	}
+
+	if (!streamDiskLevel(level, false))
+		return;
+
+	const unsigned int rows = pyramid.getNRadial(level) + 1;
+	const unsigned int columns = pyramid.getNAzimuthal(level);
+	const double* radii = simulation->getRadii();
+	const double rMin = radii[0];
+	const double rMax = radii[simulation->getNRadial()];
+
+	if (fieldTextureSerial != diskStream.getSerial()) {
+		// the stream slot is the pixel buffer, the driver copies it
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, diskStream.getBuffer());
+		glBindTexture(GL_TEXTURE_2D, fieldTexture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE32F_ARB, columns, rows, 0, GL_LUMINANCE, GL_FLOAT, 0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		diskStream.fence();
+
+		fieldTextureSerial = diskStream.getSerial();
+	}
+
+	if (rowsTextureLevel != (int)level) {
+		// fractional row of evenly spaced radii (rows of coarse levels are not evenly spaced)
+		GLfloat *bufferRows = (GLfloat*)malloc(rowSamples*sizeof(GLfloat));
+		unsigned int row = 0;
+
+		for (unsigned int i = 0; i < rowSamples; ++i) {
+			double r = rMin + (rMax - rMin)*i/(rowSamples - 1);
+
+			while ((row + 2 < rows) && (radii[pyramid.getRadialIndex(level, row + 1)] <= r)) {
+				++row;
+			}
+
+			double r0 = radii[pyramid.getRadialIndex(level, row)];
+			double r1 = radii[pyramid.getRadialIndex(level, row + 1)];
+			double fraction = (r1 > r0) ? (r - r0)/(r1 - r0) : 0.0;
+
+			bufferRows[i] = row + min(max(fraction, 0.0), 1.0);
+		}
+
+		glBindTexture(GL_TEXTURE_1D, rowsTexture);
+		glTexImage1D(GL_TEXTURE_1D, 0, GL_LUMINANCE32F_ARB, rowSamples, 0, GL_LUMINANCE, GL_FLOAT, bufferRows);
+		glBindTexture(GL_TEXTURE_1D, 0);
+
+		free(bufferRows);
+
+		rowsTextureLevel = level;
+	}
+
+	double offset, scale;
+	Colormap::getTransform(minimumValue, maximumValue, logarithmicScale, &offset, &scale);
+
+	glUseProgram(annulusProgram);
+	glUniform1f(annulus.offset, offset);
+	glUniform1f(annulus.scale, scale);
+	glUniform1i(annulus.logarithmic, logarithmicScale ? 1 : 0);
+	glUniform1i(annulus.lit, glIsEnabled(GL_LIGHTING) ? 1 : 0);
+	glUniform1f(annulus.rMin, rMin);
+	glUniform1f(annulus.rMax, rMax);
+	glUniform2f(annulus.fieldSize, columns, rows);
+	glUniform1f(annulus.columnsPerRadian, simulation->getNAzimuthal()/(2.0*M_PI)/(1 << level));
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_1D, paletteTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, fieldTexture);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_1D, rowsTexture);
+
+	// the chords of the outer polygon must not cut off the disk
+	const double outer = rMax/cos(M_PI/annulusSegments);
+
+	glNormal3f(0.0f, 0.0f, 1.0f);
+	glBegin(GL_TRIANGLE_STRIP);
+	for (unsigned int i = 0; i <= annulusSegments; ++i) {
+		double phi = 2.0*M_PI*i/annulusSegments;
+		glVertex3d(rMin*cos(phi), rMin*sin(phi), 0.0);
+		glVertex3d(outer*cos(phi), outer*sin(phi), 0.0);
+	}
+	glEnd();
+
+	glBindTexture(GL_TEXTURE_1D, 0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_1D, 0);
+
+	glUseProgram(0);
+}
+
+/**
+	draws the rings and spokes of the level, without any indices
+*/
 void OpenGLWidget::renderGrid()
 {
-	if (simulation == NULL)
+	if ((simulation == NULL) || (diskLevels == NULL))
 		return;
 
-	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+	const DiskLevel& disk = diskLevels[diskLevel];
+	const unsigned int NRadial = pyramid.getNRadial(diskLevel);
+	const unsigned int NAzimuthal = pyramid.getNAzimuthal(diskLevel);
+
 	glEnable(GL_LINE_SMOOTH);
 	glPushMatrix();
 
 	// activate arrays
 	glEnableClientState(GL_VERTEX_ARRAY);
-	glEnableClientState(GL_NORMAL_ARRAY);
+	glNormal3f(0.0f, 0.0f, 1.0f);
+	glBindBuffer(GL_ARRAY_BUFFER, disk.verticesVBO);
 
-	// bind VBOs and set data
-	glBindBuffer(GL_ARRAY_BUFFER, diskVerticesVBO);
-	glVertexPointer(3, GL_FLOAT, 0, 0);
+	glColor3ub(0x80,0x80,0x80);
 
-	glBindBuffer(GL_ARRAY_BUFFER, diskNormalsVBO);
-	glNormalPointer(GL_FLOAT, 0, 0);
+	// rings are consecutive vertices
+	for (unsigned int nRadial = 0; nRadial <= NRadial; ++nRadial) {
+		glVertexPointer(2, GL_FLOAT, 0, (const GLvoid*)((size_t)nRadial*NAzimuthal*2*sizeof(GLfloat)));
+		glDrawArrays(GL_LINE_LOOP, 0, NAzimuthal);
+	}
 
-	glColor3ub(0x80,0x80,0x80);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, diskIndicesVBO);
-	glDrawElements(GL_QUADS, 4*((simulation->getNRadial())*simulation->getNAzimuthal()), GL_UNSIGNED_INT, 0);
+	// spokes are every NAzimuthal-th vertex
+	for (unsigned int nAzimuthal = 0; nAzimuthal < NAzimuthal; ++nAzimuthal) {
+		glVertexPointer(2, GL_FLOAT, NAzimuthal*2*sizeof(GLfloat), (const GLvoid*)((size_t)nAzimuthal*2*sizeof(GLfloat)));
+		glDrawArrays(GL_LINE_STRIP, 0, NRadial+1);
+	}
 
 	// bind with 0, so, switch back to normal pointer operation
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0); // for indices
 
 	glDisableClientState(GL_VERTEX_ARRAY);
-	glDisableClientState(GL_NORMAL_ARRAY);
 	glPopMatrix();
 	glDisable(GL_LINE_SMOOTH);
-	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-
-}
-
-void OpenGLWidget::diskColor(GLfloat* color, double value, double minValue, double maxValue, bool logarithmic)
-{
-	QColor qcolor;
-
-	if (logarithmic == false) {
-		value = min(value, maxValue);
-		value = max(value, minValue);
-		value = (value-minValue)/(maxValue-minValue);
-	} else {
-		if (minValue == 0)
-			minValue = DBL_EPSILON;
-		maxValue = log10(maxValue);
-		minValue = log10(minValue);
-		value = log10(value);
-		value = min(value, maxValue);
-		value = max(value, minValue);
-		value = (value-minValue)/(maxValue-minValue);
-	}
-
-	qcolor = palette->getColorNormalized(value);
-
-	color[0] = qcolor.redF();
-	color[1] = qcolor.greenF();
-	color[2] = qcolor.blueF();
-	color[3] = qcolor.alphaF();
 }
 
 void OpenGLWidget::initDiskBorder()
@@ -885,12 +1700,31 @@ void OpenGLWidget::paintGL()
 
 	// setup camera view
 	setupCamera();
+	updateVisibleRegion();
 
 	if (showSky)
 		renderSky();
 
-	if (showDisk)
-		renderDisk();
+	// saved frames must show the current timestep
+	synchronousStream = saveScreenshots || (videoWriter != NULL) || renderingImage;
+
+	// the mesh-free disk needs the buffers of the level only for the grid
+	const bool annulusDisk = meshFreeDisk && (annulusProgram != 0);
+
+	if ((simulation != NULL) && (diskLevels != NULL)) {
+		diskLevel = chooseDiskLevel();
+
+		if (!diskLevels[diskLevel].created && (!annulusDisk || showGrid))
+			initDiskLevel(diskLevel);
+	}
+
+	if (showDisk) {
+		if (annulusDisk) {
+			renderAnnulus();
+		} else {
+			renderDisk();
+		}
+	}
 
 	if (showGrid)
 		renderGrid();
@@ -918,6 +1752,10 @@ void OpenGLWidget::paintGL()
 		if (simulation != NULL) {
 			glColor3f(1.0,1.0,1.0);
 			renderText(width()-120, 20, QString("Timestep: %1").arg(simulation->getCurrentTimestep()), QFont("Helvetica", 12, QFont::Bold) );
+
+			if (diskLevel > 0) {
+				renderText(width()-120, 40, QString("Level: %1").arg(diskLevel), QFont("Helvetica", 10));
+			}
 		}
 	}
 
@@ -927,17 +1765,213 @@ void OpenGLWidget::paintGL()
 
 	glFlush();
 
-	if (saveScreenshots && (simulation != NULL)) {
-		char temp[200];
-		sprintf(temp, "/tmp/image_%i.png", simulation->getCurrentTimestep());
-		QString filename = temp;
+	if ((saveScreenshots || (videoWriter != NULL)) && (simulation != NULL)) {
+		captureScreenshot();
+	}
+}
+
+/**
+	starts reading back the current frame
+
+	The pixels are copied into a pixel buffer by the GPU while we go on, a
+	fence tells when they can be mapped. Only if all buffers of the ring are
+	in flight we wait for the oldest one.
+*/
+void OpenGLWidget::captureScreenshot()
+{
+	unsigned int timestep = simulation->getCurrentTimestep();
+
+	if (!supportAsyncReadback) {
+		deliverFrame(grabFrameBuffer(), timestep);
+		return;
+	}
+
+	// finish what is ready, in order
+	collectScreenshots(false);
+
+	Readback& readback = readbacks[nextReadback];
+	if (readback.pending) {
+		finishReadback(readback, true);
+	}
+
+	readback.width = width();
+	readback.height = height();
+	readback.timestep = timestep;
+
+	GLsizeiptr size = (GLsizeiptr)readback.width*readback.height*4;
+
+	if (readback.buffer == 0) {
+		glGenBuffers(1, &readback.buffer);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+	if (readback.bufferSize != size) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		readback.bufferSize = size;
+	}
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, readback.width, readback.height, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readback.pending = true;
+	glFlush();
+
+	nextReadback = (nextReadback + 1) % NReadbacks;
 
-		// get image
-		QImage image = grabFrameBuffer();
-		image.save(filename, "PNG");
+	// the last frames of a playback have no following frame to collect them
+	if (!collectScheduled) {
+		collectScheduled = true;
+		QTimer::singleShot(20, this, SLOT(collectPendingScreenshots()));
 	}
 }
 
+/**
+	hands the pixels of a readback to the screenshot writer
+
+	\param wait wait for the GPU, otherwise nothing is done if the readback is not finished
+	\returns true if the readback was finished
+*/
+bool OpenGLWidget::finishReadback(Readback& readback, bool wait)
+{
+	GLenum status;
+	do {
+		status = glClientWaitSync(readback.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 100000000 : 0);
+	} while (wait && (status == GL_TIMEOUT_EXPIRED));
+
+	if (status == GL_TIMEOUT_EXPIRED) {
+		return false;
+	}
+
+	glDeleteSync(readback.fence);
+	readback.pending = false;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+	const uchar* pixels = (const uchar*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+
+	if (pixels != NULL) {
+		// BGRA as 8_8_8_8_REV is 0xAARRGGBB in native byte order, rows are bottom up
+		QImage image(pixels, readback.width, readback.height, QImage::Format_RGB32);
+		deliverFrame(image.mirrored(), readback.timestep);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	} else {
+		fprintf(stderr, "Could not map screenshot of timestep %u.\n", readback.timestep);
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	return true;
+}
+
+void OpenGLWidget::deliverFrame(const QImage& image, unsigned int timestep)
+{
+	if (saveScreenshots) {
+		screenshotWriter->write(image, timestep);
+	}
+
+	if (videoWriter != NULL) {
+		videoWriter->write(image);
+	}
+}
+
+/**
+	finishes the pending readbacks from the oldest on
+
+	\param wait wait for all of them, otherwise stop at the first one not ready
+*/
+void OpenGLWidget::collectScreenshots(bool wait)
+{
+	for (unsigned int i = 0; i < NReadbacks; ++i) {
+		Readback& readback = readbacks[(nextReadback + i) % NReadbacks];
+
+		if (readback.pending && !finishReadback(readback, wait)) {
+			return;
+		}
+	}
+}
+
+bool OpenGLWidget::hasPendingScreenshots() const
+{
+	for (unsigned int i = 0; i < NReadbacks; ++i) {
+		if (readbacks[i].pending) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void OpenGLWidget::collectPendingScreenshots()
+{
+	collectScheduled = false;
+
+	if (!hasPendingScreenshots()) {
+		return;
+	}
+
+	makeCurrent();
+	collectScreenshots(false);
+
+	if (hasPendingScreenshots()) {
+		collectScheduled = true;
+		QTimer::singleShot(20, this, SLOT(collectPendingScreenshots()));
+	}
+}
+
+/**
+	writes all pending screenshots and frees the pixel buffers, the context must be current
+*/
+void OpenGLWidget::cleanUpReadbacks()
+{
+	collectScreenshots(true);
+
+	for (unsigned int i = 0; i < NReadbacks; ++i) {
+		if (readbacks[i].buffer != 0) {
+			glDeleteBuffers(1, &readbacks[i].buffer);
+			readbacks[i].buffer = 0;
+			readbacks[i].bufferSize = 0;
+		}
+	}
+
+	screenshotWriter->waitForDone();
+}
+
+/**
+	renders the current state into an image without showing the widget
+
+	The frame is drawn into a framebuffer object of the context of the
+	widget, so the widget does not need to be visible (used by the batch
+	renderer).
+
+	\returns the image, a null image if there is no usable context
+*/
+QImage OpenGLWidget::renderImage(int width, int height)
+{
+	// a hidden widget gets no resize events, width() and height() are used while painting
+	resize(width, height);
+
+	glInit();
+
+	if (!isValid() || !QGLFramebufferObject::hasOpenGLFramebufferObjects()) {
+		fprintf(stderr, "No OpenGL context with framebuffer objects available.\n");
+		return QImage();
+	}
+
+	makeCurrent();
+
+	QGLFramebufferObject framebuffer(width, height, QGLFramebufferObject::Depth);
+	framebuffer.bind();
+
+	resizeGL(width, height);
+	renderingImage = true;
+	paintGL();
+	renderingImage = false;
+
+	framebuffer.release();
+
+	return framebuffer.toImage();
+}
+
 void OpenGLWidget::updateShowDisk(bool value)
 {
 	showDisk = value;
@@ -1004,9 +2038,43 @@ void OpenGLWidget::updateUseMultisampling(bool value)
 	update();
 }
 
+void OpenGLWidget::updateMeshFreeDisk(bool value)
+{
+	meshFreeDisk = value;
+	update();
+}
+
+void OpenGLWidget::updateUseShaders(bool value)
+{
+	useShaders = value;
+	update();
+}
+
 void OpenGLWidget::updateSaveScreenshots(bool value)
 {
+	if (!value) {
+		// frames captured so far are still written
+		makeCurrent();
+		collectScreenshots(true);
+		screenshotWriter->waitForDone();
+	}
+
 	saveScreenshots = value;
+
+	update();
+}
+
+/**
+	\param writer open video writer, NULL to stop sending frames (the caller closes it)
+*/
+void OpenGLWidget::setVideoWriter(VideoWriter* writer)
+{
+	// frames captured so far go to the old writer
+	makeCurrent();
+	collectScreenshots(true);
+
+	videoWriter = writer;
+
 	update();
 }
 
@@ -1043,9 +2111,43 @@ void OpenGLWidget::setMaximumValue(double value)
 	update();
 }
 
+void OpenGLWidget::updateLevelOfDetail(bool value)
+{
+	levelOfDetail = value;
+	update();
+}
+
+void OpenGLWidget::updateLevelOfDetailExtrema(bool value)
+{
+	// the fill in flight reads the pyramid
+	diskStream.waitForFill();
+	pyramid.setReduction(value ? GridPyramid::EXTREMA : GridPyramid::MEAN);
+	streamChanged = true;
+	update();
+}
+
+/**
+	colors have to be recomputed, e.g. because the palette or range changed
+*/
 void OpenGLWidget::updateFromGrid()
 {
 	gridChanged = true;
 	update();
 }
 
+void OpenGLWidget::updateFromPalette()
+{
+	paletteChanged = true;
+	updateFromGrid();
+}
+
+/**
+	the simulation has a new grid, so the coarse levels are recomputed as well
+*/
+void OpenGLWidget::updateFromData()
+{
+	dataChanged = true;
+	gridChanged = true;
+	update();
+}
+
@@ -8,6 +8,11 @@
 #include "RocheLobe.h"
 #include "Vector.h"
 #include "Matrix.h"
+#include "GridPyramid.h"
+#include "Colormap.h"
+#include "ScreenshotWriter.h"
+#include "VideoWriter.h"
+#include "StreamBuffer.h"
 
 class OpenGLWidget : public OpenGLNavigationWidget
 {
@@ -19,6 +24,9 @@ class OpenGLWidget : public OpenGLNavigationWidget
 		void setSimulation(Simulation *simulation);
 
 		inline Palette* getPalette() { return palette; }
+		inline ScreenshotWriter* getScreenshotWriter() { return screenshotWriter; }
+		// every painted frame is also sent to the video writer (NULL for none)
+		void setVideoWriter(VideoWriter* writer);
 
 		void setLogarithmic(bool value);
 		inline bool getLogarithmic() const { return logarithmicScale; }
@@ -26,6 +34,9 @@ class OpenGLWidget : public OpenGLNavigationWidget
 		void setMaximumValue(double value);
 		inline double getMinimumValue() const { return minimumValue; }
 		inline double getMaximumValue() const { return maximumValue; }
+		bool getVisibleRegion(double* rMin, double* rMax, double* phiMin, double* phiWidth) const;
+		void getDiskMemoryUsage(size_t* geometry, size_t* quadGeometry, size_t* stream) const;
+		QImage renderImage(int width, int height);
 
 	public slots:
 		void updateShowDisk(bool value);
@@ -39,8 +50,21 @@ class OpenGLWidget : public OpenGLNavigationWidget
 		void updateShowText(bool value);
 		void updateShowKey(bool value);
 		void updateUseMultisampling(bool value);
+		void updateUseShaders(bool value);
+		void updateMeshFreeDisk(bool value);
 		void updateSaveScreenshots(bool value);
+		void updateLevelOfDetail(bool value);
+		void updateLevelOfDetailExtrema(bool value);
 		void updateFromGrid();
+		void updateFromPalette();
+		void updateFromData();
+
+	signals:
+		void visibleRegionChanged();
+
+	private slots:
+		void collectPendingScreenshots();
+		void collectDiskStream();
 
 	protected:
 		void initializeGL();
@@ -54,16 +78,89 @@ class OpenGLWidget : public OpenGLNavigationWidget
 		void initEverything();
 		void cleanUpEverything();
 
-		// disk
+		// disk, geometry is created per level of detail when it is first drawn
 		bool showDisk;
-		GLuint diskVerticesVBO;
-		GLuint diskNormalsVBO;
-		GLuint diskColorsVBO;
-		GLuint diskIndicesVBO;
+		struct DiskLevel {
+			GLuint verticesVBO;
+			/// indices of one chunk, the same for all chunks
+			GLuint indicesVBO;
+			GLenum indexType;
+			GLuint restartIndex;
+			unsigned int bandsPerChunk;
+			/// bytes of the buffers
+			size_t memoryUsage;
+			bool created;
+		};
+		DiskLevel* diskLevels;
+		unsigned int NDiskLevels;
+		/// level drawn in the current frame
+		unsigned int diskLevel;
+		GridPyramid pyramid;
+		/// snapshot of the grid in the pyramid, keeps it alive for fills in flight
+		SnapshotPointer pyramidSnapshot;
+		bool dataChanged;
+		/// colors or raw values of the drawn level, filled by a worker thread
+		StreamBuffer diskStream;
+		/// the stream has to be filled again with the data of the pyramid
+		bool streamChanged;
+		bool streamCollectScheduled;
+		/// wait for fills, frames are saved or rendered offscreen
+		bool synchronousStream;
+		bool renderingImage;
+		bool streamDiskLevel(unsigned int level, bool colors);
+		bool levelOfDetail;
+		/// coarsest level is chosen so that cells are at most this many pixels
+		double levelOfDetailPixels;
 		void initDisk();
+		void initDiskLevel(unsigned int level);
+		size_t getDiskChunkIndices(unsigned int NAzimuthal, unsigned int bands) const;
+		void drawDiskLevel(unsigned int level, GLuint data, bool colors);
+		bool supportPrimitiveRestart;
 		void cleanUpDisk();
+		unsigned int chooseDiskLevel();
+		void updatePyramid();
+		void updatePaletteTable();
 		void renderDisk();
-		void diskColor(GLfloat* color, double value, double minValue, double maxValue, bool logarithmic);
+		/// lookup table of the palette, baked again when the palette changed
+		Colormap colormap;
+		bool paletteChanged;
+
+		// coloring in shaders from the raw values and the palette as texture
+		bool useShaders;
+		GLuint diskProgram;
+		GLint diskOffsetLocation;
+		GLint diskScaleLocation;
+		GLint diskLogarithmicLocation;
+		GLint diskPaletteLocation;
+		GLint diskLitLocation;
+		GLuint paletteTexture;
+		void initShaders();
+		void cleanUpShaders();
+
+		// mesh-free disk, an annulus colored from the field as a texture
+		static const unsigned int rowSamples = 4096;
+		static const unsigned int annulusSegments = 256;
+		bool meshFreeDisk;
+		GLuint annulusProgram;
+		struct AnnulusUniforms {
+			GLint offset;
+			GLint scale;
+			GLint logarithmic;
+			GLint lit;
+			GLint rMin;
+			GLint rMax;
+			GLint fieldSize;
+			GLint columnsPerRadian;
+		};
+		AnnulusUniforms annulus;
+		GLuint fieldTexture;
+		GLuint rowsTexture;
+		GLint maximumTextureSize;
+		/// serial of the stream slot in the field texture
+		unsigned int fieldTextureSerial;
+		/// level in the row texture (-1 if none)
+		int rowsTextureLevel;
+		void renderAnnulus();
 
 		// grid
 		bool showGrid;
@@ -109,6 +206,14 @@ class OpenGLWidget : public OpenGLNavigationWidget
 		void initSky();
 		void renderSky();
 
+		// part of the disk plane in view, phi from phiMin to phiMin+phiWidth
+		bool visibleBounded;
+		double visibleRMin;
+		double visibleRMax;
+		double visiblePhiMin;
+		double visiblePhiWidth;
+		void updateVisibleRegion();
+
 		// text
 		bool showText;
 
@@ -116,7 +221,31 @@ class OpenGLWidget : public OpenGLNavigationWidget
 		bool showKey;
 		void renderKey();
 
+		// screenshots and video frames, read back through pixel buffers and encoded by the writers
 		bool saveScreenshots;
+		ScreenshotWriter* screenshotWriter;
+		VideoWriter* videoWriter;
+		struct Readback {
+			GLuint buffer;
+			GLsizeiptr bufferSize;
+			GLsync fence;
+			unsigned int timestep;
+			int width;
+			int height;
+			bool pending;
+		};
+		static const unsigned int NReadbacks = 3;
+		/// ring of readbacks, nextReadback is the oldest one
+		Readback readbacks[NReadbacks];
+		unsigned int nextReadback;
+		bool supportAsyncReadback;
+		bool collectScheduled;
+		void captureScreenshot();
+		bool finishReadback(Readback& readback, bool wait);
+		void deliverFrame(const QImage& image, unsigned int timestep);
+		void collectScreenshots(bool wait);
+		bool hasPendingScreenshots() const;
+		void cleanUpReadbacks();
 		bool supportMultisampling;
 		bool useMultisampling;
 		Simulation* simulation;
@@ -0,0 +1,367 @@
+#include "Pack.h"
+#include <QByteArray>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char packMagic[4] = { 'F', 'V', 'P', 'K' };
+static const unsigned int packFormatVersion = 2;
+
+// header flags
+static const unsigned int flagTwamLayout = 1;
+
+Pack::Pack()
+{
+	fd = -1;
+	writeOffset = 0;
+
+	NRadial = 0;
+	NAzimuthal = 0;
+	NTimesteps = 0;
+	rMin = 0.0;
+	rMax = 0.0;
+	omegaFrame = 0.0;
+	twamLayout = false;
+}
+
+Pack::~Pack()
+{
+	close();
+}
+
+/**
+	checks if filename starts with the magic of a pack
+*/
+bool Pack::isPack(const char* filename)
+{
+	int fd = ::open(filename, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	char magic[4];
+	bool result = (::read(fd, magic, sizeof(magic)) == sizeof(magic)) && (memcmp(magic, packMagic, sizeof(magic)) == 0);
+
+	::close(fd);
+
+	return result;
+}
+
+/**
+	reads all from offset, retrying short reads
+*/
+int Pack::readAt(void* buffer, size_t size, unsigned long long offset) const
+{
+	char* position = (char*)buffer;
+
+	while (size > 0) {
+		ssize_t count = pread(fd, position, size, offset);
+
+		if (count < 0 && errno == EINTR)
+			continue;
+
+		if (count <= 0)
+			return -1;
+
+		position += count;
+		size -= count;
+		offset += count;
+	}
+
+	return 0;
+}
+
+int Pack::writeAt(const void* buffer, size_t size, unsigned long long offset)
+{
+	const char* position = (const char*)buffer;
+
+	while (size > 0) {
+		ssize_t count = pwrite(fd, position, size, offset);
+
+		if (count < 0 && errno == EINTR)
+			continue;
+
+		if (count <= 0)
+			return -1;
+
+		position += count;
+		size -= count;
+		offset += count;
+	}
+
+	return 0;
+}
+
+/**
+	opens a pack for reading and loads its metadata and chunk index
+
+	\returns 0 on success, -1 if the file cannot be read, -2 if it is no valid pack
+*/
+int Pack::open(const char* filename)
+{
+	close();
+
+	fd = ::open(filename, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Could not open '%s'.\n", filename);
+		return -1;
+	}
+
+	Header header;
+	if (readAt(&header, sizeof(header), 0) < 0) {
+		fprintf(stderr, "Could not read '%s'.\n", filename);
+		close();
+		return -1;
+	}
+
+	if ((memcmp(header.magic, packMagic, sizeof(packMagic)) != 0) || (header.formatVersion != packFormatVersion) || (header.indexOffset == 0)) {
+		fprintf(stderr, "'%s' is no valid pack.\n", filename);
+		close();
+		return -2;
+	}
+
+	// the counts of the header have to fit into the file before anything is allocated for them
+	struct stat filestatus;
+	if (fstat(fd, &filestatus) < 0) {
+		fprintf(stderr, "Could not read '%s'.\n", filename);
+		close();
+		return -1;
+	}
+
+	unsigned long long fileSize = filestatus.st_size;
+	unsigned long long metadataSize = sizeof(header) + ((unsigned long long)header.NRadial + 1 + 2ULL*header.NPlanets)*sizeof(double);
+
+	if ((header.NRadial == 0) || (header.NAzimuthal == 0) || (metadataSize > header.indexOffset) || (header.indexOffset > fileSize)
+		|| ((unsigned long long)header.NTimesteps*N_KINDS > (fileSize - header.indexOffset)/sizeof(Chunk))) {
+		fprintf(stderr, "'%s' is damaged.\n", filename);
+		close();
+		return -2;
+	}
+
+	NRadial = header.NRadial;
+	NAzimuthal = header.NAzimuthal;
+	NTimesteps = header.NTimesteps;
+	rMin = header.rMin;
+	rMax = header.rMax;
+	omegaFrame = header.omegaFrame;
+	twamLayout = (header.flags & flagTwamLayout) != 0;
+
+	radii.resize(NRadial+1);
+	planetMasses.resize(header.NPlanets);
+	planetRadii.resize(header.NPlanets);
+	chunks.resize((size_t)NTimesteps*N_KINDS);
+
+	unsigned long long offset = sizeof(header);
+	int ret = readAt(&radii[0], radii.size()*sizeof(double), offset);
+	offset += radii.size()*sizeof(double);
+
+	if ((ret == 0) && (header.NPlanets > 0)) {
+		ret = readAt(&planetMasses[0], header.NPlanets*sizeof(double), offset);
+		offset += header.NPlanets*sizeof(double);
+	}
+
+	if ((ret == 0) && (header.NPlanets > 0)) {
+		ret = readAt(&planetRadii[0], header.NPlanets*sizeof(double), offset);
+		offset += header.NPlanets*sizeof(double);
+	}
+
+	if ((ret == 0) && (chunks.size() > 0)) {
+		ret = readAt(&chunks[0], chunks.size()*sizeof(Chunk), header.indexOffset);
+	}
+
+	// chunks lie between the metadata and the index
+	for (size_t i = 0; (ret == 0) && (i < chunks.size()); ++i) {
+		if ((chunks[i].offset > 0) && ((chunks[i].offset < offset) || (chunks[i].storedSize > header.indexOffset - chunks[i].offset))) {
+			ret = -1;
+		}
+	}
+
+	if (ret < 0) {
+		fprintf(stderr, "'%s' is truncated or damaged.\n", filename);
+		close();
+		return -2;
+	}
+
+	return 0;
+}
+
+/**
+	creates a new pack with the metadata set before, chunks are added with writeChunk
+*/
+int Pack::create(const char* filename)
+{
+	close();
+
+	fd = ::open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "Could not create '%s'.\n", filename);
+		return -1;
+	}
+
+	chunks.clear();
+	chunks.resize((size_t)NTimesteps*N_KINDS);
+
+	// header is written again with the index offset by finish
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, packMagic, sizeof(packMagic));
+	header.formatVersion = packFormatVersion;
+
+	writeOffset = sizeof(header);
+
+	if ((writeAt(&header, sizeof(header), 0) < 0)
+		|| (writeAt(&radii[0], (NRadial+1)*sizeof(double), writeOffset) < 0)) {
+		fprintf(stderr, "Could not write '%s'.\n", filename);
+		return -1;
+	}
+	writeOffset += (NRadial+1)*sizeof(double);
+
+	if (planetMasses.size() > 0) {
+		if ((writeAt(&planetMasses[0], planetMasses.size()*sizeof(double), writeOffset) < 0)
+			|| (writeAt(&planetRadii[0], planetRadii.size()*sizeof(double), writeOffset + planetMasses.size()*sizeof(double)) < 0)) {
+			fprintf(stderr, "Could not write '%s'.\n", filename);
+			return -1;
+		}
+		writeOffset += 2*planetMasses.size()*sizeof(double);
+	}
+
+	return 0;
+}
+
+/**
+	appends a chunk
+
+	\param compressionLevel zlib level (1-9), 0 stores the chunk uncompressed
+*/
+int Pack::writeChunk(unsigned int timestep, unsigned int kind, const void* data, size_t size, int compressionLevel)
+{
+	if ((fd < 0) || (timestep >= NTimesteps) || (kind >= N_KINDS))
+		return -1;
+
+	Chunk& chunk = chunks[(size_t)timestep*N_KINDS + kind];
+
+	QByteArray compressed;
+	if (compressionLevel > 0) {
+		compressed = qCompress((const uchar*)data, size, compressionLevel);
+	}
+
+	// only keep compressed data if it is actually smaller
+	const void* stored = data;
+	size_t storedSize = size;
+	if ((compressed.size() > 0) && ((size_t)compressed.size() < size)) {
+		stored = compressed.constData();
+		storedSize = compressed.size();
+	}
+
+	if (writeAt(stored, storedSize, writeOffset) < 0) {
+		fprintf(stderr, "Could not write chunk of timestep %u.\n", timestep);
+		return -1;
+	}
+
+	chunk.offset = writeOffset;
+	chunk.storedSize = storedSize;
+	chunk.size = size;
+
+	writeOffset += storedSize;
+
+	return 0;
+}
+
+/**
+	writes chunk index and final header
+*/
+int Pack::finish()
+{
+	if (fd < 0)
+		return -1;
+
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, packMagic, sizeof(packMagic));
+	header.formatVersion = packFormatVersion;
+	header.NRadial = NRadial;
+	header.NAzimuthal = NAzimuthal;
+	header.NPlanets = planetMasses.size();
+	header.NTimesteps = NTimesteps;
+	header.flags = twamLayout ? flagTwamLayout : 0;
+	header.rMin = rMin;
+	header.rMax = rMax;
+	header.omegaFrame = omegaFrame;
+	header.indexOffset = writeOffset;
+
+	if (((chunks.size() > 0) && (writeAt(&chunks[0], chunks.size()*sizeof(Chunk), writeOffset) < 0))
+		|| (writeAt(&header, sizeof(header), 0) < 0)
+		|| (fsync(fd) < 0)) {
+		fprintf(stderr, "Could not write chunk index.\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+void Pack::close()
+{
+	if (fd >= 0) {
+		::close(fd);
+	}
+
+	fd = -1;
+	chunks.clear();
+}
+
+const Pack::Chunk* Pack::getChunk(unsigned int timestep, unsigned int kind) const
+{
+	if ((timestep >= NTimesteps) || (kind >= N_KINDS))
+		return NULL;
+
+	const Chunk* chunk = &chunks[(size_t)timestep*N_KINDS + kind];
+
+	return chunk->offset > 0 ? chunk : NULL;
+}
+
+bool Pack::hasChunk(unsigned int timestep, unsigned int kind) const
+{
+	return getChunk(timestep, kind) != NULL;
+}
+
+/**
+	returns the uncompressed size of a chunk in bytes (0 if it does not exist)
+*/
+size_t Pack::getChunkSize(unsigned int timestep, unsigned int kind) const
+{
+	const Chunk* chunk = getChunk(timestep, kind);
+
+	return chunk != NULL ? chunk->size : 0;
+}
+
+/**
+	reads and uncompresses a chunk, safe to call from several threads
+
+	\param buffer buffer to read into
+	\param size size of buffer, must be at least getChunkSize
+*/
+int Pack::readChunk(unsigned int timestep, unsigned int kind, void* buffer, size_t size) const
+{
+	const Chunk* chunk = getChunk(timestep, kind);
+
+	if ((chunk == NULL) || (chunk->size > size))
+		return -1;
+
+	if (chunk->storedSize == chunk->size) {
+		return readAt(buffer, chunk->size, chunk->offset);
+	}
+
+	QByteArray compressed(chunk->storedSize, Qt::Uninitialized);
+	if (readAt(compressed.data(), chunk->storedSize, chunk->offset) < 0)
+		return -1;
+
+	QByteArray uncompressed = qUncompress(compressed);
+	if ((size_t)uncompressed.size() != chunk->size)
+		return -1;
+
+	memcpy(buffer, uncompressed.constData(), chunk->size);
+
+	return 0;
+}
@@ -0,0 +1,93 @@
+#ifndef _PACK_H_
+#define _PACK_H_
+
+#include <vector>
+#include <stddef.h>
+#include "Simulation.h"
+
+/**
+	single file container for all output of a simulation
+
+	Layout (native byte order like the FARGO output itself):
+	- header with magic "FVPK", grid size, number of planets and timesteps,
+	  OmegaFrame and the offset of the chunk index
+	- radii (NRadial+1), planet masses and planet radii (NPlanets each)
+	- chunks, one per timestep and kind, optionally compressed with qCompress
+	- chunk index, offset, stored size and size for every timestep and kind
+
+	Grid chunks hold the values as in the FARGO files (without ghost cells),
+	planet chunks hold positions and then velocities (3 per planet), particle
+	chunks hold positions and velocities (x,y pairs) and then masses.
+*/
+class Pack
+{
+	public:
+		enum Kind {
+			PARTICLES = Simulation::N_GRID_TYPES,
+			PLANETS,
+			N_KINDS
+		};
+
+		Pack();
+		~Pack();
+
+		static bool isPack(const char* filename);
+
+		int open(const char* filename);
+		int create(const char* filename);
+		int finish();
+		void close();
+
+		bool hasChunk(unsigned int timestep, unsigned int kind) const;
+		size_t getChunkSize(unsigned int timestep, unsigned int kind) const;
+		int readChunk(unsigned int timestep, unsigned int kind, void* buffer, size_t size) const;
+		int writeChunk(unsigned int timestep, unsigned int kind, const void* data, size_t size, int compressionLevel);
+
+		// metadata, must be set before create
+		unsigned int NRadial;
+		unsigned int NAzimuthal;
+		unsigned int NTimesteps;
+		double rMin;
+		double rMax;
+		double omegaFrame;
+		bool twamLayout;
+		std::vector<double> radii;
+		std::vector<double> planetMasses;
+		std::vector<double> planetRadii;
+
+	private:
+		struct Header {
+			char magic[4];
+			unsigned int formatVersion;
+			unsigned int NRadial;
+			unsigned int NAzimuthal;
+			unsigned int NPlanets;
+			unsigned int NTimesteps;
+			unsigned int flags;
+			unsigned int reserved;
+			double rMin;
+			double rMax;
+			double omegaFrame;
+			unsigned long long indexOffset;
+		};
+
+		struct Chunk {
+			unsigned long long offset;
+			unsigned long long storedSize;
+			unsigned long long size;
+		};
+
+		int fd;
+		std::vector<Chunk> chunks;
+		unsigned long long writeOffset;
+
+		const Chunk* getChunk(unsigned int timestep, unsigned int kind) const;
+		int readAt(void* buffer, size_t size, unsigned long long offset) const;
+		int writeAt(const void* buffer, size_t size, unsigned long long offset);
+
+		// not copyable
+		Pack(const Pack&);
+		Pack& operator=(const Pack&);
+};
+
+#endif
@@ -0,0 +1,224 @@
+#include "PackedFARGO.h"
+#include "Pack.h"
+#include "Snapshot.h"
+#include "Catalog.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+PackedFARGO::PackedFARGO()
+{
+	pack = new Pack;
+}
+
+PackedFARGO::~PackedFARGO()
+{
+	delete pack;
+}
+
+int PackedFARGO::loadFromFile(const char* filename)
+{
+	if (pack->open(filename) < 0) {
+		return -1;
+	}
+
+	free(configFilename);
+	configFilename = (char*)malloc(1+strlen(filename));
+	strcpy(configFilename, filename);
+
+	// only used in messages
+	free(outputDirectory);
+	outputDirectory = (char*)malloc(1+strlen(filename));
+	strcpy(outputDirectory, filename);
+
+	version = pack->twamLayout ? FARGO_TWAM : FARGO_ORIGINAL;
+	rMin = pack->rMin;
+	rMax = pack->rMax;
+	omegaFrame = pack->omegaFrame;
+	NRadial = pack->NRadial;
+	NAzimuthal = pack->NAzimuthal;
+	totalTimestep = pack->NTimesteps > 0 ? pack->NTimesteps - 1 : 0;
+	currentTimestep = 0;
+
+	delete [] radii;
+	radii = new double[NRadial+1];
+	memcpy(radii, &pack->radii[0], (NRadial+1)*sizeof(double));
+
+	NPlanets = pack->planetMasses.size();
+	free(planetMasses);
+	free(planetRadii);
+	planetMasses = (double*)malloc(NPlanets*sizeof(double));
+	planetRadii = (double*)malloc(NPlanets*sizeof(double));
+	if (NPlanets > 0) {
+		memcpy(planetMasses, &pack->planetMasses[0], NPlanets*sizeof(double));
+		memcpy(planetRadii, &pack->planetRadii[0], NPlanets*sizeof(double));
+	}
+
+	// the catalog is built from the chunk index, so timestep lookups work as for directories
+	delete catalog;
+	catalog = new Catalog;
+	catalog->addDependency(filename, true);
+	catalog->NRadial = NRadial;
+	catalog->NAzimuthal = NAzimuthal;
+	catalog->totalTimestep = totalTimestep;
+	catalog->NPlanets = NPlanets;
+	catalog->planetPositions.assign(NPlanets*3, 0.0);
+	catalog->planetVelocities.assign(NPlanets*3, 0.0);
+
+	HasParticles = false;
+	NParticles = 0;
+
+	for (unsigned int timestep = 0; timestep <= totalTimestep; ++timestep) {
+		for (unsigned int kind = 0; kind < Catalog::N_KINDS; ++kind) {
+			if (pack->hasChunk(timestep, kind)) {
+				catalog->addTimestep(kind, timestep);
+			}
+		}
+
+		if (!HasParticles && pack->hasChunk(timestep, Pack::PARTICLES)) {
+			HasParticles = true;
+			NParticles = pack->getChunkSize(timestep, Pack::PARTICLES)/(5*sizeof(double));
+		}
+	}
+
+	if (catalog->getNumberOfGaps(quantityType) > 0) {
+		fprintf(stderr, "%u timesteps are missing in '%s'.\n", catalog->getNumberOfGaps(quantityType), filename);
+	}
+
+	createInitialSnapshot();
+
+	loadTimestep(0);
+
+	emit dataUpdated();
+
+	return 0;
+}
+
+/**
+	the statistics index of a pack is kept next to it
+*/
+char* PackedFARGO::getStatisticsFilename(bool cacheDirectory) const
+{
+	char* filename;
+
+	if (cacheDirectory)
+		return Catalog::getSidecarFilename(configFilename, "stats", true);
+
+	if (asprintf(&filename, "%s.stats", configFilename) < 0) {
+		fprintf(stderr, "Not enough memory!\n");
+		return NULL;
+	}
+
+	return filename;
+}
+
+/**
+	chunks may be compressed, so grids of a pack are always loaded completely
+*/
+void PackedFARGO::setRegionOfInterest(const Simulation::Region& /*region*/)
+{
+}
+
+/**
+	reads planets and particles of a timestep from their chunks
+*/
+int PackedFARGO::loadPlanetsAndParticles(Snapshot* snapshot, unsigned int timestep) const
+{
+	snapshot->resizePlanets(NPlanets);
+
+	if (NPlanets > 0) {
+		if (pack->getChunkSize(timestep, Pack::PLANETS) != NPlanets*6*sizeof(double)) {
+			fprintf(stderr, "Timestep %u was not in file!\n", timestep);
+			return -3;
+		}
+
+		double* planets = (double*)malloc(NPlanets*6*sizeof(double));
+
+		if (pack->readChunk(timestep, Pack::PLANETS, planets, NPlanets*6*sizeof(double)) < 0) {
+			fprintf(stderr, "Could not read planets of timestep %u from '%s'.\n", timestep, outputDirectory);
+			free(planets);
+			return -1;
+		}
+
+		memcpy(snapshot->planetPositions, planets, NPlanets*3*sizeof(double));
+		memcpy(snapshot->planetVelocities, planets + NPlanets*3, NPlanets*3*sizeof(double));
+		free(planets);
+	}
+
+	if (HasParticles) {
+		if (!pack->hasChunk(timestep, Pack::PARTICLES)) {
+			fprintf(stderr, "Timestep %u has no particles in '%s'.\n", timestep, outputDirectory);
+			return -1;
+		}
+
+		unsigned int n = pack->getChunkSize(timestep, Pack::PARTICLES)/(5*sizeof(double));
+		snapshot->resizeParticles(n);
+
+		if (n > 0) {
+			double* particles = (double*)malloc(n*5*sizeof(double));
+
+			if (pack->readChunk(timestep, Pack::PARTICLES, particles, n*5*sizeof(double)) < 0) {
+				fprintf(stderr, "Could not read particles of timestep %u from '%s'.\n", timestep, outputDirectory);
+				free(particles);
+				return -1;
+			}
+
+			memcpy(snapshot->particlePositions, particles, n*2*sizeof(double));
+			memcpy(snapshot->particleVelocities, particles + n*2, n*2*sizeof(double));
+			memcpy(snapshot->particleMasses, particles + n*4, n*sizeof(double));
+			free(particles);
+		}
+	}
+
+	return 0;
+}
+
+/**
+	reads the grid of one quantity of a timestep from its chunk
+*/
+int PackedFARGO::loadField(Snapshot* snapshot, QuantityType type, unsigned int timestep) const
+{
+	bool scalar = (type == DENSITY) || (type == TEMPERATURE);
+	size_t offset, count;
+	getGridLayout(scalar, &offset, &count);
+
+	if (pack->getChunkSize(timestep, type) != count*sizeof(double)) {
+		fprintf(stderr, "Timestep %u of quantity %u is not in '%s'.\n", timestep, type, outputDirectory);
+		return -1;
+	}
+
+	snapshot->resizeQuantity(type, (NRadial + 1)*NAzimuthal);
+	Snapshot::Field& field = snapshot->fields[type];
+	int ret;
+
+	if (scalar) {
+		double* cells = (double*)malloc(count*sizeof(double));
+
+		ret = pack->readChunk(timestep, type, cells, count*sizeof(double));
+		if (ret == 0) {
+			interpolateGrid(cells, field.buffer, &field.statistics);
+		}
+
+		free(cells);
+	} else {
+		ret = pack->readChunk(timestep, type, field.buffer, field.size*sizeof(double));
+
+		if (ret == 0) {
+			field.statistics.reset();
+			field.statistics.add(field.buffer, count);
+		}
+	}
+
+	if (ret < 0) {
+		fprintf(stderr, "Could not read timestep %u of quantity %u from '%s'.\n", timestep, type, outputDirectory);
+		return -1;
+	}
+
+	field.data = field.buffer;
+
+	statisticsMutex.lock();
+	bytesRead += count*sizeof(double);
+	statisticsMutex.unlock();
+
+	return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef _PACKEDFARGO_H_
+#define _PACKEDFARGO_H_
+
+#include "FARGO.h"
+
+class Pack;
+
+/**
+	FARGO simulation read from a pack written by FARGO::writePack
+
+	All timesteps are in one file, every chunk is found through the index of
+	the pack and read with a single pread.
+*/
+class PackedFARGO : public FARGO
+{
+	Q_OBJECT
+
+	public:
+		PackedFARGO();
+		~PackedFARGO();
+		int loadFromFile(const char* filename);
+		char* getStatisticsFilename(bool cacheDirectory) const;
+		void setRegionOfInterest(const Simulation::Region& region);
+
+	protected:
+		int loadPlanetsAndParticles(Snapshot* snapshot, unsigned int timestep) const;
+		int loadField(Snapshot* snapshot, Simulation::QuantityType type, unsigned int timestep) const;
+
+	private:
+		Pack* pack;
+};
+
+#endif
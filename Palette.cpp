@@ -28,7 +28,8 @@ QColor Palette::getColor(double value) const
 	if ((colorMap.size() == 1) || (pos == colorMap.begin())) {
 		ret = pos.value();
 	} else if (pos == colorMap.end()) {
-		ret = pos.value();
+		// above the last color
+		ret = (pos-1).value();
 	} else {
 		double factor = (value-(pos-1).key())/((pos.key())-((pos-1).key()));
 
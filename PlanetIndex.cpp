@@ -0,0 +1,229 @@
+#include "PlanetIndex.h"
+#include <stdlib.h>
+#include <string.h>
+
+// planet files are read in chunks of this size, longer lines are skipped
+static const size_t chunkSize = 1 << 20;
+
+PlanetIndex::PlanetIndex(QObject* parent)
+: QThread(parent)
+{
+	abort = false;
+	maximumTimestep = 0;
+}
+
+PlanetIndex::~PlanetIndex()
+{
+	mutex.lock();
+	abort = true;
+	mutex.unlock();
+
+	wait();
+
+	for (unsigned int i = 0; i < tables.size(); ++i) {
+		free(tables[i]->filename);
+		delete tables[i];
+	}
+}
+
+/**
+	adds a planet file to the index, must be called before start()
+*/
+void PlanetIndex::addFile(const char* filename)
+{
+	Table* table = new Table;
+	table->filename = strdup(filename);
+	table->offset = 0;
+
+	tables.push_back(table);
+}
+
+unsigned int PlanetIndex::getNumberOfFiles() const
+{
+	return tables.size();
+}
+
+/**
+	sets the last timestep of the simulation, so a broken planet file cannot make the index grow without bounds
+*/
+void PlanetIndex::setMaximumTimestep(unsigned int timestep)
+{
+	QMutexLocker locker(&mutex);
+	maximumTimestep = timestep;
+}
+
+bool PlanetIndex::isAborted()
+{
+	QMutexLocker locker(&mutex);
+	return abort;
+}
+
+/**
+	parses the complete lines of the next chunk of a planet file
+
+	Parsing stops at a line beyond the last timestep (and the slack), it is
+	parsed again once the simulation has got that far.
+
+	\param number number of file
+	\returns 1 if lines were parsed, 0 if there is nothing new, -1 if the file cannot be opened
+*/
+int PlanetIndex::parseChunk(unsigned int number)
+{
+	Table* table = tables[number];
+	QMutexLocker updateLocker(&table->updateMutex);
+
+	mutex.lock();
+	unsigned int lastTimestep = maximumTimestep + timestepSlack;
+	mutex.unlock();
+
+	FILE* fd = fopen(table->filename, "r");
+	if (fd == NULL) {
+		return -1;
+	}
+
+	if (fseek(fd, table->offset, SEEK_SET) < 0) {
+		fclose(fd);
+		return -1;
+	}
+
+	char* buffer = (char*)malloc(chunkSize+1);
+	size_t filled = fread(buffer, 1, chunkSize, fd);
+	buffer[filled] = 0;
+	fclose(fd);
+
+	std::vector<unsigned int> newTimesteps;
+	std::vector<double> newValues;
+
+	char* line = buffer;
+	char* end;
+	bool ahead = false;
+
+	// only parse complete lines, a partial last line is still being written
+	while ((end = (char*)memchr(line, '\n', buffer+filled-line)) != NULL) {
+		char* pos = line;
+		unsigned int timestep = strtoul(pos, &pos, 10);
+		double values[4];
+
+		bool valid = (pos != line);
+		for (unsigned int i = 0; (i < 4) && valid; ++i) {
+			char* next;
+			values[i] = strtod(pos, &next);
+			valid = (next != pos) && (next <= end);
+			pos = next;
+		}
+
+		if (valid && (timestep > lastTimestep)) {
+			ahead = true;
+			break;
+		}
+
+		if (valid) {
+			newTimesteps.push_back(timestep);
+			newValues.insert(newValues.end(), values, values+4);
+		}
+
+		line = end+1;
+	}
+
+	size_t parsed = line - buffer;
+
+	if ((parsed == 0) && !ahead && (filled == chunkSize)) {
+		// line longer than buffer, skip it
+		parsed = filled;
+	}
+
+	free(buffer);
+
+	// append new rows
+	mutex.lock();
+	for (unsigned int i = 0; i < newTimesteps.size(); ++i) {
+		unsigned int timestep = newTimesteps[i];
+
+		if (timestep >= table->rows.size()) {
+			table->rows.resize(timestep+1, -1);
+		}
+		table->rows[timestep] = table->x.size();
+
+		table->x.push_back(newValues[4*i+0]);
+		table->y.push_back(newValues[4*i+1]);
+		table->vx.push_back(newValues[4*i+2]);
+		table->vy.push_back(newValues[4*i+3]);
+	}
+	mutex.unlock();
+
+	table->offset += parsed;
+
+	return parsed > 0 ? 1 : 0;
+}
+
+/**
+	parses all complete lines which were appended to a planet file since the last call
+
+	\param number number of file
+	\returns 0 on success, -1 if the file cannot be opened
+*/
+int PlanetIndex::update(unsigned int number)
+{
+	int ret;
+
+	do {
+		ret = parseChunk(number);
+	} while ((ret > 0) && !isAborted());
+
+	return ret < 0 ? -1 : 0;
+}
+
+/**
+	gets position and velocity of a planet
+
+	\param number number of file
+	\param timestep timestep
+	\param position destination for x and y
+	\param velocity destination for v_x and v_y
+	\returns 0 on success, -1 if the file cannot be opened, -3 if timestep is not in file
+*/
+int PlanetIndex::lookup(unsigned int number, unsigned int timestep, double* position, double* velocity)
+{
+	Table* table = tables[number];
+
+	for (;;) {
+		mutex.lock();
+		if ((timestep < table->rows.size()) && (table->rows[timestep] >= 0)) {
+			int row = table->rows[timestep];
+			position[0] = table->x[row];
+			position[1] = table->y[row];
+			velocity[0] = table->vx[row];
+			velocity[1] = table->vy[row];
+			mutex.unlock();
+			return 0;
+		}
+		mutex.unlock();
+
+		// not parsed yet or file has grown, the background thread may parse the same file meanwhile
+		int ret = parseChunk(number);
+
+		if (ret < 0) {
+			return -1;
+		} else if (ret == 0) {
+			return -3;
+		}
+	}
+}
+
+/**
+	returns the last timestep parsed from a planet file
+*/
+unsigned int PlanetIndex::getLastTimestep(unsigned int number)
+{
+	QMutexLocker locker(&mutex);
+	Table* table = tables[number];
+
+	return table->rows.empty() ? 0 : table->rows.size()-1;
+}
+
+void PlanetIndex::run()
+{
+	for (unsigned int i = 0; (i < tables.size()) && !isAborted(); ++i) {
+		update(i);
+	}
+}
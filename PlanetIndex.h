@@ -0,0 +1,67 @@
+#ifndef _PLANETINDEX_H_
+#define _PLANETINDEX_H_
+
+#include <QThread>
+#include <QMutex>
+#include <vector>
+#include <stdio.h>
+
+/**
+	in-memory table of all planet files, indexed by timestep
+
+	Every planet file is parsed once (started in the background by start())
+	and extended incrementally if a requested timestep is not yet known, so
+	looking up the position of a planet costs O(1) instead of rescanning
+	the file. Files are parsed in chunks, a lookup takes turns with the
+	background thread and returns as soon as its timestep is known.
+*/
+class PlanetIndex : public QThread
+{
+	Q_OBJECT
+
+	public:
+		PlanetIndex(QObject* parent = 0);
+		~PlanetIndex();
+
+		void addFile(const char* filename);
+		unsigned int getNumberOfFiles() const;
+		void setMaximumTimestep(unsigned int timestep);
+
+		int update(unsigned int number);
+		int lookup(unsigned int number, unsigned int timestep, double* position, double* velocity);
+		unsigned int getLastTimestep(unsigned int number);
+
+	protected:
+		void run();
+
+	private:
+		// planet files of a running simulation may be ahead of the grid files
+		static const unsigned int timestepSlack = 1024;
+
+		struct Table {
+			char* filename;
+			/// serializes parsing of the file, protects offset
+			QMutex updateMutex;
+			/// number of bytes parsed so far
+			long offset;
+			/// row of each timestep, -1 if timestep is not in file
+			std::vector<int> rows;
+			std::vector<double> x;
+			std::vector<double> y;
+			std::vector<double> vx;
+			std::vector<double> vy;
+		};
+
+		std::vector<Table*> tables;
+
+		/// protects the rows of the tables, abort and maximumTimestep
+		QMutex mutex;
+		bool abort;
+		/// last timestep of the simulation, parsing stops at rows beyond it (and the slack)
+		unsigned int maximumTimestep;
+
+		bool isAborted();
+		int parseChunk(unsigned int number);
+};
+
+#endif
@@ -0,0 +1,239 @@
+#include "Prefetcher.h"
+#include "Snapshot.h"
+
+Prefetcher::Prefetcher(QObject* parent)
+: QThread(parent), simulation(NULL)
+{
+	lookAhead = 8;
+
+	abort = false;
+	active = false;
+	loading = false;
+	loadingTimestep = 0;
+	nextTimestep = 0;
+	stride = 1;
+	lastTimestep = 0;
+	quantityType = Simulation::DENSITY;
+	generation = 0;
+
+	resetStatistics();
+}
+
+Prefetcher::~Prefetcher()
+{
+	mutex.lock();
+	abort = true;
+	condition.wakeAll();
+	mutex.unlock();
+
+	wait();
+}
+
+/**
+	sets the simulation to load from, waits until a running load has finished
+*/
+void Prefetcher::setSimulation(Simulation* simulation)
+{
+	QMutexLocker locker(&mutex);
+
+	active = false;
+	generation++;
+	ready.clear();
+
+	while (loading) {
+		condition.wait(&mutex);
+	}
+
+	this->simulation = simulation;
+}
+
+/**
+	sets how many timesteps are decoded in advance
+*/
+void Prefetcher::setLookAhead(unsigned int value)
+{
+	QMutexLocker locker(&mutex);
+
+	lookAhead = value > 0 ? value : 1;
+
+	while ((unsigned int)ready.size() > lookAhead) {
+		ready.removeLast();
+	}
+
+	condition.wakeAll();
+}
+
+/**
+	starts decoding timesteps
+
+	\param timestep first timestep to decode
+	\param stride distance between two timesteps (negative for backward playback)
+*/
+void Prefetcher::startPlayback(unsigned int timestep, int stride)
+{
+	QMutexLocker locker(&mutex);
+
+	this->stride = stride;
+	restart(timestep);
+}
+
+void Prefetcher::stopPlayback()
+{
+	QMutexLocker locker(&mutex);
+
+	active = false;
+	generation++;
+	ready.clear();
+}
+
+/**
+	restarts the pipeline at timestep (mutex must be locked)
+*/
+void Prefetcher::restart(unsigned int timestep)
+{
+	generation++;
+	ready.clear();
+
+	if (simulation == NULL) {
+		active = false;
+		return;
+	}
+
+	nextTimestep = timestep;
+	lastTimestep = simulation->getLastTimeStep();
+	quantityType = simulation->getQuantityType();
+	active = true;
+
+	condition.wakeAll();
+}
+
+/**
+	returns the decoded snapshot of timestep
+
+	If timestep is currently being decoded, this waits for it (stall). If it
+	is not part of the prefetched sequence, a null pointer is returned (miss)
+	and the pipeline restarts behind timestep, so the caller has to load the
+	timestep itself.
+*/
+SnapshotPointer Prefetcher::take(unsigned int timestep)
+{
+	QMutexLocker locker(&mutex);
+	bool stalled = false;
+
+	if ((simulation != NULL) && (simulation->getQuantityType() != quantityType)) {
+		quantityType = simulation->getQuantityType();
+
+		// snapshots with preloaded quantities may still hold the new one
+		for (int i = 0; i < ready.size(); ++i) {
+			if (!ready[i]->hasQuantity(quantityType)) {
+				ready.clear();
+				active = false;
+				break;
+			}
+		}
+	}
+
+	bool wrongQuantity = false;
+
+	while (true) {
+		for (int i = 0; i < ready.size(); ++i) {
+			if (ready[i]->timestep == timestep) {
+				// was loaded before the quantity changed
+				if (!ready[i]->hasQuantity(quantityType)) {
+					ready.clear();
+					wrongQuantity = true;
+					break;
+				}
+
+				SnapshotPointer snapshot = ready[i];
+
+				// everything before was skipped
+				for (int j = 0; j <= i; ++j) {
+					ready.removeFirst();
+				}
+
+				if (stalled) {
+					stalls++;
+				} else {
+					hits++;
+				}
+
+				condition.wakeAll();
+				return snapshot;
+			}
+		}
+
+		bool pending = (loading && (loadingTimestep == timestep)) || (active && (nextTimestep == timestep));
+
+		if (wrongQuantity || abort || !pending)
+			break;
+
+		// everything ready comes before timestep in playback order and was
+		// skipped, dropping it lets the loader continue if the queue is full
+		if (!ready.isEmpty()) {
+			ready.clear();
+			condition.wakeAll();
+		}
+
+		stalled = true;
+		condition.wait(&mutex);
+	}
+
+	misses++;
+
+	int next = (simulation != NULL) ? simulation->getNextTimestep(timestep, stride) : -1;
+
+	if (next >= 0) {
+		restart(next);
+	} else {
+		active = false;
+	}
+
+	return SnapshotPointer();
+}
+
+void Prefetcher::resetStatistics()
+{
+	hits = 0;
+	misses = 0;
+	stalls = 0;
+}
+
+void Prefetcher::run()
+{
+	mutex.lock();
+
+	while (!abort) {
+		if (!active || (simulation == NULL) || ((unsigned int)ready.size() >= lookAhead) || (nextTimestep < 0) || (nextTimestep > lastTimestep)) {
+			condition.wait(&mutex);
+			continue;
+		}
+
+		unsigned int timestep = nextTimestep;
+		unsigned int currentGeneration = generation;
+		Simulation::QuantityType type = quantityType;
+
+		loading = true;
+		loadingTimestep = timestep;
+		mutex.unlock();
+
+		SnapshotPointer snapshot = simulation->getSnapshot(timestep, type);
+
+		mutex.lock();
+		loading = false;
+
+		if (currentGeneration == generation) {
+			if (!snapshot.isNull()) {
+				ready.append(snapshot);
+				nextTimestep = simulation->getNextTimestep(timestep, stride);
+			} else {
+				// leave this timestep to the caller, which will report the error
+				active = false;
+			}
+		}
+
+		condition.wakeAll();
+	}
+
+	mutex.unlock();
+}
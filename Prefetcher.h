@@ -0,0 +1,72 @@
+#ifndef _PREFETCHER_H_
+#define _PREFETCHER_H_
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QList>
+#include "Simulation.h"
+
+/**
+	loader thread decoding the next timesteps during playback
+
+	While playing, the prefetcher keeps up to lookAhead decoded snapshots of
+	the timesteps following the current one (in steps of stride) ready, so
+	MainWidget only has to hand them over to the simulation.
+*/
+class Prefetcher : public QThread
+{
+	Q_OBJECT
+
+	public:
+		Prefetcher(QObject* parent = 0);
+		~Prefetcher();
+
+		void setSimulation(Simulation* simulation);
+
+		void setLookAhead(unsigned int value);
+		inline unsigned int getLookAhead() const { return lookAhead; }
+
+		void startPlayback(unsigned int timestep, int stride);
+		void stopPlayback();
+		SnapshotPointer take(unsigned int timestep);
+
+		// statistics
+		inline unsigned int getHits() const { return hits; }
+		inline unsigned int getMisses() const { return misses; }
+		inline unsigned int getStalls() const { return stalls; }
+		void resetStatistics();
+
+	protected:
+		void run();
+
+	private:
+		Simulation* simulation;
+		unsigned int lookAhead;
+
+		QMutex mutex;
+		QWaitCondition condition;
+
+		/// decoded snapshots in playback order
+		QList<SnapshotPointer> ready;
+
+		bool abort;
+		bool active;
+		bool loading;
+		unsigned int loadingTimestep;
+		long long nextTimestep;
+		int stride;
+		unsigned int lastTimestep;
+		Simulation::QuantityType quantityType;
+
+		/// increased on every restart, so results of an obsolete playback are dropped
+		unsigned int generation;
+
+		unsigned int hits;
+		unsigned int misses;
+		unsigned int stalls;
+
+		void restart(unsigned int timestep);
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+#if defined(__AVX512F__) || defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+	vectors of doubles of the widest vector unit the viewer was compiled for
+
+	The viewer is built with -march=native, so the instruction set is chosen
+	at compile time. SIMD_ENABLED is defined if there is any vector unit,
+	otherwise only the scalar loops are used.
+*/
+namespace simd {
+
+#if defined(__AVX512F__)
+#define SIMD_ENABLED
+typedef __m512d Vector;
+static const unsigned int vectorWidth = 8;
+static inline Vector load(const double* p) { return _mm512_loadu_pd(p); }
+static inline void store(double* p, Vector v) { _mm512_storeu_pd(p, v); }
+static inline Vector add(Vector a, Vector b) { return _mm512_add_pd(a, b); }
+static inline Vector sub(Vector a, Vector b) { return _mm512_sub_pd(a, b); }
+static inline Vector mul(Vector a, Vector b) { return _mm512_mul_pd(a, b); }
+static inline Vector div(Vector a, Vector b) { return _mm512_div_pd(a, b); }
+static inline Vector min(Vector a, Vector b) { return _mm512_min_pd(a, b); }
+static inline Vector max(Vector a, Vector b) { return _mm512_max_pd(a, b); }
+static inline Vector sqrt(Vector a) { return _mm512_sqrt_pd(a); }
+static inline Vector set1(double a) { return _mm512_set1_pd(a); }
+static const char* const instructionSet = "AVX-512";
+#elif defined(__AVX__)
+#define SIMD_ENABLED
+typedef __m256d Vector;
+static const unsigned int vectorWidth = 4;
+static inline Vector load(const double* p) { return _mm256_loadu_pd(p); }
+static inline void store(double* p, Vector v) { _mm256_storeu_pd(p, v); }
+static inline Vector add(Vector a, Vector b) { return _mm256_add_pd(a, b); }
+static inline Vector sub(Vector a, Vector b) { return _mm256_sub_pd(a, b); }
+static inline Vector mul(Vector a, Vector b) { return _mm256_mul_pd(a, b); }
+static inline Vector div(Vector a, Vector b) { return _mm256_div_pd(a, b); }
+static inline Vector min(Vector a, Vector b) { return _mm256_min_pd(a, b); }
+static inline Vector max(Vector a, Vector b) { return _mm256_max_pd(a, b); }
+static inline Vector sqrt(Vector a) { return _mm256_sqrt_pd(a); }
+static inline Vector set1(double a) { return _mm256_set1_pd(a); }
+static const char* const instructionSet = "AVX";
+#elif defined(__SSE2__)
+#define SIMD_ENABLED
+typedef __m128d Vector;
+static const unsigned int vectorWidth = 2;
+static inline Vector load(const double* p) { return _mm_loadu_pd(p); }
+static inline void store(double* p, Vector v) { _mm_storeu_pd(p, v); }
+static inline Vector add(Vector a, Vector b) { return _mm_add_pd(a, b); }
+static inline Vector sub(Vector a, Vector b) { return _mm_sub_pd(a, b); }
+static inline Vector mul(Vector a, Vector b) { return _mm_mul_pd(a, b); }
+static inline Vector div(Vector a, Vector b) { return _mm_div_pd(a, b); }
+static inline Vector min(Vector a, Vector b) { return _mm_min_pd(a, b); }
+static inline Vector max(Vector a, Vector b) { return _mm_max_pd(a, b); }
+static inline Vector sqrt(Vector a) { return _mm_sqrt_pd(a); }
+static inline Vector set1(double a) { return _mm_set1_pd(a); }
+static const char* const instructionSet = "SSE2";
+#else
+static const char* const instructionSet = "scalar";
+#endif
+
+}
+
+#endif
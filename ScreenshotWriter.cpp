@@ -0,0 +1,93 @@
+#include "ScreenshotWriter.h"
+#include <stdio.h>
+#include <QRunnable>
+#include <QThread>
+
+class EncodeTask : public QRunnable
+{
+	public:
+		EncodeTask(ScreenshotWriter* writer, const QImage& image, const QString& filename, int quality) : writer(writer), image(image), filename(filename), quality(quality)
+		{
+		}
+
+		void run()
+		{
+			if (!image.save(filename, "PNG", quality)) {
+				fprintf(stderr, "Could not write screenshot '%s'.\n", filename.toAscii().constData());
+			}
+
+			// drop the image before making room for the next one
+			image = QImage();
+			writer->free.release();
+		}
+
+	private:
+		ScreenshotWriter* writer;
+		QImage image;
+		QString filename;
+		int quality;
+};
+
+/**
+	\param queueLength images queued at most, 0 for two per encoding thread
+*/
+ScreenshotWriter::ScreenshotWriter(unsigned int queueLength)
+{
+	if (queueLength == 0) {
+		queueLength = 2*QThread::idealThreadCount();
+	}
+
+	this->queueLength = queueLength;
+	free.release(queueLength);
+
+	pattern = "/tmp/image_%1.png";
+	compressionLevel = 6;
+}
+
+ScreenshotWriter::~ScreenshotWriter()
+{
+	waitForDone();
+}
+
+void ScreenshotWriter::setPattern(const QString& pattern)
+{
+	this->pattern = pattern;
+}
+
+void ScreenshotWriter::setCompressionLevel(int level)
+{
+	compressionLevel = qBound(0, level, 9);
+}
+
+QString ScreenshotWriter::getFilename(unsigned int timestep) const
+{
+	return pattern.arg(timestep);
+}
+
+bool ScreenshotWriter::isFull()
+{
+	return free.available() == 0;
+}
+
+/**
+	queues an image for encoding, blocks while the queue is full
+
+	\param timestep used for the filename
+*/
+void ScreenshotWriter::write(const QImage& image, unsigned int timestep)
+{
+	free.acquire();
+
+	// the PNG handler of Qt maps quality 100..0 to compression level 0..9
+	int quality = (9 - compressionLevel)*100/9;
+
+	pool.start(new EncodeTask(this, image, getFilename(timestep), quality));
+}
+
+/**
+	waits until all queued images are written
+*/
+void ScreenshotWriter::waitForDone()
+{
+	pool.waitForDone();
+}
@@ -0,0 +1,48 @@
+#ifndef _SCREENSHOTWRITER_H_
+#define _SCREENSHOTWRITER_H_
+
+#include <QString>
+#include <QImage>
+#include <QThreadPool>
+#include <QSemaphore>
+
+/**
+	encodes and writes screenshots on a thread pool
+
+	At most queueLength images are waiting or being encoded at once, write
+	blocks while the queue is full. Callers which must not block (playback)
+	check isFull first and try again later.
+*/
+class ScreenshotWriter
+{
+	public:
+		ScreenshotWriter(unsigned int queueLength = 0);
+		~ScreenshotWriter();
+
+		// %1 is replaced by the timestep
+		void setPattern(const QString& pattern);
+		inline const QString& getPattern() const { return pattern; }
+		// zlib compression level 0 (fastest) to 9 (smallest)
+		void setCompressionLevel(int level);
+		inline int getCompressionLevel() const { return compressionLevel; }
+
+		QString getFilename(unsigned int timestep) const;
+
+		inline unsigned int getQueueLength() const { return queueLength; }
+		bool isFull();
+		void write(const QImage& image, unsigned int timestep);
+		void waitForDone();
+
+	private:
+		QString pattern;
+		int compressionLevel;
+		unsigned int queueLength;
+
+		QThreadPool pool;
+		/// free places in the queue
+		QSemaphore free;
+
+		friend class EncodeTask;
+};
+
+#endif
@@ -2,6 +2,14 @@
 #define _SIMULATION_H_
 
 #include <QObject>
+#include <QSharedPointer>
+
+class Snapshot;
+class SnapshotCache;
+class FieldStatistics;
+class Expression;
+typedef QSharedPointer<Snapshot> SnapshotPointer;
+typedef QSharedPointer<const Expression> ExpressionPointer;
 
 class Simulation : public QObject
 {
@@ -14,7 +22,39 @@ class Simulation : public QObject
 			TEMPERATURE,
 			V_RADIAL,
 			V_AZIMUTHAL,
-			N_QUANTITY_TYPES
+			// computed from the grids above while loading
+			VORTICITY,
+			VORTENSITY,
+			TOOMRE_Q,
+			MASS_FLUX,
+			// user defined, see setExpression
+			EXPRESSION,
+			N_QUANTITY_TYPES,
+			// quantities which are read from grid files
+			N_GRID_TYPES = VORTICITY
+		};
+
+		/**
+			part of a grid which is loaded at full resolution
+
+			Outside of it only every stride-th row of cells is read and copied to
+			the rows in between. A stride of 1 means the whole grid is loaded.
+		*/
+		struct Region {
+			Region() : firstRow(0), rows(0), firstColumn(0), columns(0), stride(1) {}
+
+			// vertex rows firstRow to firstRow+rows-1
+			unsigned int firstRow;
+			unsigned int rows;
+			// vertex columns firstColumn to firstColumn+columns-1, modulo NAzimuthal
+			unsigned int firstColumn;
+			unsigned int columns;
+			unsigned int stride;
+
+			inline bool isFull() const { return stride <= 1; }
+			inline bool operator==(const Region& other) const { return (isFull() && other.isFull()) || ((firstRow == other.firstRow) && (rows == other.rows) && (firstColumn == other.firstColumn) && (columns == other.columns) && (stride == other.stride)); }
+			// a grid loaded with this region can be shown for the other one
+			inline bool covers(const Region& other) const { return isFull() || (*this == other); }
 		};
 
 		Simulation();
@@ -31,6 +71,7 @@ class Simulation : public QObject
 
 		// particle stuff
 		virtual unsigned int getNumberOfParticles() const = 0;
+		virtual const double* getParticlePositions() const = 0;
 		virtual const double* getParticlePosition(unsigned int number) const = 0;
 		virtual const double* getParticleVelocity(unsigned int number) const = 0;
 		virtual const double* getParticleMass(unsigned int number) const = 0;
@@ -39,6 +80,10 @@ class Simulation : public QObject
 		virtual int loadTimestep(unsigned int timestep) = 0;
 		virtual unsigned int getCurrentTimestep() const = 0;
 		virtual unsigned int getLastTimeStep() const = 0;
+		virtual bool hasTimestep(unsigned int timestep) const = 0;
+		// quantities (bit 1 << type) written for a timestep
+		virtual unsigned int getQuantitiesOfTimestep(unsigned int timestep) const = 0;
+		virtual int getNextTimestep(unsigned int timestep, int stride) const = 0;
 		virtual unsigned int getNRadial() const = 0;
 		virtual unsigned int getNAzimuthal() const = 0;
 		virtual double getRMin() const = 0;
@@ -46,14 +91,49 @@ class Simulation : public QObject
 		virtual const double* getRadii() const = 0;
 		virtual const double* getQuantity() const = 0;
 		virtual void setQuantityType(QuantityType type) = 0;
+		virtual QuantityType getQuantityType() const = 0;
+
+		// quantities (bit 1 << type) which are loaded together with the current one
+		virtual void setPreloadedQuantities(unsigned int mask) = 0;
+		virtual unsigned int getPreloadedQuantities() const = 0;
+
+		// follow a running simulation, timestepsAdded is emitted when new output is complete
+		virtual void setFollow(bool value) = 0;
+		virtual bool getFollow() const = 0;
+
+		// snapshot stuff, loadSnapshot and getSnapshot must be safe to call from any thread
+		// planets and particles are only loaded if planets is set
+		virtual int loadSnapshot(Snapshot* snapshot, unsigned int timestep, unsigned int quantityMask, bool planets) const = 0;
+		virtual SnapshotPointer getSnapshot(unsigned int timestep, QuantityType type) = 0;
+		virtual void setSnapshot(const SnapshotPointer& snapshot) = 0;
+		// snapshot of the current timestep, keeps its grids alive (null if none)
+		virtual SnapshotPointer getCurrentSnapshot() const = 0;
+		virtual SnapshotCache* getSnapshotCache() = 0;
+
+		// region of the grids loaded by getSnapshot (loadSnapshot uses the region of the snapshot)
+		virtual void setRegionOfInterest(const Region& region) = 0;
+		virtual Region getRegionOfInterest() const = 0;
+
+		// expression of quantity EXPRESSION, cached values of the old one are dropped
+		virtual void setExpression(const ExpressionPointer& expression) = 0;
+		virtual ExpressionPointer getExpression() const = 0;
 
 		virtual double getMinimumValue(void) const = 0;
 		virtual double getMaximumValue(void) const = 0;
+		// statistics of the current quantity, computed while loading (NULL if not loaded)
+		virtual const FieldStatistics* getStatistics() const = 0;
+		// changes if the files the run was opened from are rewritten, e.g. by a new run
+		virtual unsigned long long getStamp() const = 0;
+		// file for the statistics index of the whole run (or its fallback in the user cache directory), must be freed by the caller
+		virtual char* getStatisticsFilename(bool cacheDirectory) const = 0;
 
 	private:
 
 	signals:
 		void dataUpdated();
+		void timestepsAdded();
+		// files of a timestep were written while following the simulation
+		void timestepWritten(unsigned int timestep);
 };
 
 #endif
@@ -0,0 +1,147 @@
+#include "Snapshot.h"
+#include <stdlib.h>
+#include <QMutex>
+#include <QList>
+
+// snapshots which are not used anymore, so their buffers can be reused
+static QMutex poolMutex;
+static QList<Snapshot*> pool;
+static const int maximumPoolSize = 2;
+
+Snapshot::Snapshot()
+{
+	timestep = 0;
+
+	for (unsigned int type = 0; type < Simulation::N_QUANTITY_TYPES; ++type) {
+		fields[type].buffer = NULL;
+		fields[type].size = 0;
+		fields[type].data = NULL;
+	}
+	quantityMask = 0;
+
+	NPlanets = 0;
+	planetCapacity = 0;
+	planetPositions = NULL;
+	planetVelocities = NULL;
+
+	NParticles = 0;
+	particleCapacity = 0;
+	particlePositions = NULL;
+	particleVelocities = NULL;
+	particleMasses = NULL;
+}
+
+Snapshot::~Snapshot()
+{
+	for (unsigned int type = 0; type < Simulation::N_QUANTITY_TYPES; ++type) {
+		delete [] fields[type].buffer;
+	}
+
+	free(planetPositions);
+	free(planetVelocities);
+
+	free(particlePositions);
+	free(particleVelocities);
+	free(particleMasses);
+}
+
+/**
+	returns a snapshot, reusing the buffers of a snapshot which is not used anymore if possible
+*/
+SnapshotPointer Snapshot::create()
+{
+	Snapshot* snapshot = NULL;
+
+	poolMutex.lock();
+	if (!pool.isEmpty()) {
+		snapshot = pool.takeLast();
+	}
+	poolMutex.unlock();
+
+	if (snapshot == NULL) {
+		snapshot = new Snapshot;
+	}
+
+	return SnapshotPointer(snapshot, Snapshot::recycle);
+}
+
+/**
+	called when the last reference to a snapshot is dropped
+*/
+void Snapshot::recycle(Snapshot* snapshot)
+{
+	for (unsigned int type = 0; type < Simulation::N_QUANTITY_TYPES; ++type) {
+		snapshot->fields[type].file.close();
+		snapshot->fields[type].data = NULL;
+	}
+	snapshot->quantityMask = 0;
+	snapshot->region = Simulation::Region();
+
+	poolMutex.lock();
+	if (pool.size() < maximumPoolSize) {
+		pool.append(snapshot);
+		snapshot = NULL;
+	}
+	poolMutex.unlock();
+
+	delete snapshot;
+}
+
+/**
+	sets the number of grid values of a quantity
+*/
+void Snapshot::resizeQuantity(Simulation::QuantityType type, unsigned int size)
+{
+	Field& field = fields[type];
+
+	if (size != field.size) {
+		delete [] field.buffer;
+		field.buffer = new double[size];
+		field.size = size;
+	}
+}
+
+/**
+	sets the number of planets (including the star)
+*/
+void Snapshot::resizePlanets(unsigned int number)
+{
+	if (number > planetCapacity) {
+		planetPositions = (double*)realloc(planetPositions, 3*number*sizeof(double));
+		planetVelocities = (double*)realloc(planetVelocities, 3*number*sizeof(double));
+		planetCapacity = number;
+	}
+
+	NPlanets = number;
+}
+
+/**
+	sets the number of particles, buffers are only reallocated if they grow
+*/
+void Snapshot::resizeParticles(unsigned int number)
+{
+	if (number > particleCapacity) {
+		particlePositions = (double*)realloc(particlePositions, 2*number*sizeof(double));
+		particleVelocities = (double*)realloc(particleVelocities, 2*number*sizeof(double));
+		particleMasses = (double*)realloc(particleMasses, number*sizeof(double));
+		particleCapacity = number;
+	}
+
+	NParticles = number;
+}
+
+/**
+	returns the memory held by this snapshot in bytes (including mapped grid files)
+*/
+size_t Snapshot::getMemoryUsage() const
+{
+	size_t usage = sizeof(Snapshot)
+		+ planetCapacity*6*sizeof(double)
+		+ particleCapacity*5*sizeof(double);
+
+	for (unsigned int type = 0; type < Simulation::N_QUANTITY_TYPES; ++type) {
+		usage += fields[type].size*sizeof(double) + fields[type].file.getSize();
+	}
+
+	return usage;
+}
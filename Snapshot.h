@@ -0,0 +1,68 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include "Simulation.h"
+#include "MappedFile.h"
+#include "FieldStatistics.h"
+
+/**
+	all data of one decoded timestep
+
+	Snapshots are filled by Simulation::loadSnapshot (possibly on a loader
+	thread) and handed over to the simulation with Simulation::setSnapshot.
+*/
+class Snapshot
+{
+	public:
+		Snapshot();
+		~Snapshot();
+
+		static SnapshotPointer create();
+		void resizeQuantity(Simulation::QuantityType type, unsigned int size);
+		void resizePlanets(unsigned int number);
+		void resizeParticles(unsigned int number);
+		size_t getMemoryUsage() const;
+
+		unsigned int timestep;
+
+		// one grid per quantity, data points either to buffer or into file
+		struct Field {
+			double* buffer;
+			unsigned int size;
+			const double* data;
+			MappedFile file;
+			FieldStatistics statistics;
+		};
+		Field fields[Simulation::N_QUANTITY_TYPES];
+
+		// bit (1 << type) is set for every loaded quantity
+		unsigned int quantityMask;
+
+		// part of the grids which was loaded at full resolution
+		Simulation::Region region;
+
+		inline bool hasQuantity(Simulation::QuantityType type) const { return (quantityMask & (1u << type)) != 0; }
+		inline const double* getQuantity(Simulation::QuantityType type) const { return hasQuantity(type) ? fields[type].data : NULL; }
+
+		// planets
+		unsigned int NPlanets;
+		unsigned int planetCapacity;
+		double* planetPositions;
+		double* planetVelocities;
+
+		// particles (positions and velocities as x,y pairs)
+		unsigned int NParticles;
+		unsigned int particleCapacity;
+		double* particlePositions;
+		double* particleVelocities;
+		double* particleMasses;
+
+	private:
+		static void recycle(Snapshot* snapshot);
+
+		// not copyable
+		Snapshot(const Snapshot&);
+		Snapshot& operator=(const Snapshot&);
+};
+
+#endif
@@ -0,0 +1,208 @@
+#include "SnapshotCache.h"
+#include "Snapshot.h"
+#include "CompressedCache.h"
+
+SnapshotCache::SnapshotCache()
+{
+	budget = 512*1024*1024;
+	usage = 0;
+
+	pinned = false;
+	pinnedFirst = 0;
+	pinnedLast = 0;
+
+	compressed = new CompressedCache;
+
+	resetStatistics();
+}
+
+SnapshotCache::~SnapshotCache()
+{
+	delete compressed;
+}
+
+bool SnapshotCache::isPinned(unsigned int timestep) const
+{
+	return pinned && (timestep >= pinnedFirst) && (timestep <= pinnedLast);
+}
+
+/**
+	sets the maximum memory used by all cached snapshots
+*/
+void SnapshotCache::setBudget(size_t bytes)
+{
+	List evicted;
+
+	mutex.lock();
+	budget = bytes;
+	evict(&evicted);
+	mutex.unlock();
+
+	compress(evicted);
+}
+
+/**
+	keeps snapshots of the timesteps first to last in the cache regardless of the budget
+*/
+void SnapshotCache::setPinnedRange(unsigned int first, unsigned int last)
+{
+	List evicted;
+
+	mutex.lock();
+	pinned = true;
+	pinnedFirst = first;
+	pinnedLast = last;
+	evict(&evicted);
+	mutex.unlock();
+
+	compress(evicted);
+}
+
+void SnapshotCache::clearPinnedRange()
+{
+	List evicted;
+
+	mutex.lock();
+	pinned = false;
+	evict(&evicted);
+	mutex.unlock();
+
+	compress(evicted);
+}
+
+/**
+	returns the cached snapshot of timestep if it holds quantity type, otherwise a null pointer
+
+	Snapshots only found in the compressed tier are decoded and cached again.
+*/
+SnapshotPointer SnapshotCache::find(unsigned int timestep, Simulation::QuantityType type)
+{
+	mutex.lock();
+
+	std::map<Key, List::iterator>::iterator pos = index.find(timestep);
+
+	if ((pos != index.end()) && (*pos->second)->hasQuantity(type)) {
+		hits++;
+
+		// move to front
+		entries.splice(entries.begin(), entries, pos->second);
+
+		SnapshotPointer snapshot = *(pos->second);
+		mutex.unlock();
+
+		return snapshot;
+	}
+
+	misses++;
+	mutex.unlock();
+
+	// decode without holding the lock
+	SnapshotPointer snapshot = compressed->find(timestep, type);
+
+	if (!snapshot.isNull()) {
+		insert(snapshot);
+	}
+
+	return snapshot;
+}
+
+void SnapshotCache::insert(const SnapshotPointer& snapshot)
+{
+	List evicted;
+
+	mutex.lock();
+
+	Key key = snapshot->timestep;
+	std::map<Key, List::iterator>::iterator pos = index.find(key);
+
+	if (pos != index.end()) {
+		usage -= (*pos->second)->getMemoryUsage();
+		entries.erase(pos->second);
+	}
+
+	entries.push_front(snapshot);
+	index[key] = entries.begin();
+	usage += snapshot->getMemoryUsage();
+
+	evict(&evicted);
+
+	mutex.unlock();
+
+	compress(evicted);
+}
+
+/**
+	removes the snapshot of a timestep (e.g. because its files changed)
+*/
+void SnapshotCache::remove(unsigned int timestep)
+{
+	compressed->remove(timestep);
+
+	QMutexLocker locker(&mutex);
+
+	std::map<Key, List::iterator>::iterator pos = index.find(timestep);
+
+	if (pos != index.end()) {
+		usage -= (*pos->second)->getMemoryUsage();
+		entries.erase(pos->second);
+		index.erase(pos);
+	}
+}
+
+void SnapshotCache::clear()
+{
+	compressed->clear();
+
+	QMutexLocker locker(&mutex);
+
+	entries.clear();
+	index.clear();
+	usage = 0;
+}
+
+/**
+	evicts least recently used snapshots until the budget is met (mutex must be locked)
+
+	\param evicted list to append the evicted snapshots to
+*/
+void SnapshotCache::evict(List* evicted)
+{
+	List::iterator pos = entries.end();
+
+	while ((usage > budget) && (pos != entries.begin())) {
+		--pos;
+
+		if (isPinned((*pos)->timestep))
+			continue;
+
+		usage -= (*pos)->getMemoryUsage();
+		index.erase((*pos)->timestep);
+		evicted->push_back(*pos);
+		pos = entries.erase(pos);
+		evictions++;
+	}
+}
+
+/**
+	hands evicted snapshots to the compressed tier, which encodes them on its own thread (mutex must not be locked)
+*/
+void SnapshotCache::compress(const List& evicted)
+{
+	for (List::const_iterator pos = evicted.begin(); pos != evicted.end(); ++pos) {
+		compressed->insert(*pos);
+	}
+}
+
+unsigned int SnapshotCache::getNumberOfEntries()
+{
+	QMutexLocker locker(&mutex);
+
+	return index.size();
+}
+
+void SnapshotCache::resetStatistics()
+{
+	hits = 0;
+	misses = 0;
+	evictions = 0;
+}
@@ -0,0 +1,78 @@
+#ifndef _SNAPSHOTCACHE_H_
+#define _SNAPSHOTCACHE_H_
+
+#include <QMutex>
+#include <list>
+#include <map>
+#include <stddef.h>
+#include "Simulation.h"
+
+class CompressedCache;
+
+/**
+	least recently used cache of decoded snapshots
+
+	Snapshots are keyed by timestep, a snapshot may hold several quantities. When the memory used by all
+	snapshots exceeds the budget, the least recently used ones are evicted,
+	except for those in the pinned range of timesteps. Evicted snapshots are
+	handed to the compressed tier (if enabled), which is asked on a miss.
+*/
+class SnapshotCache
+{
+	public:
+		SnapshotCache();
+		~SnapshotCache();
+
+		void setBudget(size_t bytes);
+		inline size_t getBudget() const { return budget; }
+
+		void setPinnedRange(unsigned int first, unsigned int last);
+		void clearPinnedRange();
+		inline bool hasPinnedRange() const { return pinned; }
+		inline unsigned int getPinnedFirst() const { return pinnedFirst; }
+		inline unsigned int getPinnedLast() const { return pinnedLast; }
+
+		SnapshotPointer find(unsigned int timestep, Simulation::QuantityType type);
+		void insert(const SnapshotPointer& snapshot);
+		void remove(unsigned int timestep);
+		void clear();
+
+		inline CompressedCache* getCompressedCache() { return compressed; }
+
+		// statistics
+		inline unsigned int getHits() const { return hits; }
+		inline unsigned int getMisses() const { return misses; }
+		inline unsigned int getEvictions() const { return evictions; }
+		inline size_t getUsage() const { return usage; }
+		unsigned int getNumberOfEntries();
+		void resetStatistics();
+
+	private:
+		typedef unsigned int Key;
+		typedef std::list<SnapshotPointer> List;
+
+		/// snapshots, most recently used first
+		List entries;
+		std::map<Key, List::iterator> index;
+
+		QMutex mutex;
+
+		CompressedCache* compressed;
+
+		size_t budget;
+		size_t usage;
+
+		bool pinned;
+		unsigned int pinnedFirst;
+		unsigned int pinnedLast;
+
+		unsigned int hits;
+		unsigned int misses;
+		unsigned int evictions;
+
+		bool isPinned(unsigned int timestep) const;
+		void evict(List* evicted);
+		void compress(const List& evicted);
+};
+
+#endif
@@ -0,0 +1,616 @@
+#include "StatisticsIndex.h"
+#include "Snapshot.h"
+#include "Catalog.h"
+#include <QRunnable>
+#include <QThread>
+#include <QMutexLocker>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+static const char indexMagic[4] = { 'F', 'V', 'S', 'T' };
+static const unsigned int indexFormatVersion = 2;
+
+/**
+	reads the fields of statistics one by one, so the file does not depend on the layout of the class
+*/
+static bool readStatistics(FILE* fd, FieldStatistics* statistics)
+{
+	double reals[5];
+	unsigned long long counts[4];
+
+	if ((fread(reals, sizeof(reals), 1, fd) != 1) || (fread(counts, sizeof(counts), 1, fd) != 1))
+		return false;
+
+	statistics->minimum = reals[0];
+	statistics->maximum = reals[1];
+	statistics->sum = reals[2];
+	statistics->positiveMinimum = reals[3];
+	statistics->positiveMaximum = reals[4];
+	statistics->count = counts[0];
+	statistics->positiveCount = counts[1];
+	statistics->nanCount = counts[2];
+	statistics->infCount = counts[3];
+
+	return true;
+}
+
+static bool writeStatistics(FILE* fd, const FieldStatistics& statistics)
+{
+	double reals[5] = { statistics.minimum, statistics.maximum, statistics.sum, statistics.positiveMinimum, statistics.positiveMaximum };
+	unsigned long long counts[4] = { statistics.count, statistics.positiveCount, statistics.nanCount, statistics.infCount };
+
+	return (fwrite(reals, sizeof(reals), 1, fd) == 1) && (fwrite(counts, sizeof(counts), 1, fd) == 1);
+}
+
+/**
+	one worker of the index job, takes timesteps until none are left
+*/
+class IndexTask : public QRunnable
+{
+	public:
+		IndexTask(StatisticsIndex* index) : index(index)
+		{
+		}
+
+		void run()
+		{
+			index->work();
+		}
+
+	private:
+		StatisticsIndex* index;
+};
+
+StatisticsIndex::StatisticsIndex(QObject* parent)
+: QObject(parent)
+{
+	simulation = NULL;
+	next = 0;
+	running = 0;
+	abort = false;
+	done = 0;
+	total = 0;
+}
+
+StatisticsIndex::~StatisticsIndex()
+{
+	stop();
+	clear();
+}
+
+/**
+	stops the job and loads the stored index of a simulation
+*/
+void StatisticsIndex::setSimulation(Simulation* simulation)
+{
+	stop();
+	clear();
+
+	this->simulation = simulation;
+
+	if (simulation != NULL) {
+		load();
+	}
+}
+
+/**
+	starts indexing all timesteps and quantities which are not indexed yet
+
+	\param rebuild drop the existing index first
+*/
+void StatisticsIndex::start(bool rebuild)
+{
+	stop();
+
+	if (simulation == NULL)
+		return;
+
+	if (rebuild) {
+		clear();
+	}
+
+	mutex.lock();
+	todo.clear();
+	for (unsigned int timestep = 0; timestep <= simulation->getLastTimeStep(); ++timestep) {
+		if (getMissingQuantities(timestep) != 0) {
+			todo.push_back(timestep);
+		}
+	}
+	next = 0;
+	done = 0;
+	total = todo.size();
+	abort = false;
+
+	if (todo.empty()) {
+		mutex.unlock();
+		emit finished();
+		return;
+	}
+
+	// every timestep is already read by one task per quantity
+	unsigned int threads = QThread::idealThreadCount() > 2 ? QThread::idealThreadCount()/2 : 1;
+	if (threads > todo.size())
+		threads = todo.size();
+
+	running = threads;
+	mutex.unlock();
+
+	pool.setMaxThreadCount(threads);
+	for (unsigned int i = 0; i < threads; ++i) {
+		pool.start(new IndexTask(this));
+	}
+}
+
+/**
+	stops the job, timesteps indexed so far are kept and stored
+*/
+void StatisticsIndex::stop()
+{
+	mutex.lock();
+	abort = true;
+	mutex.unlock();
+
+	pool.waitForDone();
+}
+
+bool StatisticsIndex::isRunning()
+{
+	QMutexLocker locker(&mutex);
+
+	return running > 0;
+}
+
+/**
+	drops the entries of a timestep whose files were written again, they are indexed by the next job
+*/
+void StatisticsIndex::removeTimestep(unsigned int timestep)
+{
+	QMutexLocker locker(&mutex);
+
+	for (unsigned int type = 0; type < Simulation::N_QUANTITY_TYPES; ++type) {
+		if (timestep < entries[type].size()) {
+			delete entries[type][timestep];
+			entries[type][timestep] = NULL;
+		}
+	}
+}
+
+void StatisticsIndex::clear()
+{
+	QMutexLocker locker(&mutex);
+
+	for (unsigned int type = 0; type < Simulation::N_QUANTITY_TYPES; ++type) {
+		for (unsigned int i = 0; i < entries[type].size(); ++i) {
+			delete entries[type][i];
+		}
+		entries[type].clear();
+	}
+}
+
+/**
+	returns quantities of a timestep which exist but are not indexed, mutex must be locked
+*/
+unsigned int StatisticsIndex::getMissingQuantities(unsigned int timestep)
+{
+	// an expression may change at any time, so it is not indexed
+	unsigned int mask = simulation->getQuantitiesOfTimestep(timestep) & ~(1u << Simulation::EXPRESSION);
+
+	for (unsigned int type = 0; type < Simulation::N_QUANTITY_TYPES; ++type) {
+		if ((timestep < entries[type].size()) && (entries[type][timestep] != NULL)) {
+			mask &= ~(1u << type);
+		}
+	}
+
+	return mask;
+}
+
+void StatisticsIndex::work()
+{
+	for (;;) {
+		mutex.lock();
+
+		if (abort || (next >= todo.size())) {
+			bool last = --running == 0;
+			bool aborted = abort;
+			mutex.unlock();
+
+			// keep what was indexed even if the job was stopped
+			if (last) {
+				save();
+
+				if (!aborted)
+					emit finished();
+			}
+			return;
+		}
+
+		unsigned int timestep = todo[next++];
+		unsigned int mask = getMissingQuantities(timestep);
+		mutex.unlock();
+
+		SnapshotPointer snapshot = Snapshot::create();
+		simulation->loadSnapshot(snapshot.data(), timestep, mask, false);
+
+		Entry* newEntries[Simulation::N_QUANTITY_TYPES];
+		for (unsigned int type = 0; type < Simulation::N_QUANTITY_TYPES; ++type) {
+			newEntries[type] = NULL;
+
+			if (snapshot->quantityMask & mask & (1u << type)) {
+				const Snapshot::Field& field = snapshot->fields[type];
+				const FieldStatistics& statistics = field.statistics;
+
+				newEntries[type] = createEntry(statistics, field.data, statistics.count + statistics.nanCount + statistics.infCount);
+			}
+		}
+
+		snapshot.clear();
+
+		mutex.lock();
+		for (unsigned int type = 0; type < Simulation::N_QUANTITY_TYPES; ++type) {
+			if (newEntries[type] == NULL)
+				continue;
+
+			if (entries[type].size() <= timestep)
+				entries[type].resize(timestep + 1, NULL);
+
+			delete entries[type][timestep];
+			entries[type][timestep] = newEntries[type];
+		}
+		unsigned int currentDone = ++done;
+		unsigned int currentTotal = total;
+		mutex.unlock();
+
+		emit progress(currentDone, currentTotal);
+	}
+}
+
+/**
+	returns the histogram bin of a value
+
+	The bins of positive values are 4 per factor of two, given by the exponent
+	and the two leading bits of the mantissa. Negative values are mirrored
+	below zeroBin, values smaller than 2^smallestExponent go to zeroBin.
+*/
+unsigned int StatisticsIndex::getBin(double value)
+{
+	unsigned long long bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	int exponent = (int)((bits >> 52) & 0x7ff) - 1023;
+
+	if (exponent < smallestExponent)
+		return zeroBin;
+
+	unsigned int level = (exponent - smallestExponent)*binsPerOctave + ((bits >> 50) & 3);
+	if (level >= binsPerSign)
+		level = binsPerSign - 1;
+
+	return (bits >> 63) ? zeroBin - 1 - level : zeroBin + 1 + level;
+}
+
+/**
+	returns the lower or upper limit of the values of a bin
+*/
+double StatisticsIndex::getBinLimit(unsigned int bin, bool upper)
+{
+	if (bin == zeroBin)
+		return 0.0;
+
+	bool negative = bin < zeroBin;
+	unsigned int level = negative ? zeroBin - 1 - bin : bin - zeroBin - 1;
+
+	// the limit farther from zero
+	bool outer = negative ? !upper : upper;
+
+	int exponent = level/binsPerOctave + smallestExponent;
+	double value = ldexp(1.0 + (double)(level % binsPerOctave + (outer ? 1 : 0))/binsPerOctave, exponent);
+
+	return negative ? -value : value;
+}
+
+/**
+	creates the entry of a loaded grid, the histogram is cut to the bins in use
+*/
+StatisticsIndex::Entry* StatisticsIndex::createEntry(const FieldStatistics& statistics, const double* values, unsigned int count)
+{
+	std::vector<unsigned int> histogram(N_BINS, 0);
+	unsigned int firstBin = N_BINS;
+	unsigned int lastBin = 0;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		if (isnan(values[i]) || isinf(values[i]))
+			continue;
+
+		histogram[getBin(values[i])]++;
+	}
+
+	for (unsigned int bin = 0; bin < N_BINS; ++bin) {
+		if (histogram[bin] > 0) {
+			if (firstBin == N_BINS)
+				firstBin = bin;
+			lastBin = bin;
+		}
+	}
+
+	Entry* entry = new Entry;
+	entry->statistics = statistics;
+
+	if (firstBin == N_BINS) {
+		entry->firstBin = 0;
+	} else {
+		entry->firstBin = firstBin;
+		entry->histogram.assign(histogram.begin() + firstBin, histogram.begin() + lastBin + 1);
+	}
+
+	return entry;
+}
+
+/**
+	returns the number of indexed timesteps of a quantity in [first, last]
+*/
+unsigned int StatisticsIndex::getNumberOfEntries(Simulation::QuantityType type, unsigned int first, unsigned int last)
+{
+	QMutexLocker locker(&mutex);
+	unsigned int result = 0;
+
+	for (unsigned int timestep = first; (timestep <= last) && (timestep < entries[type].size()); ++timestep) {
+		if (entries[type][timestep] != NULL)
+			result++;
+	}
+
+	return result;
+}
+
+/**
+	merges the statistics of a quantity over the timesteps first to last
+
+	\returns false if none of the timesteps is indexed
+*/
+bool StatisticsIndex::getStatistics(Simulation::QuantityType type, unsigned int first, unsigned int last, FieldStatistics* result)
+{
+	QMutexLocker locker(&mutex);
+	bool found = false;
+
+	result->reset();
+
+	for (unsigned int timestep = first; (timestep <= last) && (timestep < entries[type].size()); ++timestep) {
+		if (entries[type][timestep] != NULL) {
+			result->merge(entries[type][timestep]->statistics);
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+/**
+	computes percentiles of a quantity over the timesteps first to last
+
+	The values are interpolated within a bin, so they are accurate to about 20%
+	of the value, and clamped to the exact minimum and maximum.
+
+	\param lower lower percentile (0 - 100)
+	\param upper upper percentile (0 - 100)
+	\param positive only use positive values (for a logarithmic scale)
+	\returns false if there are no (positive) values
+*/
+bool StatisticsIndex::getPercentiles(Simulation::QuantityType type, unsigned int first, unsigned int last, double lower, double upper, bool positive, double* minimum, double* maximum)
+{
+	std::vector<unsigned long long> histogram(N_BINS, 0);
+	FieldStatistics statistics;
+
+	mutex.lock();
+	for (unsigned int timestep = first; (timestep <= last) && (timestep < entries[type].size()); ++timestep) {
+		const Entry* entry = entries[type][timestep];
+
+		if (entry == NULL)
+			continue;
+
+		statistics.merge(entry->statistics);
+		for (unsigned int i = 0; i < entry->histogram.size(); ++i) {
+			histogram[entry->firstBin + i] += entry->histogram[i];
+		}
+	}
+	mutex.unlock();
+
+	unsigned int firstBin = positive ? zeroBin + 1 : 0;
+	double lowest = positive ? statistics.positiveMinimum : statistics.minimum;
+	double highest = positive ? statistics.positiveMaximum : statistics.maximum;
+
+	unsigned long long sum = 0;
+	for (unsigned int bin = firstBin; bin < N_BINS; ++bin) {
+		sum += histogram[bin];
+	}
+
+	if (sum == 0)
+		return false;
+
+	double percentiles[2] = { lower, upper };
+	double* results[2] = { minimum, maximum };
+
+	for (unsigned int i = 0; i < 2; ++i) {
+		double target = percentiles[i]/100.0*sum;
+		double cumulative = 0.0;
+		double value = highest;
+
+		for (unsigned int bin = firstBin; bin < N_BINS; ++bin) {
+			if ((histogram[bin] > 0) && (cumulative + histogram[bin] >= target)) {
+				double fraction = (target - cumulative)/histogram[bin];
+				double binLower = getBinLimit(bin, false);
+				value = binLower + fraction*(getBinLimit(bin, true) - binLower);
+				break;
+			}
+			cumulative += histogram[bin];
+		}
+
+		if (value < lowest)
+			value = lowest;
+		if (value > highest)
+			value = highest;
+
+		*results[i] = value;
+	}
+
+	return true;
+}
+
+/**
+	reads the stored index from the output directory or the user cache directory
+*/
+int StatisticsIndex::load()
+{
+	if (simulation == NULL)
+		return -1;
+
+	for (unsigned int i = 0; i < 2; ++i) {
+		char* filename = simulation->getStatisticsFilename(i == 1);
+
+		if (filename == NULL)
+			continue;
+
+		int ret = load(filename);
+		free(filename);
+
+		if (ret == 0)
+			return 0;
+	}
+
+	return -1;
+}
+
+/**
+	reads a stored index, it is ignored if it does not match the grid
+*/
+int StatisticsIndex::load(const char* filename)
+{
+	FILE* fd = fopen(filename, "r");
+
+	// not built yet
+	if (fd == NULL)
+		return -1;
+
+	// magic, format version, NRadial, NAzimuthal, number of entries and the stamp of the run
+	char magic[4];
+	unsigned int header[4];
+	unsigned long long stamp;
+
+	if ((fread(magic, sizeof(magic), 1, fd) != 1) || (fread(header, sizeof(header), 1, fd) != 1) || (fread(&stamp, sizeof(stamp), 1, fd) != 1)
+		|| (memcmp(magic, indexMagic, sizeof(indexMagic)) != 0) || (header[0] != indexFormatVersion) || (header[1] != simulation->getNRadial()) || (header[2] != simulation->getNAzimuthal()) || (stamp != simulation->getStamp())) {
+		fprintf(stderr, "Ignoring statistics index '%s'.\n", filename);
+		fclose(fd);
+		return -1;
+	}
+
+	QMutexLocker locker(&mutex);
+
+	for (unsigned int i = 0; i < header[3]; ++i) {
+		unsigned int position[2];
+		unsigned int bins[2];
+		Entry* entry = new Entry;
+
+		if ((fread(position, sizeof(position), 1, fd) != 1) || !readStatistics(fd, &entry->statistics) || (fread(bins, sizeof(bins), 1, fd) != 1)
+			|| (position[0] > simulation->getLastTimeStep() + timestepSlack) || (position[1] >= Simulation::N_QUANTITY_TYPES) || (bins[0] > N_BINS) || (bins[1] > N_BINS - bins[0])) {
+			fprintf(stderr, "Statistics index '%s' is truncated or damaged.\n", filename);
+			delete entry;
+			break;
+		}
+
+		entry->firstBin = bins[0];
+		entry->histogram.resize(bins[1]);
+
+		if ((bins[1] > 0) && (fread(&entry->histogram[0], bins[1]*sizeof(unsigned int), 1, fd) != 1)) {
+			fprintf(stderr, "Statistics index '%s' is truncated.\n", filename);
+			delete entry;
+			break;
+		}
+
+		std::vector<Entry*>& list = entries[position[1]];
+		if (list.size() <= position[0])
+			list.resize(position[0] + 1, NULL);
+
+		delete list[position[0]];
+		list[position[0]] = entry;
+	}
+
+	fclose(fd);
+
+	return 0;
+}
+
+/**
+	writes the index to the output directory, or to the user cache directory if that is not writable
+*/
+int StatisticsIndex::save()
+{
+	if (simulation == NULL)
+		return -1;
+
+	for (unsigned int i = 0; i < 2; ++i) {
+		char* filename = simulation->getStatisticsFilename(i == 1);
+		char* temp;
+
+		if (filename == NULL)
+			continue;
+
+		FILE* fd = Catalog::createSidecar(filename, &temp);
+		if (fd == NULL) {
+			free(filename);
+			continue;
+		}
+
+		bool ok = save(fd);
+		int ret = Catalog::commitSidecar(fd, temp, filename, ok);
+		free(filename);
+
+		if (ret == 0)
+			return 0;
+	}
+
+	fprintf(stderr, "Could not write statistics index.\n");
+	return -1;
+}
+
+/**
+	writes the index, which is a header (see load) followed by the entries as
+
+	timestep, quantity, statistics, first bin, number of bins, bins
+*/
+bool StatisticsIndex::save(FILE* fd)
+{
+	QMutexLocker locker(&mutex);
+
+	unsigned int header[4] = { indexFormatVersion, simulation->getNRadial(), simulation->getNAzimuthal(), 0 };
+	unsigned long long stamp = simulation->getStamp();
+
+	for (unsigned int type = 0; type < Simulation::N_QUANTITY_TYPES; ++type) {
+		for (unsigned int timestep = 0; timestep < entries[type].size(); ++timestep) {
+			if (entries[type][timestep] != NULL)
+				header[3]++;
+		}
+	}
+
+	bool ok = (fwrite(indexMagic, sizeof(indexMagic), 1, fd) == 1) && (fwrite(header, sizeof(header), 1, fd) == 1) && (fwrite(&stamp, sizeof(stamp), 1, fd) == 1);
+
+	for (unsigned int type = 0; ok && (type < Simulation::N_QUANTITY_TYPES); ++type) {
+		for (unsigned int timestep = 0; ok && (timestep < entries[type].size()); ++timestep) {
+			const Entry* entry = entries[type][timestep];
+
+			if (entry == NULL)
+				continue;
+
+			unsigned int position[2] = { timestep, type };
+			unsigned int bins[2] = { entry->firstBin, (unsigned int)entry->histogram.size() };
+
+			ok = (fwrite(position, sizeof(position), 1, fd) == 1) && writeStatistics(fd, entry->statistics) && (fwrite(bins, sizeof(bins), 1, fd) == 1);
+
+			if (ok && (bins[1] > 0)) {
+				ok = fwrite(&entry->histogram[0], bins[1]*sizeof(unsigned int), 1, fd) == 1;
+			}
+		}
+	}
+
+	return ok;
+}
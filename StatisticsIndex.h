@@ -0,0 +1,104 @@
+#ifndef _STATISTICSINDEX_H_
+#define _STATISTICSINDEX_H_
+
+#include <QObject>
+#include <QMutex>
+#include <QThreadPool>
+#include <vector>
+#include <stdio.h>
+#include "Simulation.h"
+#include "FieldStatistics.h"
+
+/**
+	statistics of every timestep and quantity of a whole run
+
+	A background job loads all timesteps (several at once, through
+	Simulation::loadSnapshot) and keeps the statistics of every grid together
+	with a histogram over logarithmic bins (4 per factor of two, taken from
+	the exponent and the two leading mantissa bits, so no log is needed).
+	Histograms of any timestep range are merged to get global limits or
+	percentiles without touching the grids again. The index is stored in a
+	sidecar file next to the simulation, so it is only built once. It is
+	dropped if the files the run was opened from changed (see
+	Simulation::getStamp), and entries of rewritten timesteps are removed.
+*/
+class StatisticsIndex : public QObject
+{
+	Q_OBJECT
+
+	public:
+		// bins of the histogram, ordered by value: negative, zero, positive
+		static const int smallestExponent = -80;
+		static const int largestExponent = 80;
+		static const unsigned int binsPerOctave = 4;
+		static const unsigned int binsPerSign = (largestExponent - smallestExponent)*binsPerOctave;
+		static const unsigned int zeroBin = binsPerSign;
+		static const unsigned int N_BINS = 2*binsPerSign + 1;
+
+		StatisticsIndex(QObject* parent = 0);
+		~StatisticsIndex();
+
+		void setSimulation(Simulation* simulation);
+
+		void start(bool rebuild);
+		void stop();
+		bool isRunning();
+
+		unsigned int getNumberOfEntries(Simulation::QuantityType type, unsigned int first, unsigned int last);
+		bool getStatistics(Simulation::QuantityType type, unsigned int first, unsigned int last, FieldStatistics* result);
+		bool getPercentiles(Simulation::QuantityType type, unsigned int first, unsigned int last, double lower, double upper, bool positive, double* minimum, double* maximum);
+
+		// progress of the running job
+		inline unsigned int getDone() const { return done; }
+		inline unsigned int getTotal() const { return total; }
+
+		static unsigned int getBin(double value);
+		static double getBinLimit(unsigned int bin, bool upper);
+
+	public slots:
+		void removeTimestep(unsigned int timestep);
+
+	signals:
+		void progress(unsigned int done, unsigned int total);
+		void finished();
+
+	private:
+		// a running simulation may have more timesteps than when the index was stored
+		static const unsigned int timestepSlack = 1024;
+
+		struct Entry {
+			FieldStatistics statistics;
+			// counts of the bins firstBin to firstBin+histogram.size()-1
+			unsigned int firstBin;
+			std::vector<unsigned int> histogram;
+		};
+
+		Simulation* simulation;
+
+		QMutex mutex;
+		QThreadPool pool;
+
+		/// entries[type][timestep], NULL if not indexed yet
+		std::vector<Entry*> entries[Simulation::N_QUANTITY_TYPES];
+
+		/// timesteps the job still has to index
+		std::vector<unsigned int> todo;
+		unsigned int next;
+		unsigned int running;
+		bool abort;
+		unsigned int done;
+		unsigned int total;
+
+		void work();
+		void clear();
+		int load();
+		int load(const char* filename);
+		int save();
+		bool save(FILE* fd);
+		unsigned int getMissingQuantities(unsigned int timestep);
+		static Entry* createEntry(const FieldStatistics& statistics, const double* values, unsigned int count);
+
+		friend class IndexTask;
+};
+
+#endif
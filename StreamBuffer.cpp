@@ -0,0 +1,273 @@
+#include "StreamBuffer.h"
+#include <stdio.h>
+#include <QRunnable>
+
+class FillTask : public QRunnable
+{
+	public:
+		FillTask(StreamBuffer::Fill* fill, void* data, QSemaphore* done) : fill(fill), data(data), done(done)
+		{
+		}
+
+		void run()
+		{
+			fill->fill(data);
+
+			delete fill;
+			done->release();
+		}
+
+	private:
+		StreamBuffer::Fill* fill;
+		void* data;
+		QSemaphore* done;
+};
+
+StreamBuffer::StreamBuffer()
+{
+	for (unsigned int i = 0; i < NSlots; ++i) {
+		slots[i].buffer = 0;
+		slots[i].capacity = 0;
+		slots[i].fence = 0;
+		slots[i].key = -1;
+	}
+
+	current = -1;
+	filling = -1;
+	serial = 0;
+	fenced = false;
+	unsynchronized = false;
+
+	// one fill at a time
+	pool.setMaxThreadCount(1);
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	// a fill may still write into a mapping, the buffers are gone with the context
+	pool.waitForDone();
+}
+
+/**
+	creates the buffers, after glewInit
+*/
+void StreamBuffer::init()
+{
+	fenced = GLEW_VERSION_3_2 || GLEW_ARB_sync;
+	unsynchronized = fenced && (GLEW_VERSION_3_0 || GLEW_ARB_map_buffer_range);
+
+	for (unsigned int i = 0; i < NSlots; ++i) {
+		glGenBuffers(1, &slots[i].buffer);
+		slots[i].capacity = 0;
+		slots[i].fence = 0;
+		slots[i].key = -1;
+	}
+
+	current = -1;
+}
+
+void StreamBuffer::cleanUp()
+{
+	collect(true);
+
+	for (unsigned int i = 0; i < NSlots; ++i) {
+		if (slots[i].fence != 0) {
+			glDeleteSync(slots[i].fence);
+			slots[i].fence = 0;
+		}
+
+		if (slots[i].buffer != 0) {
+			glDeleteBuffers(1, &slots[i].buffer);
+			slots[i].buffer = 0;
+		}
+
+		slots[i].capacity = 0;
+		slots[i].key = -1;
+	}
+
+	current = -1;
+}
+
+/**
+	\returns true if the GPU is done with the slot
+*/
+bool StreamBuffer::isFree(Slot& slot, bool wait)
+{
+	if (slot.fence == 0)
+		return true;
+
+	GLenum status;
+	do {
+		status = glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 100000000 : 0);
+	} while (wait && (status == GL_TIMEOUT_EXPIRED));
+
+	if (status == GL_TIMEOUT_EXPIRED)
+		return false;
+
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+
+	return true;
+}
+
+/**
+	maps a free slot and fills it on the worker thread
+
+	\param fill writes the data, deleted when it is done
+	\param size bytes of the data
+	\param key identifies the data for getKey
+	\param wait fill on this thread, the slot is the newest one on return
+	\returns 0 on success, -1 if no slot is free yet (without wait) or mapping failed
+*/
+int StreamBuffer::start(Fill* fill, size_t size, int key, bool wait)
+{
+	if ((filling >= 0) || (slots[0].buffer == 0)) {
+		delete fill;
+		return -1;
+	}
+
+	// the slot after the one drawn from was used longest ago
+	int next = (current + 1) % NSlots;
+	int slot = -1;
+
+	for (unsigned int i = 0; i < NSlots - 1; ++i) {
+		int candidate = (next + i) % NSlots;
+
+		if (isFree(slots[candidate], false)) {
+			slot = candidate;
+			break;
+		}
+	}
+
+	if (slot < 0) {
+		if (!wait) {
+			delete fill;
+			return -1;
+		}
+
+		isFree(slots[next], true);
+		slot = next;
+	}
+
+	Slot& s = slots[slot];
+	void* data;
+
+	glBindBuffer(GL_ARRAY_BUFFER, s.buffer);
+
+	if (unsynchronized && (size <= s.capacity)) {
+		data = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	} else {
+		// grow or orphan the buffer
+		if (size > s.capacity)
+			s.capacity = size;
+
+		glBufferData(GL_ARRAY_BUFFER, s.capacity, NULL, GL_STREAM_DRAW);
+		data = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (data == NULL) {
+		fprintf(stderr, "Could not map stream buffer of %lu bytes.\n", (unsigned long)size);
+		delete fill;
+		return -1;
+	}
+
+	s.key = key;
+	filling = slot;
+
+	if (wait) {
+		fill->fill(data);
+		delete fill;
+		done.release();
+		collect(true);
+	} else {
+		pool.start(new FillTask(fill, data, &done));
+	}
+
+	return 0;
+}
+
+/**
+	unmaps the slot of a fill which is done, it becomes the newest one
+
+	\param wait wait for the fill in flight
+	\returns true if the newest slot changed
+*/
+bool StreamBuffer::collect(bool wait)
+{
+	if (filling < 0)
+		return false;
+
+	if (wait) {
+		done.acquire();
+	} else if (!done.tryAcquire()) {
+		return false;
+	}
+
+	Slot& s = slots[filling];
+	filling = -1;
+
+	glBindBuffer(GL_ARRAY_BUFFER, s.buffer);
+	GLboolean valid = glUnmapBuffer(GL_ARRAY_BUFFER);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (valid != GL_TRUE) {
+		// contents were lost, e.g. the display mode changed
+		s.key = -1;
+		return false;
+	}
+
+	current = &s - slots;
+	++serial;
+
+	return true;
+}
+
+/**
+	waits until the fill in flight is done, without the context
+
+	Use before changing what the fill reads, the slot is collected later.
+*/
+void StreamBuffer::waitForFill()
+{
+	pool.waitForDone();
+}
+
+/**
+	marks the end of the commands using the newest slot, it is not filled again before
+*/
+void StreamBuffer::fence()
+{
+	if (!fenced || (current < 0))
+		return;
+
+	Slot& s = slots[current];
+
+	if (s.fence != 0)
+		glDeleteSync(s.fence);
+
+	s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+/**
+	the newest slot is outdated and must not be drawn anymore
+*/
+void StreamBuffer::invalidate()
+{
+	if (current >= 0)
+		slots[current].key = -1;
+
+	current = -1;
+}
+
+size_t StreamBuffer::getMemoryUsage() const
+{
+	size_t size = 0;
+
+	for (unsigned int i = 0; i < NSlots; ++i) {
+		size += slots[i].capacity;
+	}
+
+	return size;
+}
@@ -0,0 +1,89 @@
+#ifndef _STREAMBUFFER_H_
+#define _STREAMBUFFER_H_
+
+#include <GL/glew.h>
+#include <stddef.h>
+#include <QThreadPool>
+#include <QSemaphore>
+
+/**
+	ring of buffer objects for data which changes with every timestep
+
+	A free slot is mapped on the thread of the OpenGL context, filled by a
+	worker thread and unmapped once the worker is done, so the data of the
+	next timestep is computed and transferred while the newest complete slot
+	is drawn. Buffers are kept and only grow.
+
+	Every use of a slot is fenced (OpenGL 3.2 or ARB_sync) and a slot is only
+	filled again after its fence signalled, so it is mapped without any
+	synchronization in the driver (OpenGL 3.0 or ARB_map_buffer_range).
+	Without them the buffer is orphaned before it is mapped.
+
+	Everything but Fill::fill has to be called with the context current.
+*/
+class StreamBuffer
+{
+	public:
+		/// writes the contents of a slot, runs on the worker thread
+		class Fill
+		{
+			public:
+				virtual ~Fill() {}
+				virtual void fill(void* data) = 0;
+		};
+
+		static const unsigned int NSlots = 3;
+
+		StreamBuffer();
+		~StreamBuffer();
+
+		void init();
+		void cleanUp();
+
+		int start(Fill* fill, size_t size, int key, bool wait);
+		bool collect(bool wait);
+		void waitForFill();
+		void fence();
+		void invalidate();
+
+		/// a fill is in flight (and not collected yet)
+		inline bool isBusy() const { return filling >= 0; }
+		/// the fill in flight is done and can be collected
+		inline bool isFinished() const { return done.available() > 0; }
+
+		/// buffer of the newest complete slot (0 if none)
+		inline GLuint getBuffer() const { return current >= 0 ? slots[current].buffer : 0; }
+		/// key given to start for the newest complete slot (-1 if none)
+		inline int getKey() const { return current >= 0 ? slots[current].key : -1; }
+		/// number of fills collected so far, changes with the contents of the newest slot
+		inline unsigned int getSerial() const { return serial; }
+		size_t getMemoryUsage() const;
+
+	private:
+		struct Slot {
+			GLuint buffer;
+			size_t capacity;
+			GLsync fence;
+			int key;
+		};
+		Slot slots[NSlots];
+		/// slot which is drawn from and slot which is filled (-1 if none)
+		int current;
+		int filling;
+		unsigned int serial;
+
+		bool fenced;
+		bool unsynchronized;
+
+		QThreadPool pool;
+		/// released when the fill in flight is done
+		QSemaphore done;
+
+		bool isFree(Slot& slot, bool wait);
+
+		// not copyable
+		StreamBuffer(const StreamBuffer&);
+		StreamBuffer& operator=(const StreamBuffer&);
+};
+
+#endif
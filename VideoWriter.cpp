@@ -0,0 +1,320 @@
+#include "VideoWriter.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <QRunnable>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+class FrameTask : public QRunnable
+{
+	public:
+		FrameTask(VideoWriter* writer, const QImage& image) : writer(writer), image(image)
+		{
+		}
+
+		void run()
+		{
+			writer->writeFrame(image);
+
+			image = QImage();
+			writer->queueSpace.release();
+		}
+
+	private:
+		VideoWriter* writer;
+		QImage image;
+};
+
+/**
+	\param queueLength frames queued at most
+*/
+VideoWriter::VideoWriter(unsigned int queueLength)
+{
+	file = NULL;
+	pipe = false;
+	fps = 25;
+	width = 0;
+	height = 0;
+	frames = 0;
+	failed = false;
+	headerWritten = false;
+	planes = NULL;
+
+	// one thread, so frames are written in order
+	pool.setMaxThreadCount(1);
+
+	this->queueLength = queueLength;
+	queueSpace.release(queueLength);
+}
+
+VideoWriter::~VideoWriter()
+{
+	close();
+}
+
+/**
+	opens a file or starts a command (output starting with '|') to write the video to
+
+	\returns 0 on success, -1 on failure
+*/
+int VideoWriter::open(const QString& output, unsigned int fps)
+{
+	close();
+
+	QByteArray name = output.toLocal8Bit();
+
+	if (output.startsWith('|')) {
+		// a command which quits early must not take us with it
+		signal(SIGPIPE, SIG_IGN);
+		file = popen(name.constData() + 1, "w");
+		pipe = true;
+	} else {
+		file = fopen(name.constData(), "wb");
+		pipe = false;
+	}
+
+	if (file == NULL) {
+		fprintf(stderr, "Could not open video output '%s': %s\n", name.constData(), strerror(errno));
+		return -1;
+	}
+
+	this->fps = (fps > 0) ? fps : 25;
+	width = 0;
+	height = 0;
+	frames = 0;
+	failed = false;
+	headerWritten = false;
+
+	return 0;
+}
+
+/**
+	writes the queued frames and closes the output
+
+	\returns 0 if all frames were written (and the command succeeded), -1 otherwise
+*/
+int VideoWriter::close()
+{
+	if (file == NULL) {
+		return 0;
+	}
+
+	pool.waitForDone();
+
+	int ret = failed ? -1 : 0;
+
+	if (pipe) {
+		int status = pclose(file);
+		if (status != 0) {
+			fprintf(stderr, "Video command exited with status %i.\n", status);
+			ret = -1;
+		}
+	} else if (fclose(file) != 0) {
+		fprintf(stderr, "Could not write video: %s\n", strerror(errno));
+		ret = -1;
+	}
+
+	file = NULL;
+	free(planes);
+	planes = NULL;
+
+	return ret;
+}
+
+bool VideoWriter::isFull()
+{
+	return queueSpace.available() == 0;
+}
+
+/**
+	queues a frame, blocks while the queue is full
+*/
+void VideoWriter::write(const QImage& image)
+{
+	if (file == NULL) {
+		return;
+	}
+
+	if (width == 0) {
+		if ((image.width() < 2) || (image.height() < 2)) {
+			return;
+		}
+
+		// 4:2:0 needs even sizes
+		width = image.width() & ~1;
+		height = image.height() & ~1;
+		planes = (unsigned char*)malloc(width*height*3/2);
+	}
+
+	queueSpace.acquire();
+	++frames;
+
+	pool.start(new FrameTask(this, image));
+}
+
+/**
+	converts a frame and writes it, called by the worker thread
+*/
+void VideoWriter::writeFrame(const QImage& frame)
+{
+	if (failed) {
+		return;
+	}
+
+	if (!headerWritten) {
+		if (fprintf(file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", width, height, fps) < 0) {
+			fprintf(stderr, "Could not write video header: %s\n", strerror(errno));
+			failed = true;
+			return;
+		}
+		headerWritten = true;
+	}
+
+	QImage image = frame;
+
+	if (((unsigned int)image.width() & ~1u) != width || ((unsigned int)image.height() & ~1u) != height) {
+		image = image.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	}
+	if ((image.format() != QImage::Format_RGB32) && (image.format() != QImage::Format_ARGB32)) {
+		image = image.convertToFormat(QImage::Format_RGB32);
+	}
+
+	unsigned char* y = planes;
+	unsigned char* u = y + width*height;
+	unsigned char* v = u + width*height/4;
+
+	convert(image.constBits(), image.bytesPerLine(), width, height, y, u, v);
+
+	size_t size = width*height*3/2;
+	if ((fputs("FRAME\n", file) == EOF) || (fwrite(planes, 1, size, file) != size)) {
+		fprintf(stderr, "Could not write video frame: %s\n", strerror(errno));
+		failed = true;
+	}
+}
+
+#if defined(__SSE2__)
+/**
+	sums of the products of the channels of 4 pixels (16 bit, 2 in each
+	argument) with the coefficients, as 32 bit integers
+*/
+static inline __m128i dot4(__m128i lo, __m128i hi, __m128i coefficients)
+{
+	lo = _mm_madd_epi16(lo, coefficients);
+	hi = _mm_madd_epi16(hi, coefficients);
+
+	// lanes 0 and 2 get the sums of the pixels
+	lo = _mm_add_epi32(lo, _mm_srli_epi64(lo, 32));
+	hi = _mm_add_epi32(hi, _mm_srli_epi64(hi, 32));
+
+	lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+	hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+
+	return _mm_unpacklo_epi64(lo, hi);
+}
+
+/**
+	sums of horizontally neighbouring pixels, 16 bit
+*/
+static inline __m128i pairSums(__m128i pixels, __m128i zero)
+{
+	__m128i lo = _mm_unpacklo_epi8(pixels, zero);
+	__m128i hi = _mm_unpackhi_epi8(pixels, zero);
+
+	lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+	hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+
+	return _mm_unpacklo_epi64(lo, hi);
+}
+#endif
+
+/**
+	The channels of 0xAARRGGBB are read as bytes B, G, R, A in the vector
+	kernel (little endian only). Chroma is taken from the 2x2 block, first
+	averaged vertically (rounded) and then summed horizontally, the scalar
+	loop does exactly the same so both give identical results.
+*/
+void VideoWriter::convert(const unsigned char* pixels, unsigned int stride, unsigned int width, unsigned int height, unsigned char* y, unsigned char* u, unsigned char* v)
+{
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i yCoefficients = _mm_set_epi16(0, 66, 129, 25, 0, 66, 129, 25);
+	const __m128i uCoefficients = _mm_set_epi16(0, -38, -74, 112, 0, -38, -74, 112);
+	const __m128i vCoefficients = _mm_set_epi16(0, 112, -94, -18, 0, 112, -94, -18);
+	const __m128i yRound = _mm_set1_epi32(128);
+	const __m128i yOffset = _mm_set1_epi32(16);
+	const __m128i chromaRound = _mm_set1_epi32(256);
+	const __m128i chromaOffset = _mm_set1_epi32(128);
+#endif
+
+	for (unsigned int row = 0; row < height; row += 2) {
+		const unsigned char* row0 = pixels + (size_t)row*stride;
+		const unsigned char* row1 = row0 + stride;
+		unsigned char* y0 = y + (size_t)row*width;
+		unsigned char* y1 = y0 + width;
+		unsigned char* uRow = u + (size_t)row/2*width/2;
+		unsigned char* vRow = v + (size_t)row/2*width/2;
+
+		unsigned int x = 0;
+
+#if defined(__SSE2__)
+		for (; x + 8 <= width; x += 8) {
+			__m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + 4*x));
+			__m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + 4*x + 16));
+			__m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + 4*x));
+			__m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + 4*x + 16));
+
+			// luma of both rows
+			__m128i l0 = dot4(_mm_unpacklo_epi8(a0, zero), _mm_unpackhi_epi8(a0, zero), yCoefficients);
+			__m128i l1 = dot4(_mm_unpacklo_epi8(a1, zero), _mm_unpackhi_epi8(a1, zero), yCoefficients);
+			l0 = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(l0, yRound), 8), yOffset);
+			l1 = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(l1, yRound), 8), yOffset);
+			_mm_storel_epi64((__m128i*)(y0 + x), _mm_packus_epi16(_mm_packs_epi32(l0, l1), zero));
+
+			l0 = dot4(_mm_unpacklo_epi8(b0, zero), _mm_unpackhi_epi8(b0, zero), yCoefficients);
+			l1 = dot4(_mm_unpacklo_epi8(b1, zero), _mm_unpackhi_epi8(b1, zero), yCoefficients);
+			l0 = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(l0, yRound), 8), yOffset);
+			l1 = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(l1, yRound), 8), yOffset);
+			_mm_storel_epi64((__m128i*)(y1 + x), _mm_packus_epi16(_mm_packs_epi32(l0, l1), zero));
+
+			// chroma of the four 2x2 blocks
+			__m128i s0 = pairSums(_mm_avg_epu8(a0, b0), zero);
+			__m128i s1 = pairSums(_mm_avg_epu8(a1, b1), zero);
+
+			__m128i c = dot4(s0, s1, uCoefficients);
+			c = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(c, chromaRound), 9), chromaOffset);
+			int packed = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(c, zero), zero));
+			memcpy(uRow + x/2, &packed, 4);
+
+			c = dot4(s0, s1, vCoefficients);
+			c = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(c, chromaRound), 9), chromaOffset);
+			packed = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(c, zero), zero));
+			memcpy(vRow + x/2, &packed, 4);
+		}
+#endif
+
+		for (; x < width; x += 2) {
+			const unsigned int* p0 = (const unsigned int*)row0 + x;
+			const unsigned int* p1 = (const unsigned int*)row1 + x;
+			int r = 0, g = 0, b = 0;
+
+			for (unsigned int i = 0; i < 2; ++i) {
+				int r0 = (p0[i] >> 16) & 0xFF, g0 = (p0[i] >> 8) & 0xFF, b0 = p0[i] & 0xFF;
+				int r1 = (p1[i] >> 16) & 0xFF, g1 = (p1[i] >> 8) & 0xFF, b1 = p1[i] & 0xFF;
+
+				y0[x+i] = ((66*r0 + 129*g0 + 25*b0 + 128) >> 8) + 16;
+				y1[x+i] = ((66*r1 + 129*g1 + 25*b1 + 128) >> 8) + 16;
+
+				r += (r0 + r1 + 1) >> 1;
+				g += (g0 + g1 + 1) >> 1;
+				b += (b0 + b1 + 1) >> 1;
+			}
+
+			uRow[x/2] = ((-38*r - 74*g + 112*b + 256) >> 9) + 128;
+			vRow[x/2] = ((112*r - 94*g - 18*b + 256) >> 9) + 128;
+		}
+	}
+}
@@ -0,0 +1,64 @@
+#ifndef _VIDEOWRITER_H_
+#define _VIDEOWRITER_H_
+
+#include <stdio.h>
+#include <QString>
+#include <QImage>
+#include <QThreadPool>
+#include <QSemaphore>
+
+/**
+	streams frames as YUV4MPEG2 (4:2:0) into a file or a pipe
+
+	An output starting with '|' is run as a shell command which gets the
+	stream on its standard input, e.g. "| ffmpeg -i - movie.mp4". The size of
+	the first frame (rounded down to even numbers) is the size of the video,
+	later frames of another size are scaled.
+
+	Frames are converted to YUV and written by a single worker thread, so
+	they stay in order. At most queueLength frames are waiting, write blocks
+	while the queue is full.
+*/
+class VideoWriter
+{
+	public:
+		VideoWriter(unsigned int queueLength = 4);
+		~VideoWriter();
+
+		int open(const QString& output, unsigned int fps);
+		int close();
+		inline bool isOpen() const { return file != NULL; }
+
+		bool isFull();
+		void write(const QImage& image);
+		inline unsigned int getFrames() const { return frames; }
+
+		// converts rows of 0xAARRGGBB pixels to BT.601 limited range 4:2:0, width and height even
+		static void convert(const unsigned char* pixels, unsigned int stride, unsigned int width, unsigned int height, unsigned char* y, unsigned char* u, unsigned char* v);
+
+	private:
+		FILE* file;
+		bool pipe;
+		unsigned int fps;
+		unsigned int width;
+		unsigned int height;
+		unsigned int frames;
+		/// set by the worker if writing failed
+		bool failed;
+		/// set by the worker with the first frame (frames is counted when queueing)
+		bool headerWritten;
+
+		/// Y, U and V planes of the frame being written
+		unsigned char* planes;
+
+		QThreadPool pool;
+		/// free places in the queue
+		QSemaphore queueSpace;
+		unsigned int queueLength;
+
+		void writeFrame(const QImage& image);
+
+		friend class FrameTask;
+};
+
+#endif
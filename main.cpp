@@ -1,9 +1,96 @@
 #include <QApplication>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "MainWidget.h"
 #include "Simulation.h"
+#include "FARGO.h"
+#include "Interpolation.h"
+#include "BatchRenderer.h"
+
+/**
+	converts the output of a simulation into a pack
+
+	usage: FARGO-Viewer --pack <config file> <pack file> [compression level]
+*/
+static int pack(int argc, char *argv[])
+{
+	if (argc < 4) {
+		fprintf(stderr, "Usage: %s --pack <config file> <pack file> [compression level]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	QCoreApplication app(argc, argv);
+
+	FARGO simulation;
+	if (simulation.loadFromFile(argv[2]) != 0) {
+		return EXIT_FAILURE;
+	}
+
+	int compressionLevel = (argc > 4) ? atoi(argv[4]) : 0;
+
+	return simulation.writePack(argv[3], compressionLevel) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+	compares the interpolation kernel with the reference loop
+
+	usage: FARGO-Viewer --benchmark-interpolation [NRadial] [NAzimuthal] [repetitions]
+*/
+static int benchmarkInterpolation(int argc, char *argv[])
+{
+	unsigned int NRadial = (argc > 2) ? atoi(argv[2]) : 2048;
+	unsigned int NAzimuthal = (argc > 3) ? atoi(argv[3]) : 4096;
+	unsigned int repetitions = (argc > 4) ? atoi(argv[4]) : 20;
+
+	if ((NRadial == 0) || (NAzimuthal == 0) || (repetitions == 0)) {
+		fprintf(stderr, "Usage: %s --benchmark-interpolation [NRadial] [NAzimuthal] [repetitions]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	QCoreApplication app(argc, argv);
+
+	return interpolation::benchmark(NRadial, NAzimuthal, repetitions) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+	renders a range of timesteps to images, see BatchRenderer
+
+	usage: FARGO-Viewer --render <simulation> <output directory> [options]
+*/
+static int render(int argc, char *argv[])
+{
+	if ((argc < 3) || (strcmp(argv[2], "--help") == 0)) {
+		BatchRenderer::printUsage(argv[0]);
+		return (argc < 3) ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	// the OpenGL context needs a (possibly virtual) display
+	QApplication app(argc, argv);
+
+	BatchRenderer renderer;
+	if (renderer.parseArguments(app.arguments().mid(2)) != 0) {
+		BatchRenderer::printUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	return renderer.run() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
 int main(int argc, char *argv[])
 {
+	if ((argc > 1) && (strcmp(argv[1], "--pack") == 0)) {
+		return pack(argc, argv);
+	}
+
+	if ((argc > 1) && (strcmp(argv[1], "--benchmark-interpolation") == 0)) {
+		return benchmarkInterpolation(argc, argv);
+	}
+
+	if ((argc > 1) && (strcmp(argv[1], "--render") == 0)) {
+		return render(argc, argv);
+	}
+
 	QApplication app(argc, argv);
 
 	MainWidget mainWidget;
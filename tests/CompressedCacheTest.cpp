@@ -0,0 +1,97 @@
+#include "CompressedCache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/**
+	round trips of the grid encodings of CompressedCache, returns 0 if all pass
+*/
+
+static int failures = 0;
+
+static void check(bool condition, const char* message, unsigned int index)
+{
+	if (!condition) {
+		fprintf(stderr, "FAIL: %s (value %u)\n", message, index);
+		++failures;
+	}
+}
+
+static void testQuantized(const double* values, unsigned int count, double errorBound)
+{
+	double maximumAbsolute = 0.0;
+	for (unsigned int i = 0; i < count; ++i) {
+		if (isfinite(values[i]) && (fabs(values[i]) > maximumAbsolute)) {
+			maximumAbsolute = fabs(values[i]);
+		}
+	}
+
+	char* data;
+	CompressedCache::encodeQuantized(values, count, errorBound, &data);
+
+	double* decoded = (double*)malloc(count*sizeof(double));
+	CompressedCache::decodeQuantized(data, count, decoded);
+
+	for (unsigned int i = 0; i < count; ++i) {
+		if (isnan(values[i])) {
+			check(isnan(decoded[i]), "NaN is kept", i);
+		} else if (isinf(values[i])) {
+			check(decoded[i] == values[i], "infinity is kept", i);
+		} else {
+			check(fabs(decoded[i] - values[i]) <= errorBound*maximumAbsolute*(1.0 + 1e-9), "quantized value within the error bound", i);
+		}
+	}
+
+	free(decoded);
+	free(data);
+}
+
+static void testLossless(const double* values, unsigned int count)
+{
+	char* data;
+	size_t size = CompressedCache::encodeLossless(values, count, &data);
+
+	double* decoded = (double*)malloc(count*sizeof(double));
+	CompressedCache::decodeLossless(data, size, count, decoded);
+
+	check(memcmp(values, decoded, count*sizeof(double)) == 0, "lossless round trip is exact", 0);
+
+	free(decoded);
+	free(data);
+}
+
+int main()
+{
+	const unsigned int count = 2000;
+	double* values = (double*)malloc(count*sizeof(double));
+
+	for (unsigned int i = 0; i < count; ++i) {
+		values[i] = 1.0 + 0.5*sin(0.01*i) + 1e-3*i;
+	}
+
+	testQuantized(values, count, 1e-4);
+	testLossless(values, count);
+
+	// non-finite values in the middle of blocks, not at their start
+	values[300] = NAN;
+	values[700] = INFINITY;
+	values[701] = -INFINITY;
+	values[1500] = NAN;
+	values[1501] = INFINITY;
+
+	testQuantized(values, count, 1e-4);
+	testQuantized(values, count, 1e-2);
+	testLossless(values, count);
+
+	free(values);
+
+	if (failures > 0) {
+		fprintf(stderr, "%i checks failed\n", failures);
+		return 1;
+	}
+
+	printf("All checks passed\n");
+
+	return 0;
+}
@@ -0,0 +1,12 @@
+# round trip tests, build with qmake && make and run ./CompressedCacheTest (done by .travis.yml)
+
+TEMPLATE = app
+TARGET = CompressedCacheTest
+CONFIG += console
+CONFIG -= app_bundle
+QT -= gui
+DEPENDPATH += ..
+INCLUDEPATH += ..
+
+HEADERS += ../CompressedCache.h ../Snapshot.h ../FieldStatistics.h ../MappedFile.h
+SOURCES += CompressedCacheTest.cpp ../CompressedCache.cpp ../Snapshot.cpp ../FieldStatistics.cpp ../MappedFile.cpp